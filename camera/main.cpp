@@ -2,6 +2,9 @@
 #include <std_image.h>
 
 #include <glad/glad.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/instancing.h>
+#include <learnopengl/render_queue.h>
 #include <GLFW/glfw3.h>
 
 #include <glm/glm.hpp>
@@ -17,10 +20,16 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
+void runInstancingBenchmark(Shader &perDraw, Shader &instanced, unsigned int vao, InstanceBuffer &instances);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// CUBE_COUNT cubes as instances of one draw call (instancing.h), off for the tutorial's 10 cubes with a draw call each
+const bool INSTANCED_CUBES = true;
+const size_t CUBE_COUNT = 100000;
+// CPU cost of a draw call per cube vs. one instanced draw, printed at startup, takes seconds
+const bool INSTANCING_BENCHMARK = false;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -72,12 +81,15 @@ int main()
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    GLState::instance().enable(GL_DEPTH_TEST);
 
     // build and compile our shader zprogram
     // ------------------------------------
     Shader ourShader("../trans_vs.glsl",
                      "../trans_fs.glsl");
+    // the same with the model matrix per instance
+    Shader instancedShader("../trans_instanced_vs.glsl",
+                           "../trans_fs.glsl");
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -141,9 +153,9 @@ int main()
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
 
-    glBindVertexArray(VAO);
+    GLState::instance().bindVertexArray(VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
     // position attribute
@@ -160,7 +172,7 @@ int main()
     // texture 1
     // ---------
     glGenTextures(1, &texture1);
-    glBindTexture(GL_TEXTURE_2D, texture1);
+    GLState::instance().bindTexture(GL_TEXTURE_2D, texture1);
     // set the texture wrapping parameters
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -188,7 +200,7 @@ int main()
     // texture 2
     // ---------
     glGenTextures(1, &texture2);
-    glBindTexture(GL_TEXTURE_2D, texture2);
+    GLState::instance().bindTexture(GL_TEXTURE_2D, texture2);
     // set the texture wrapping parameters
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -218,7 +230,22 @@ int main()
     ourShader.use();
     ourShader.setInt("texture1", 0);
     ourShader.setInt("texture2", 1);
-
+    instancedShader.use();
+    instancedShader.setInt("texture1", 0);
+    instancedShader.setInt("texture2", 1);
+
+    // a field of cubes in front of the camera, their matrices uploaded once, they don't move
+    InstanceBuffer instances;
+    instances.attach(VAO);
+    if(INSTANCING_BENCHMARK)
+        runInstancingBenchmark(ourShader, instancedShader, VAO, instances);
+    std::vector<glm::mat4> cubeModels;
+    InstanceMatrices(ScatterInstances(CUBE_COUNT, glm::vec3(0.0f, 0.0f, -45.0f), 80.0f), 0.0f, cubeModels);
+    instances.upload(cubeModels.data(), cubeModels.size());
+
+    // draws of a frame, submitted in sort key order (render_queue.h)
+    RenderQueue renderQueue;
+    glm::mat4 boxModels[10];
 
     // render loop
     // -----------
@@ -239,12 +266,6 @@ int main()
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // bind textures on corresponding texture units
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture1);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texture2);
-
         // activate shader
         ourShader.use();
 
@@ -259,19 +280,49 @@ int main()
         glm::mat4 view = camera.GetViewMatrix();
         ourShader.setMat4("view", view);
 
-        // render boxes
-        glBindVertexArray(VAO);
-        for (unsigned int i = 0; i < 10; i++)
+        if(INSTANCED_CUBES)
+        {
+            // render all boxes at once, the queue only gets the one draw
+            instancedShader.use();
+            instancedShader.setMat4("projection", projection);
+            instancedShader.setMat4("view", view);
+            uint32_t field = renderQueue.addSource([&](uint32_t) {
+                GLState::instance().bindTexture(0, GL_TEXTURE_2D, texture1);
+                GLState::instance().bindTexture(1, GL_TEXTURE_2D, texture2);
+                instancedShader.use();
+                GLState::instance().bindVertexArray(VAO);
+                glDrawArraysInstanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(instances.size()));
+            });
+            renderQueue.push(MakeRenderKey(RENDER_PASS_OPAQUE, instancedShader.ID, HashCombine(texture1, texture2), VAO, 0), field, 0);
+        }
+        else
         {
-            // calculate the model matrix for each object and pass it to shader before drawing
-            glm::mat4 model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            ourShader.setMat4("model", model);
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            // render boxes: recorded into the queue, which draws them sorted by state and front to back
+            uint32_t boxes = renderQueue.addSource([&](uint32_t i) {
+                // bind textures on corresponding texture units, free after the first box
+                GLState::instance().bindTexture(0, GL_TEXTURE_2D, texture1);
+                GLState::instance().bindTexture(1, GL_TEXTURE_2D, texture2);
+                ourShader.use();
+                GLState::instance().bindVertexArray(VAO);
+                ourShader.setMat4("model", boxModels[i]);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+            });
+            for (unsigned int i = 0; i < 10; i++)
+            {
+                // calculate the model matrix for each object, the queue hands it to the shader before drawing
+                glm::mat4 model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
+                model = glm::translate(model, cubePositions[i]);
+                float angle = 20.0f * i;
+                model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+                boxModels[i] = model;
+
+                float distance = -(view * model[3]).z;
+                renderQueue.push(MakeRenderKey(RENDER_PASS_OPAQUE, ourShader.ID, HashCombine(texture1, texture2), VAO,
+                                               QuantizeRenderDepth(distance, 0.1f, 100.0f)), boxes, i);
+            }
         }
+        renderQueue.sort();
+        renderQueue.submit();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
@@ -281,9 +332,11 @@ int main()
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    GLState::instance().deleteVertexArrays(1, &VAO);
+    GLState::instance().deleteBuffers(1, &VBO);
+    instances.release();
 
+    GLState::instance().report();
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -346,3 +399,43 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
+
+// CPU time of drawing n cubes with a model uniform and a draw call each, the way the tutorial
+// draws its 10, vs. computing their matrices, uploading them and one instanced draw. Both start
+// from the same field, the per draw path builds its matrices one by one as it goes.
+// ------------------------------------------------------------------------------------------
+void runInstancingBenchmark(Shader &perDraw, Shader &instanced, unsigned int vao, InstanceBuffer &instances)
+{
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = camera.GetViewMatrix();
+    for(Shader *shader : { &perDraw, &instanced })
+    {
+        shader->use();
+        shader->setMat4("projection", projection);
+        shader->setMat4("view", view);
+    }
+    GLState::instance().bindVertexArray(vao);
+    std::vector<glm::mat4> matrices;
+    for(size_t count : { size_t(1000), size_t(10000), size_t(100000) })
+    {
+        InstanceField field = ScatterInstances(count, glm::vec3(0.0f, 0.0f, -45.0f), 80.0f);
+        double perDrawMs = MeasureSubmitMilliseconds(3, [&] {
+            perDraw.use();
+            for(size_t i = 0; i < count; i++)
+            {
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), field.positions[i]);
+                model = glm::rotate(model, glm::radians(field.angles[i]), field.axes[i]);
+                perDraw.setMat4("model", model);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+            }
+        });
+        double instancedMs = MeasureSubmitMilliseconds(3, [&] {
+            instanced.use();
+            InstanceMatrices(field, 0.0f, matrices);
+            instances.upload(matrices.data(), matrices.size());
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(count));
+        });
+        std::cout << "INSTANCING:: " << count << " cubes: " << perDrawMs << " ms with a draw call each, " << instancedMs
+                  << " ms instanced (" << perDrawMs / std::max(instancedMs, 1e-6) << "x)" << std::endl;
+    }
+}
@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in mat4 aInstanceModel; // per instance, takes locations 3 to 6
+
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+
+void main()
+{
+	FragPos = vec3(aInstanceModel * vec4(aPos, 1.0));
+    // rotation and translation only, the rotation is its own normal matrix
+    Normal = mat3(aInstanceModel) * aNormal;
+	gl_Position = projection * view * vec4(FragPos, 1.0f);
+	TexCoords = aTexCoords;
+}
\ No newline at end of file
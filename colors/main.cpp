@@ -2,11 +2,16 @@
 #include <std_image.h>
 
 #include <glad/glad.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/instancing.h>
+#include <learnopengl/render_queue.h>
 #include <GLFW/glfw3.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <learnopengl/texture_cache.h>
+
 #include "shader_m.h"
 #include "camera.h"
 
@@ -16,13 +21,16 @@ void on_frame_buffer_size(GLFWwindow* window, int width, int height);
 void on_mouse(GLFWwindow* window, double xpos_in, double ypos_in);
 void on_scroll(GLFWwindow* window, double xoffset, double yoffset);
 void process_input(GLFWwindow* window);
-unsigned int load_texture(const char *path);
+TextureHandle load_texture(const char *path, TextureRole role = TEXTURE_ROLE_COLOR);
 
 // const vars
 const unsigned int kWidth = 800;
 const unsigned int kHeight = 600;
 const std::string  kCube_shader_path = "/Users/yuelu/develop/Graphics/LearnOpenGl/colors/";
 const std::string  kLight_shader_path = "/Users/yuelu/develop/Graphics/LearnOpenGl/colors/";
+// kCube_count cubes as instances of one draw call (instancing.h), off for 10 cubes with a draw call each
+const bool kInstanced_cubes = true;
+const size_t kCube_count = 100000;
 
 Camera camera(glm::vec3(0.0f, 0.0f, 6.0f));
 float lastX = kWidth / 2.0f;
@@ -61,11 +69,14 @@ int main() {
         std::cerr << "[Error] failed to initialize GLAD" << std::endl;
         return -1;
     }
-    glEnable(GL_DEPTH_TEST);
+    GLState::instance().enable(GL_DEPTH_TEST);
 
     // shaders: object
     Shader lighting_shader((kLight_shader_path+"color.vs").c_str(),
                            (kLight_shader_path+"color.fs").c_str());
+    // the same with the model matrix per instance
+    Shader instanced_shader((kLight_shader_path+"color_instanced.vs").c_str(),
+                            (kLight_shader_path+"color.fs").c_str());
     // shader: light source cube
     Shader lightcube_shader((kCube_shader_path+"cube.vs").c_str(),
                             (kCube_shader_path+"cube.fs").c_str());
@@ -131,9 +142,9 @@ int main() {
     unsigned int vbo, cube_vao;
     glGenVertexArrays(1, &cube_vao);
     glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    GLState::instance().bindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    glBindVertexArray(cube_vao);
+    GLState::instance().bindVertexArray(cube_vao);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
     // normal attribute
@@ -145,18 +156,32 @@ int main() {
 
     unsigned int light_cube_vao;
     glGenVertexArrays(1, &light_cube_vao);
-    glBindVertexArray(light_cube_vao);
+    GLState::instance().bindVertexArray(light_cube_vao);
     // we only need to bind to the VBO (to link it with glVertexAttribPointer), no need to fill it;
     // the VBO's data already contains all we need (it's already bound, but we do it again for educational purposes)
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    GLState::instance().bindBuffer(GL_ARRAY_BUFFER, vbo);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    unsigned int diffuse_map = load_texture("/Users/yuelu/develop/Graphics/LearnOpenGl/common/resources/container2.png");
-    unsigned int specular_map = load_texture("/Users/yuelu/develop/Graphics/LearnOpenGl/common/resources/container2_specular.png");
+    TextureHandle diffuse_map = load_texture("/Users/yuelu/develop/Graphics/LearnOpenGl/common/resources/container2.png");
+    TextureHandle specular_map = load_texture("/Users/yuelu/develop/Graphics/LearnOpenGl/common/resources/container2_specular.png", TEXTURE_ROLE_MASK);
     lighting_shader.use();
     lighting_shader.setInt("material.diffuse", 0);
     lighting_shader.setInt("material.specular", 1);
+    instanced_shader.use();
+    instanced_shader.setInt("material.diffuse", 0);
+    instanced_shader.setInt("material.specular", 1);
+
+    // a field of cubes in front of the camera, their matrices uploaded once, they don't move
+    InstanceBuffer instances;
+    instances.attach(cube_vao);
+    std::vector<glm::mat4> field_models;
+    InstanceMatrices(ScatterInstances(kCube_count, glm::vec3(0.0f, 0.0f, -40.0f), 80.0f), 0.0f, field_models);
+    instances.upload(field_models.data(), field_models.size());
+
+    // draws of a frame, submitted in sort key order (render_queue.h)
+    RenderQueue render_queue;
+    glm::mat4 cube_models[10];
 
     while(!glfwWindowShouldClose(window)){
         float current_time = static_cast<float>(glfwGetTime());
@@ -175,49 +200,72 @@ int main() {
         glm::vec3 diffuse_color = light_color * glm::vec3(0.5f);
         glm::vec3 ambient_color = light_color * glm::vec3(0.2f);
 
-        lighting_shader.use();
-        lighting_shader.setVec3("light.position", camera.Position);
-        lighting_shader.setVec3("light.direction", camera.Front);
-        lighting_shader.setFloat("light.cutoff", glm::cos(glm::radians(12.5f)));
-
-        lighting_shader.setVec3("viewPos", camera.Position);
-        lighting_shader.setFloat("material.shininess", 32.0f);
-        lighting_shader.setVec3("light.ambient",  0.2f, 0.2f, 0.2f);
-        lighting_shader.setVec3("light.diffuse",  0.5f, 0.5f, 0.5f);
-        lighting_shader.setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-//        lighting_shader.setFloat("light.constant", 1.0f);
-//        lighting_shader.setFloat("light.linear", 0.09f);
-//        lighting_shader.setFloat("light.quadratic", 0.032);
-
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),
                                                 (float)kWidth / (float)kHeight,
                                                 0.1f,
                                                 100.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        lighting_shader.setMat4("projection", projection);
-        lighting_shader.setMat4("view", view);
+        // both shaders light the same way
+        for(Shader *shader : { &instanced_shader, &lighting_shader }) {
+            shader->use();
+            shader->setVec3("light.position", camera.Position);
+            shader->setVec3("light.direction", camera.Front);
+            shader->setFloat("light.cutoff", glm::cos(glm::radians(12.5f)));
+
+            shader->setVec3("viewPos", camera.Position);
+            shader->setFloat("material.shininess", 32.0f);
+            shader->setVec3("light.ambient",  0.2f, 0.2f, 0.2f);
+            shader->setVec3("light.diffuse",  0.5f, 0.5f, 0.5f);
+            shader->setVec3("light.specular", 1.0f, 1.0f, 1.0f);
+//            shader->setFloat("light.constant", 1.0f);
+//            shader->setFloat("light.linear", 0.09f);
+//            shader->setFloat("light.quadratic", 0.032);
+
+            shader->setMat4("projection", projection);
+            shader->setMat4("view", view);
+        }
 
         // world transformation
         glm::mat4 model = glm::mat4(1.0f);
         lighting_shader.setMat4("model", model);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuse_map);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specular_map);
-
         // render the cube
         // glBindVertexArray(cube_vao);
         // glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(cube_vao);
-        for(unsigned int i=0;i<10;i++) {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cube_positions[i]);
-            float angle = 20.0f * i;
-            model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            lighting_shader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        if(kInstanced_cubes) {
+            // all cubes in one draw, the queue only gets that
+            uint32_t field = render_queue.addSource([&](uint32_t) {
+                GLState::instance().bindTexture(0, GL_TEXTURE_2D, diffuse_map->id);
+                GLState::instance().bindTexture(1, GL_TEXTURE_2D, specular_map->id);
+                instanced_shader.use();
+                GLState::instance().bindVertexArray(cube_vao);
+                glDrawArraysInstanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(instances.size()));
+            });
+            render_queue.push(MakeRenderKey(RENDER_PASS_OPAQUE, instanced_shader.ID, HashCombine(diffuse_map->id, specular_map->id),
+                                            cube_vao, 0), field, 0);
+        } else {
+            // the cubes go through the queue, which draws them sorted by state and front to back
+            uint32_t cubes = render_queue.addSource([&](uint32_t i) {
+                GLState::instance().bindTexture(0, GL_TEXTURE_2D, diffuse_map->id);
+                GLState::instance().bindTexture(1, GL_TEXTURE_2D, specular_map->id);
+                lighting_shader.use();
+                GLState::instance().bindVertexArray(cube_vao);
+                lighting_shader.setMat4("model", cube_models[i]);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+            });
+            for(unsigned int i=0;i<10;i++) {
+                glm::mat4 model = glm::mat4(1.0f);
+                model = glm::translate(model, cube_positions[i]);
+                float angle = 20.0f * i;
+                model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+                cube_models[i] = model;
+                float distance = -(view * model[3]).z;
+                render_queue.push(MakeRenderKey(RENDER_PASS_OPAQUE, lighting_shader.ID, HashCombine(diffuse_map->id, specular_map->id),
+                                                cube_vao, QuantizeRenderDepth(distance, 0.1f, 100.0f)), cubes, i);
+            }
         }
+        render_queue.sort();
+        render_queue.submit();
 
         // also draw the lamp object
 //        lightcube_shader.use();
@@ -235,9 +283,14 @@ int main() {
         glfwPollEvents();
     }
 
-    glDeleteVertexArrays(1, &cube_vao);
-    glDeleteVertexArrays(1, &light_cube_vao);
-    glDeleteBuffers(1, &vbo);
+    GLState::instance().deleteVertexArrays(1, &cube_vao);
+    GLState::instance().deleteVertexArrays(1, &light_cube_vao);
+    GLState::instance().deleteBuffers(1, &vbo);
+    instances.release();
+    // textures are deleted with their last handle, which has to happen while the context is alive
+    diffuse_map.reset();
+    specular_map.reset();
+    GLState::instance().report();
     glfwTerminate();
 
     return 0;
@@ -284,35 +337,8 @@ void on_scroll(GLFWwindow* window, double xoffset, double yoffset) {
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
-unsigned int load_texture(const char *path) {
-    unsigned int texture_id;
-    glGenTextures(1, &texture_id);
-
-    int width, height, nr_components;
-    unsigned char *data = stbi_load(path, &width, &height, &nr_components, 0);
-    if (data) {
-        GLenum format;
-        if (nr_components == 1)
-            format = GL_RED;
-        else if (nr_components == 3)
-            format = GL_RGB;
-        else if (nr_components == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, texture_id);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-    return texture_id;
+// textures come from the process wide cache: the same file is only decoded and uploaded once,
+// block compressed according to its role
+TextureHandle load_texture(const char *path, TextureRole role) {
+    return TextureCache::instance().acquire(path, false, role);
 }
@@ -0,0 +1,55 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// 64 bit MurmurHash2 (MurmurHash64A). Not cryptographic, but it eats 8 bytes per step which keeps
+// hashing a multi-hundred MB model file well below the cost of actually parsing it.
+inline uint64_t HashBytes(const void *data, size_t size, uint64_t seed = 0x9747b28c4c5f3a1dull)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+
+    uint64_t h = seed ^ (size * m);
+
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    const size_t blocks = size / 8;
+    for(size_t i = 0; i < blocks; i++)
+    {
+        uint64_t k;
+        std::memcpy(&k, bytes + i * 8, sizeof(k)); // unaligned safe load
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    const unsigned char *tail = bytes + blocks * 8;
+    switch(size & 7)
+    {
+        case 7: h ^= uint64_t(tail[6]) << 48; [[fallthrough]];
+        case 6: h ^= uint64_t(tail[5]) << 40; [[fallthrough]];
+        case 5: h ^= uint64_t(tail[4]) << 32; [[fallthrough]];
+        case 4: h ^= uint64_t(tail[3]) << 24; [[fallthrough]];
+        case 3: h ^= uint64_t(tail[2]) << 16; [[fallthrough]];
+        case 2: h ^= uint64_t(tail[1]) << 8;  [[fallthrough]];
+        case 1: h ^= uint64_t(tail[0]);
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+// folds another value into an existing hash, used to mix format versions and options into cache keys
+inline uint64_t HashCombine(uint64_t hash, uint64_t value)
+{
+    return HashBytes(&value, sizeof(value), hash);
+}
+#endif
@@ -0,0 +1,252 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// A shadow of the GL binding state, so setting what is already set costs nothing: the bound
+// program, vertex array, active texture unit, the textures of every unit, buffers (plain and
+// indexed) and enable flags. Everything that binds goes through GLState::instance() on the GL
+// thread, anything that changes bindings behind its back has to call invalidate() afterwards.
+// State the shadow doesn't know yet (at startup, after invalidate()) is unknown and the next
+// call always reaches GL.
+//
+// Texture units are only activated when a texture actually changes on them, so drawing the same
+// material twice costs neither glActiveTexture nor glBindTexture. The element array buffer is
+// vertex array state, it becomes unknown whenever the vertex array changes.
+class GLState
+{
+public:
+    struct Stats {
+        size_t issued = 0;  // calls that reached GL
+        size_t elided = 0;  // calls that would have set what was already set
+    };
+
+    static GLState &instance()
+    {
+        static GLState *state = new GLState();
+        return *state;
+    }
+
+    void useProgram(unsigned int program)
+    {
+        if(set(current.program, program))
+            glUseProgram(program);
+    }
+
+    void bindVertexArray(unsigned int vao)
+    {
+        if(!set(current.vertexArray, vao))
+            return;
+        glBindVertexArray(vao);
+        buffer(GL_ELEMENT_ARRAY_BUFFER) = kUnknown;
+    }
+
+    // unit is GL_TEXTURE0 + i, like glActiveTexture
+    void activeTexture(GLenum unit)
+    {
+        if(set(current.activeUnit, unit - GL_TEXTURE0))
+            glActiveTexture(unit);
+    }
+
+    // binds texture on the active unit
+    void bindTexture(GLenum target, unsigned int texture)
+    {
+        unsigned int *slot = textureSlot(current.activeUnit, target);
+        if(!slot)
+        {
+            issue();
+            glBindTexture(target, texture);
+        }
+        else if(set(*slot, texture))
+            glBindTexture(target, texture);
+    }
+
+    // binds texture on unit index (0 for GL_TEXTURE0), activating the unit only if that changes anything
+    void bindTexture(unsigned int unit, GLenum target, unsigned int texture)
+    {
+        unsigned int *slot = textureSlot(unit, target);
+        if(slot && *slot == texture)
+        {
+            stats.elided++;
+            return;
+        }
+        activeTexture(GL_TEXTURE0 + unit);
+        bindTexture(target, texture);
+    }
+
+    void bindBuffer(GLenum target, unsigned int id)
+    {
+        if(set(buffer(target), id))
+            glBindBuffer(target, id);
+    }
+
+    // binds id to binding point index of target and, like GL does, to target itself
+    void bindBufferBase(GLenum target, GLuint index, unsigned int id)
+    {
+        unsigned int &indexed = indexedBuffer(target, index);
+        if(!set(indexed, id))
+            return;
+        glBindBufferBase(target, index, id);
+        buffer(target) = id;
+    }
+
+    void enable(GLenum capability) { setCapability(capability, true); }
+    void disable(GLenum capability) { setCapability(capability, false); }
+
+    // glDelete* wrappers, deleted names are unbound like GL does and may be handed out again
+    void deleteTextures(GLsizei count, const unsigned int *textures)
+    {
+        for(GLsizei i = 0; i < count; i++)
+            for(unsigned int &bound : current.textures)
+                if(bound == textures[i])
+                    bound = 0;
+        glDeleteTextures(count, textures);
+    }
+
+    void deleteBuffers(GLsizei count, const unsigned int *buffers)
+    {
+        for(GLsizei i = 0; i < count; i++)
+            for(Binding &binding : current.buffers)
+                if(binding.id == buffers[i])
+                    binding.id = 0;
+        // whether indexed bindings let go of deleted buffers depends on the GL version
+        for(GLsizei i = 0; i < count; i++)
+            for(IndexedBinding &binding : current.indexedBuffers)
+                if(binding.id == buffers[i])
+                    binding.id = kUnknown;
+        glDeleteBuffers(count, buffers);
+    }
+
+    void deleteVertexArrays(GLsizei count, const unsigned int *arrays)
+    {
+        for(GLsizei i = 0; i < count; i++)
+            if(current.vertexArray == arrays[i])
+            {
+                current.vertexArray = 0;
+                buffer(GL_ELEMENT_ARRAY_BUFFER) = kUnknown;
+            }
+        glDeleteVertexArrays(count, arrays);
+    }
+
+    // a program in use stays alive until it isn't, its name may come back only after that
+    void deleteProgram(unsigned int program)
+    {
+        if(current.program == program)
+            current.program = kUnknown;
+        glDeleteProgram(program);
+    }
+
+    // forget everything, for code that changed bindings without going through here
+    void invalidate() { current = Shadow(); }
+
+    const Stats &statistics() const { return stats; }
+    void resetStatistics() { stats = Stats(); }
+
+    // one line summary of the calls since the last resetStatistics()
+    void report(const char *label = "total") const
+    {
+        size_t total = stats.issued + stats.elided;
+        std::cout << "GL_STATE:: " << label << ": " << stats.issued << " calls issued, " << stats.elided << " elided";
+        if(total)
+            std::cout << " (" << 100.0 * stats.elided / total << "%)";
+        std::cout << std::endl;
+    }
+
+private:
+    static constexpr unsigned int kUnknown = ~0u;
+    static constexpr unsigned int kTextureUnits = 32;  // GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS is at least 48, the tutorials use a handful
+    static constexpr unsigned int kTextureTargets = 4; // see textureSlot
+
+    struct Binding {
+        GLenum target;
+        unsigned int id;
+    };
+
+    struct IndexedBinding {
+        GLenum target;
+        GLuint index;
+        unsigned int id;
+    };
+
+    struct Shadow {
+        unsigned int program = kUnknown;
+        unsigned int vertexArray = kUnknown;
+        unsigned int activeUnit = kUnknown;
+        std::vector<unsigned int> textures = std::vector<unsigned int>(kTextureUnits * kTextureTargets, kUnknown);
+        std::vector<Binding> buffers;
+        std::vector<IndexedBinding> indexedBuffers;
+        std::vector<Binding> capabilities; // id is 0, 1 or kUnknown
+    };
+
+    Shadow current;
+    Stats stats;
+
+    GLState() {}
+
+    // true if value changes, which then has to be issued
+    bool set(unsigned int &shadow, unsigned int value)
+    {
+        if(shadow == value)
+        {
+            stats.elided++;
+            return false;
+        }
+        shadow = value;
+        issue();
+        return true;
+    }
+
+    void issue() { stats.issued++; }
+
+    // nullptr for units and targets outside the shadow, those always reach GL
+    unsigned int *textureSlot(unsigned int unit, GLenum target)
+    {
+        unsigned int index;
+        switch(target)
+        {
+        case GL_TEXTURE_2D: index = 0; break;
+        case GL_TEXTURE_2D_ARRAY: index = 1; break;
+        case GL_TEXTURE_CUBE_MAP: index = 2; break;
+        case GL_TEXTURE_3D: index = 3; break;
+        default: return nullptr;
+        }
+        if(unit >= kTextureUnits)
+            return nullptr;
+        return &current.textures[unit * kTextureTargets + index];
+    }
+
+    static unsigned int &find(std::vector<Binding> &bindings, GLenum target)
+    {
+        for(Binding &binding : bindings)
+            if(binding.target == target)
+                return binding.id;
+        bindings.push_back(Binding{ target, kUnknown });
+        return bindings.back().id;
+    }
+
+    unsigned int &buffer(GLenum target) { return find(current.buffers, target); }
+
+    unsigned int &indexedBuffer(GLenum target, GLuint index)
+    {
+        for(IndexedBinding &binding : current.indexedBuffers)
+            if(binding.target == target && binding.index == index)
+                return binding.id;
+        current.indexedBuffers.push_back(IndexedBinding{ target, index, kUnknown });
+        return current.indexedBuffers.back().id;
+    }
+
+    void setCapability(GLenum capability, bool on)
+    {
+        if(!set(find(current.capabilities, capability), on ? 1u : 0u))
+            return;
+        if(on)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+};
+#endif
@@ -0,0 +1,146 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/thread_pool.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Instanced drawing of many copies of one mesh: the model matrix of every copy lives in a vertex
+// buffer read once per instance (glVertexAttribDivisor), so a single glDrawArraysInstanced /
+// glDrawElementsInstanced draws them all instead of a uniform update and a draw call per copy.
+// Shaders take the matrix as a mat4 attribute at kInstanceMatrixLocation in place of the model
+// uniform, see the *_instanced shaders of the tutorials.
+
+// a mat4 attribute takes four locations, 3 to 6 here, after position, normal and texture coordinates
+const unsigned int kInstanceMatrixLocation = 3;
+
+class InstanceBuffer
+{
+public:
+    InstanceBuffer() = default;
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer &operator=(const InstanceBuffer&) = delete;
+    ~InstanceBuffer()
+    {
+        release();
+    }
+
+    // GL thread, also before the context goes away if the buffer outlives it
+    void release()
+    {
+        if(VBO)
+            GLState::instance().deleteBuffers(1, &VBO);
+        VBO = 0;
+        instances = 0;
+    }
+
+    // GL thread: feeds location .. location + 3 of vao from this buffer, one matrix per instance.
+    // Several vertex arrays can share the buffer.
+    void attach(unsigned int vao, unsigned int location = kInstanceMatrixLocation)
+    {
+        if(!VBO)
+            glGenBuffers(1, &VBO);
+        GLState::instance().bindVertexArray(vao);
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        for(unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(location + column);
+            glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  reinterpret_cast<void*>(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(location + column, 1);
+        }
+        GLState::instance().bindVertexArray(0);
+    }
+
+    // GL thread: replaces the matrices. The old storage is orphaned rather than overwritten, so
+    // draws still reading it never stall the upload.
+    void upload(const glm::mat4 *matrices, size_t count)
+    {
+        if(!VBO)
+            glGenBuffers(1, &VBO);
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), matrices);
+        instances = count;
+    }
+
+    size_t size() const { return instances; }
+
+private:
+    unsigned int VBO = 0;
+    size_t instances = 0;
+};
+
+// objects scattered through a cube: where each one sits and how it is turned
+struct InstanceField {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> axes;    // unit rotation axes
+    std::vector<float> angles;      // degrees at time 0
+    std::vector<float> spins;       // degrees per second, 0 for objects that stand still
+};
+
+// count objects at random spots of a cube of side extent around center, each with its own axis
+// and angle. About spinningShare of them turn at 25 degrees per second like the tutorial's
+// every-third cube. The same seed gives the same field.
+inline InstanceField ScatterInstances(size_t count, glm::vec3 center, float extent, float spinningShare = 0.0f, uint32_t seed = 1)
+{
+    // xorshift32, plenty for placing cubes
+    auto next = [&seed] {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return (seed & 0xffffff) / float(0x1000000);
+    };
+    InstanceField field;
+    field.positions.resize(count);
+    field.axes.resize(count);
+    field.angles.resize(count);
+    field.spins.resize(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        field.positions[i] = center + extent * glm::vec3(next() - 0.5f, next() - 0.5f, next() - 0.5f);
+        glm::vec3 axis(next() - 0.5f, next() - 0.5f, next() - 0.5f);
+        field.axes[i] = glm::length(axis) > 1e-3f ? glm::normalize(axis) : glm::vec3(1.0f, 0.3f, 0.5f);
+        field.angles[i] = 360.0f * next();
+        field.spins[i] = next() < spinningShare ? 25.0f : 0.0f;
+    }
+    return field;
+}
+
+// model matrices of field at time (seconds), rows of instances on the shared thread pool
+inline void InstanceMatrices(const InstanceField &field, float time, std::vector<glm::mat4> &matrices)
+{
+    matrices.resize(field.positions.size());
+    SharedThreadPool().parallelFor(matrices.size(), 4096, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), field.positions[i]);
+            matrices[i] = glm::rotate(model, glm::radians(field.angles[i] + field.spins[i] * time), field.axes[i]);
+        }
+    });
+}
+
+// GL thread: CPU milliseconds per call of submit, averaged over runs. The GPU is drained before
+// every run and the time it then takes isn't counted, only what issuing the calls costs.
+inline double MeasureSubmitMilliseconds(int runs, const std::function<void()> &submit)
+{
+    double total = 0.0;
+    for(int run = 0; run < runs; run++)
+    {
+        glFinish();
+        auto start = std::chrono::steady_clock::now();
+        submit();
+        total += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    glFinish();
+    return total / runs;
+}
+#endif
@@ -0,0 +1,88 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+
+// read-only memory mapping of a whole file. The pages stay valid until close() or destruction,
+// so pointers into data() can be handed straight to glBufferData without an intermediate copy.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &path)
+    {
+        open(path);
+    }
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // maps the file at path, returns false if it doesn't exist or can't be mapped
+    bool open(const std::string &path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(st.st_size);
+        opened = true;
+        // mmap refuses zero sized mappings, an empty file is still a valid (empty) file though
+        if(length > 0)
+        {
+            void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapping == MAP_FAILED)
+            {
+                length = 0;
+                opened = false;
+            }
+            else
+                address = mapping;
+        }
+        // the mapping keeps its own reference to the file
+        ::close(fd);
+        return opened;
+    }
+
+    void close()
+    {
+        if(address)
+            munmap(address, length);
+        address = nullptr;
+        length = 0;
+        opened = false;
+    }
+
+    // tells the kernel the mapping is read front to back once: aggressive read-ahead, and pages
+    // behind the reader may be dropped early
+    void adviseSequential() const
+    {
+        if(address)
+            madvise(address, length, MADV_SEQUENTIAL);
+    }
+
+    bool isOpen() const { return opened; }
+    const unsigned char *data() const { return static_cast<const unsigned char*>(address); }
+    size_t size() const { return length; }
+
+private:
+    void  *address = nullptr;
+    size_t length = 0;
+    bool   opened = false;
+};
+#endif
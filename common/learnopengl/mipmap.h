@@ -0,0 +1,268 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <learnopengl/simd.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Mip chains built on the CPU instead of glGenerateMipmap, so every driver gets the same filter
+// and a cached chain costs nothing at startup. Levels are resampled from the full precision
+// float level above (not from 8 bit), one RGBA pixel per SIMD vector, rows of every level on the
+// shared thread pool. sRGB color is filtered in linear light, normal maps are renormalized after
+// every step.
+enum MipFilter {
+    MIP_FILTER_BOX,     // average of the 2x2 (or 3x2, 2x3, 3x3 for odd sizes) footprint
+    MIP_FILTER_KAISER   // Kaiser windowed sinc, sharper than the box at the cost of slight ringing
+};
+
+struct MipOptions {
+    bool srgb = false;       // color channels are sRGB encoded, alpha never is
+    bool normalMap = false;  // rgb holds a unit vector mapped to [0, 1]
+    MipFilter filter = MIP_FILTER_BOX;
+    size_t levels = 0;       // length of the chain, 0 for all levels down to 1x1
+};
+
+struct MipLevel {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgba;
+};
+
+const size_t kMipRowGrain = 32; // rows per task of one resampling pass
+
+namespace mip
+{
+    inline const float *SrgbToLinearTable()
+    {
+        static const std::vector<float> table = [] {
+            std::vector<float> t(256);
+            for(int i = 0; i < 256; i++)
+            {
+                float c = i / 255.0f;
+                t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return t;
+        }();
+        return table.data();
+    }
+
+    // linear [0, 1] -> sRGB byte, through 4096 steps of linear
+    inline uint8_t LinearToSrgb(float linear)
+    {
+        static const std::vector<uint8_t> table = [] {
+            std::vector<uint8_t> t(4096);
+            for(int i = 0; i < 4096; i++)
+            {
+                float c = i / 4095.0f;
+                float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+                t[i] = static_cast<uint8_t>(std::lround(std::min(std::max(s, 0.0f), 1.0f) * 255.0f));
+            }
+            return t;
+        }();
+        return table[std::lround(std::min(std::max(linear, 0.0f), 1.0f) * 4095.0f)];
+    }
+
+    // zeroth order modified Bessel function of the first kind, for the Kaiser window
+    inline double BesselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for(int k = 1; k < 32; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // the source pixels and weights behind one destination pixel along an axis
+    struct Taps {
+        int first = 0;
+        std::vector<float> weights;
+    };
+
+    // resampling size -> outSize along one axis. Weights are in destination pixel units: the box
+    // covers one destination pixel, the windowed sinc two on either side.
+    inline std::vector<Taps> BuildTaps(int size, int outSize, MipFilter filter)
+    {
+        const double radius = filter == MIP_FILTER_BOX ? 0.5 : 2.0, alpha = 4.0;
+        double scale = double(size) / outSize;
+        std::vector<Taps> taps(outSize);
+        for(int j = 0; j < outSize; j++)
+        {
+            double center = (j + 0.5) * scale;
+            int first = static_cast<int>(std::floor(center - radius * scale));
+            int last = static_cast<int>(std::ceil(center + radius * scale));
+            Taps &t = taps[j];
+            t.first = first;
+            double total = 0.0;
+            for(int i = first; i < last; i++)
+            {
+                double weight;
+                if(filter == MIP_FILTER_BOX)
+                {
+                    // overlap of source pixel [i, i + 1] with the destination footprint
+                    weight = std::max(0.0, std::min(i + 1.0, center + 0.5 * scale) - std::max(double(i), center - 0.5 * scale));
+                }
+                else
+                {
+                    double x = (i + 0.5 - center) / scale, ratio = x / radius;
+                    const double pi = 3.14159265358979323846;
+                    double sinc = x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x);
+                    weight = std::abs(ratio) >= 1.0 ? 0.0 : sinc * BesselI0(alpha * std::sqrt(1.0 - ratio * ratio)) / BesselI0(alpha);
+                }
+                t.weights.push_back(static_cast<float>(weight));
+                total += weight;
+            }
+            for(float &weight : t.weights)
+                weight = static_cast<float>(weight / total);
+        }
+        return taps;
+    }
+
+    // one separable resampling step of a float RGBA image, edges clamp
+    inline std::vector<float> Resample(const std::vector<float> &in, int width, int height, int outWidth, int outHeight, MipFilter filter)
+    {
+        using namespace simd;
+        std::vector<Taps> horizontal = BuildTaps(width, outWidth, filter), vertical = BuildTaps(height, outHeight, filter);
+        std::vector<float> rows(size_t(outWidth) * height * 4), out(size_t(outWidth) * outHeight * 4);
+        SharedThreadPool().parallelFor(height, kMipRowGrain, [&](size_t begin, size_t end) {
+            for(size_t y = begin; y < end; y++)
+            {
+                const float *row = in.data() + y * width * 4;
+                for(int x = 0; x < outWidth; x++)
+                {
+                    const Taps &t = horizontal[x];
+                    float4 sum = zero4();
+                    for(size_t k = 0; k < t.weights.size(); k++)
+                    {
+                        int i = std::min(std::max(t.first + int(k), 0), width - 1);
+                        sum = add4(sum, mul4(load4(row + size_t(i) * 4), splat4(t.weights[k])));
+                    }
+                    store4(rows.data() + (y * outWidth + x) * 4, sum);
+                }
+            }
+        });
+        SharedThreadPool().parallelFor(outHeight, kMipRowGrain, [&](size_t begin, size_t end) {
+            for(size_t y = begin; y < end; y++)
+            {
+                const Taps &t = vertical[y];
+                float *target = out.data() + y * outWidth * 4;
+                for(size_t k = 0; k < t.weights.size(); k++)
+                {
+                    int i = std::min(std::max(t.first + int(k), 0), height - 1);
+                    const float *source = rows.data() + size_t(i) * outWidth * 4;
+                    float4 weight = splat4(t.weights[k]);
+                    for(int x = 0; x < outWidth; x++)
+                    {
+                        float4 value = mul4(load4(source + x * 4), weight);
+                        store4(target + x * 4, k == 0 ? value : add4(load4(target + x * 4), value));
+                    }
+                }
+            }
+        });
+        return out;
+    }
+
+    // count pixels of 1 to 4 channels as tightly packed RGBA8, gray expands to all three color channels
+    inline std::vector<uint8_t> ExpandToRgba8(const uint8_t *pixels, size_t count, int components)
+    {
+        std::vector<uint8_t> rgba(count * 4);
+        for(size_t i = 0; i < count; i++)
+        {
+            const uint8_t *p = pixels + i * components;
+            uint8_t *q = rgba.data() + i * 4;
+            switch(components)
+            {
+            case 1: q[0] = q[1] = q[2] = p[0]; q[3] = 255; break;
+            case 2: q[0] = q[1] = q[2] = p[0]; q[3] = p[1]; break;
+            case 3: q[0] = p[0]; q[1] = p[1]; q[2] = p[2]; q[3] = 255; break;
+            default: std::copy(p, p + 4, q); break;
+            }
+        }
+        return rgba;
+    }
+
+    // 8 bit RGBA to the float space the filter works in
+    inline std::vector<float> ToFloat(const uint8_t *rgba, size_t pixels, const MipOptions &options)
+    {
+        const float *linear = SrgbToLinearTable();
+        std::vector<float> out(pixels * 4);
+        for(size_t i = 0; i < pixels * 4; i++)
+        {
+            bool color = (i & 3) != 3;
+            if(options.normalMap && color)
+                out[i] = rgba[i] * (2.0f / 255.0f) - 1.0f;
+            else
+                out[i] = options.srgb && color ? linear[rgba[i]] : rgba[i] * (1.0f / 255.0f);
+        }
+        return out;
+    }
+
+    // unit length for the xyz of every pixel, flat up for pixels that averaged out to nothing
+    inline void Renormalize(std::vector<float> &pixels)
+    {
+        for(size_t i = 0; i < pixels.size(); i += 4)
+        {
+            float *n = pixels.data() + i;
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if(length < 1e-6f)
+            {
+                n[0] = n[1] = 0.0f;
+                n[2] = 1.0f;
+                continue;
+            }
+            n[0] /= length;
+            n[1] /= length;
+            n[2] /= length;
+        }
+    }
+
+    inline std::vector<uint8_t> ToBytes(const std::vector<float> &pixels, const MipOptions &options)
+    {
+        std::vector<uint8_t> out(pixels.size());
+        for(size_t i = 0; i < pixels.size(); i++)
+        {
+            bool color = (i & 3) != 3;
+            float v = pixels[i];
+            if(options.normalMap && color)
+                v = v * 0.5f + 0.5f;
+            else if(options.srgb && color)
+            {
+                out[i] = LinearToSrgb(v);
+                continue;
+            }
+            out[i] = static_cast<uint8_t>(std::lround(std::min(std::max(v, 0.0f), 1.0f) * 255.0f));
+        }
+        return out;
+    }
+}
+
+// every level of a tightly packed RGBA8 image down to 1x1, level 0 is a copy of the image
+inline std::vector<MipLevel> BuildMipChain(const uint8_t *rgba, int width, int height, const MipOptions &options = MipOptions())
+{
+    std::vector<MipLevel> levels(1);
+    levels[0].width = width;
+    levels[0].height = height;
+    levels[0].rgba.assign(rgba, rgba + size_t(width) * height * 4);
+    std::vector<float> current = mip::ToFloat(rgba, size_t(width) * height, options);
+    while((width > 1 || height > 1) && (options.levels == 0 || levels.size() < options.levels))
+    {
+        int outWidth = std::max(1, width / 2), outHeight = std::max(1, height / 2);
+        current = mip::Resample(current, width, height, outWidth, outHeight, options.filter);
+        if(options.normalMap)
+            mip::Renormalize(current);
+        width = outWidth;
+        height = outHeight;
+        MipLevel level;
+        level.width = width;
+        level.height = height;
+        level.rgba = mip::ToBytes(current, options);
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
+#endif
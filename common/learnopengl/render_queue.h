@@ -0,0 +1,152 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <learnopengl/content_hash.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Draws recorded first and submitted later, in the order of a 64 bit sort key instead of the
+// order the code happens to reach them. An item is the key plus which source recorded it and
+// that source's own command index; a source is a callback that draws one of its commands. After
+// sort() (a radix sort of the keys) submit() hands every command back to its source, so draws
+// sharing a program, material and vertex array follow each other whoever recorded them and the
+// binds in between become no-ops in GLState.
+//
+// Key layout, most significant bits first:
+//   opaque       pass (4) | program (10) | material (16) | vertex array (10) | depth (24)
+//   transparent  pass (4) | ~depth (24)  | program (10)  | material (16) | vertex array (10)
+// Opaque draws group by state and go front to back within a group, which is what early z wants
+// once the state is set. Transparent draws go strictly back to front, their order is what blends
+// right. Programs, materials and vertex arrays only need to be equal for equal state, wider ids
+// are folded into their bits (a collision costs a state change, never a wrong draw).
+enum RenderPass {
+    RENDER_PASS_OPAQUE = 0,
+    RENDER_PASS_TRANSPARENT = 1
+};
+
+const int kRenderKeyDepthBits = 24;
+
+// view space distance in [nearPlane, farPlane] quantized to kRenderKeyDepthBits, nearer is smaller
+inline uint32_t QuantizeRenderDepth(float distance, float nearPlane, float farPlane)
+{
+    float t = (distance - nearPlane) / (farPlane - nearPlane);
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    return static_cast<uint32_t>(t * float((1u << kRenderKeyDepthBits) - 1));
+}
+
+// an id of up to 64 bits folded into bits, ids that fit stay unchanged
+inline uint64_t FoldRenderId(uint64_t id, int bits)
+{
+    uint64_t mask = (uint64_t(1) << bits) - 1;
+    return id <= mask ? id : HashCombine(0, id) & mask;
+}
+
+inline uint64_t MakeRenderKey(RenderPass pass, unsigned int program, uint64_t material, unsigned int vertexArray, uint32_t depth)
+{
+    uint64_t state = FoldRenderId(program, 10) << 26 | FoldRenderId(material, 16) << 10 | FoldRenderId(vertexArray, 10);
+    depth &= (1u << kRenderKeyDepthBits) - 1;
+    if(pass == RENDER_PASS_TRANSPARENT)
+        return uint64_t(pass) << 60 | uint64_t((1u << kRenderKeyDepthBits) - 1 - depth) << 36 | state;
+    return uint64_t(pass) << 60 | state << kRenderKeyDepthBits | depth;
+}
+
+struct RenderItem {
+    uint64_t key;
+    uint32_t source;
+    uint32_t command;
+};
+
+// LSD radix sort of items by key, 8 bits per pass. All histograms are counted in one sweep and
+// passes whose byte is the same for every item are skipped, so keys that only differ in a few
+// fields cost a few passes. Stable, scratch is resized to items.size().
+inline void RadixSortRenderItems(std::vector<RenderItem> &items, std::vector<RenderItem> &scratch)
+{
+    size_t count = items.size();
+    if(count < 2)
+        return;
+    scratch.resize(count);
+    size_t histograms[8][256] = {};
+    for(const RenderItem &item : items)
+        for(int pass = 0; pass < 8; pass++)
+            histograms[pass][(item.key >> (pass * 8)) & 0xff]++;
+    for(int pass = 0; pass < 8; pass++)
+    {
+        size_t *histogram = histograms[pass];
+        if(histogram[(items[0].key >> (pass * 8)) & 0xff] == count)
+            continue;
+        size_t offset = 0;
+        for(int digit = 0; digit < 256; digit++)
+        {
+            size_t n = histogram[digit];
+            histogram[digit] = offset;
+            offset += n;
+        }
+        for(const RenderItem &item : items)
+            scratch[histogram[(item.key >> (pass * 8)) & 0xff]++] = item;
+        items.swap(scratch);
+    }
+}
+
+class RenderQueue
+{
+public:
+    typedef std::function<void(uint32_t command)> Source;
+
+    // totals since the last resetStatistics()
+    struct Stats {
+        size_t items = 0;          // draws submitted
+        size_t frames = 0;         // submit() calls
+        double sortSeconds = 0.0;  // spent in sort()
+    };
+
+    // a source draws its commands on the GL thread, it has to outlive the next submit()
+    uint32_t addSource(Source source)
+    {
+        sources.push_back(std::move(source));
+        return static_cast<uint32_t>(sources.size() - 1);
+    }
+
+    void push(uint64_t key, uint32_t source, uint32_t command)
+    {
+        items.push_back(RenderItem{ key, source, command });
+    }
+
+    void sort()
+    {
+        auto start = std::chrono::steady_clock::now();
+        RadixSortRenderItems(items, scratch);
+        stats.sortSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // hands every item to its source in key order, then forgets items and sources
+    void submit()
+    {
+        for(const RenderItem &item : items)
+            sources[item.source](item.command);
+        stats.items += items.size();
+        stats.frames++;
+        clear();
+    }
+
+    void clear()
+    {
+        items.clear();
+        sources.clear();
+    }
+
+    size_t size() const { return items.size(); }
+    const std::vector<RenderItem> &queued() const { return items; }
+
+    const Stats &statistics() const { return stats; }
+    void resetStatistics() { stats = Stats(); }
+
+private:
+    std::vector<RenderItem> items, scratch;
+    std::vector<Source> sources;
+    Stats stats;
+};
+#endif
@@ -2,6 +2,7 @@
 #define SHADER_H
 
 #include <glad/glad.h>
+#include <learnopengl/gl_state.h>
 
 #include <string>
 #include <fstream>
@@ -72,7 +73,7 @@ public:
     // ------------------------------------------------------------------------
     void use()
     {
-        glUseProgram(ID);
+        GLState::instance().useProgram(ID);
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
@@ -0,0 +1,85 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Four float lanes on SSE2 or NEON, plain arrays everywhere else. Just the handful of operations
+// the bulk loops of the project need, all loads and stores are unaligned.
+namespace simd
+{
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+    typedef __m128 float4;
+    inline float4 load4(const float *p) { return _mm_loadu_ps(p); }
+    inline void store4(float *p, float4 v) { _mm_storeu_ps(p, v); }
+    inline float4 zero4() { return _mm_setzero_ps(); }
+    inline float4 splat4(float x) { return _mm_set1_ps(x); }
+    inline float4 add4(float4 a, float4 b) { return _mm_add_ps(a, b); }
+    inline float4 sub4(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+    inline float4 mul4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+    inline float4 div4(float4 a, float4 b) { return _mm_div_ps(a, b); }
+    inline float4 sqrt4(float4 a) { return _mm_sqrt_ps(a); }
+    // a with its sign flipped in the lanes where s is negative
+    inline float4 xorsign4(float4 a, float4 s) { return _mm_xor_ps(a, _mm_and_ps(s, _mm_set1_ps(-0.0f))); }
+#elif defined(__ARM_NEON)
+    typedef float32x4_t float4;
+    inline float4 load4(const float *p) { return vld1q_f32(p); }
+    inline void store4(float *p, float4 v) { vst1q_f32(p, v); }
+    inline float4 zero4() { return vdupq_n_f32(0.0f); }
+    inline float4 splat4(float x) { return vdupq_n_f32(x); }
+    inline float4 add4(float4 a, float4 b) { return vaddq_f32(a, b); }
+    inline float4 sub4(float4 a, float4 b) { return vsubq_f32(a, b); }
+    inline float4 mul4(float4 a, float4 b) { return vmulq_f32(a, b); }
+#if defined(__aarch64__)
+    inline float4 div4(float4 a, float4 b) { return vdivq_f32(a, b); }
+    inline float4 sqrt4(float4 a) { return vsqrtq_f32(a); }
+#else
+    inline float4 div4(float4 a, float4 b)
+    {
+        float4 r = vrecpeq_f32(b);
+        r = vmulq_f32(r, vrecpsq_f32(b, r));
+        r = vmulq_f32(r, vrecpsq_f32(b, r));
+        return vmulq_f32(a, r);
+    }
+    inline float4 sqrt4(float4 a)
+    {
+        float4 r = vrsqrteq_f32(vmaxq_f32(a, vdupq_n_f32(1e-30f)));
+        r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(a, r), r));
+        r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(a, r), r));
+        return vmulq_f32(a, r);
+    }
+#endif
+    inline float4 xorsign4(float4 a, float4 s)
+    {
+        uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(s), vdupq_n_u32(0x80000000u));
+        return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), sign));
+    }
+#else
+    struct float4 { float v[4]; };
+    inline float4 load4(const float *p) { float4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+    inline void store4(float *p, float4 v) { memcpy(p, v.v, sizeof(v.v)); }
+    inline float4 zero4() { return float4{ { 0.0f, 0.0f, 0.0f, 0.0f } }; }
+    inline float4 splat4(float x) { return float4{ { x, x, x, x } }; }
+    template<typename Op> inline float4 map4(float4 a, float4 b, Op op)
+    {
+        float4 r;
+        for(int i = 0; i < 4; i++)
+            r.v[i] = op(a.v[i], b.v[i]);
+        return r;
+    }
+    inline float4 add4(float4 a, float4 b) { return map4(a, b, [](float x, float y) { return x + y; }); }
+    inline float4 sub4(float4 a, float4 b) { return map4(a, b, [](float x, float y) { return x - y; }); }
+    inline float4 mul4(float4 a, float4 b) { return map4(a, b, [](float x, float y) { return x * y; }); }
+    inline float4 div4(float4 a, float4 b) { return map4(a, b, [](float x, float y) { return x / y; }); }
+    inline float4 sqrt4(float4 a) { return map4(a, a, [](float x, float) { return std::sqrt(x); }); }
+    inline float4 xorsign4(float4 a, float4 s) { return map4(a, s, [](float x, float y) { return std::signbit(y) ? -x : x; }); }
+#endif
+}
+#endif
@@ -0,0 +1,115 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/texture_compression.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+// Texture arrays: mip chains with the same size, format and level count become the layers of one
+// GL_TEXTURE_2D_ARRAY. Everything drawn from the same arrays binds them once and tells the shader
+// which layer to sample through a vertex attribute instead of switching textures between draws.
+// The arrays are plain TextureObjects outside of the TextureCache index (key 0), they die with
+// their last handle like any other texture.
+
+// the least GL_MAX_ARRAY_TEXTURE_LAYERS a 3.3 context has, and what a byte layer index holds
+const size_t kMaxTextureArrayLayers = 256;
+
+// where one image ended up
+struct TextureArrayLayer {
+    TextureHandle array;     // null for images that weren't valid
+    unsigned int layer = 0;
+};
+
+// GL thread: uploads images[0..count) as the layers of textureID. Formats the context can't
+// sample are decoded and stored as RGBA8, like UploadCompressedImage does.
+inline void UploadTextureArray(unsigned int textureID, const CompressedImage *const *images, size_t count)
+{
+    const CompressedImage &first = *images[0];
+    bool supported = CompressedFormatUsable(first.format);
+    bool rgba = first.format == GL_RGBA8 || !supported;
+    GLState::instance().bindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    for(size_t level = 0; level < first.levels.size(); level++)
+    {
+        const CompressedLevel &l = first.levels[level];
+        if(rgba)
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, GLint(level), GL_RGBA8, l.width, l.height, GLsizei(count), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        else
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, GLint(level), first.format, l.width, l.height, GLsizei(count), 0,
+                                   GLsizei(l.size * count), nullptr);
+        for(size_t layer = 0; layer < count; layer++)
+        {
+            const CompressedImage &image = *images[layer];
+            const uint8_t *data = image.data() + image.levels[level].offset;
+            if(rgba)
+            {
+                std::vector<uint8_t> decoded;
+                if(first.format != GL_RGBA8)
+                {
+                    decoded = DecodeCompressedLevel(image, level);
+                    data = decoded.data();
+                }
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, GLint(level), 0, 0, GLint(layer), l.width, l.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            }
+            else
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, GLint(level), 0, 0, GLint(layer), l.width, l.height, 1, first.format,
+                                          GLsizei(l.size), data);
+        }
+    }
+    SetCompressedImageParameters(first, GL_TEXTURE_2D_ARRAY);
+}
+
+// GL thread: packs images into as few texture arrays as their sizes, formats and mip counts allow,
+// in order of first appearance. Returns the array and layer of every image.
+inline std::vector<TextureArrayLayer> BuildTextureArrays(const std::vector<const CompressedImage*> &images)
+{
+    typedef std::tuple<GLenum, int, int, size_t> GroupKey; // format, width, height, levels
+    std::map<GroupKey, std::vector<size_t>> groups;
+    std::vector<GroupKey> order;
+    for(size_t i = 0; i < images.size(); i++)
+    {
+        if(!images[i] || !images[i]->valid())
+            continue;
+        GroupKey key(images[i]->format, images[i]->width(), images[i]->height(), images[i]->levels.size());
+        std::vector<size_t> &members = groups[key];
+        if(members.empty())
+            order.push_back(key);
+        members.push_back(i);
+    }
+
+    std::vector<TextureArrayLayer> layers(images.size());
+    std::vector<const CompressedImage*> batch;
+    for(const GroupKey &key : order)
+    {
+        const std::vector<size_t> &members = groups[key];
+        for(size_t begin = 0; begin < members.size(); begin += kMaxTextureArrayLayers)
+        {
+            size_t count = std::min(kMaxTextureArrayLayers, members.size() - begin);
+            batch.clear();
+            for(size_t i = 0; i < count; i++)
+                batch.push_back(images[members[begin + i]]);
+            TextureHandle array = std::make_shared<TextureObject>();
+            glGenTextures(1, &array->id);
+            array->width = std::get<1>(key);
+            array->height = std::get<2>(key);
+            array->format = std::get<0>(key);
+            array->layers = static_cast<int>(count);
+            UploadTextureArray(array->id, batch.data(), count);
+            for(size_t i = 0; i < count; i++)
+            {
+                layers[members[begin + i]].array = array;
+                layers[members[begin + i]].layer = static_cast<unsigned int>(i);
+            }
+        }
+    }
+    return layers;
+}
+#endif
@@ -0,0 +1,228 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/texture_compression.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+// Texture atlases: small textures (icons, decals, little tiling masks) packed into a few large
+// pages, so the meshes using them share one texture object instead of switching between many
+// tiny ones. Meshes reach their texture through a uv offset and scale (AtlasUvRect); shaders
+// apply it to fract(uv) with the gradients of the unwrapped coordinates, so textures keep tiling.
+// To match, every texture is surrounded by a gutter of wrapped pixels (the opposite edge's), and
+// filter taps across an edge read what a repeating sampler would. The corner of every texture
+// sits on a grid that keeps it on whole pixels down to the page's coarsest mip level, where the
+// gutter is one pixel wide, so filtering never bleeds between neighbours. Pages only keep that
+// many levels. Sizes aren't rounded: below the top level, the texels on the right and bottom edge
+// of a texture whose size isn't a multiple of the grid also cover some of its gutter, which holds
+// wrapped pixels again.
+
+struct AtlasOptions {
+    bool enabled = false;
+    int pageSize = 1024;        // pages are pageSize x pageSize pixels
+    int maxTextureSize = 256;   // textures with both sides up to this go into pages, larger ones stay on their own
+    int gutter = 4;             // pixels around every texture, a power of two: pages get log2(gutter) + 1 mip levels
+};
+
+// bump whenever what ComposeAtlasPage writes or where PackAtlas puts it changes, pages cached
+// with an older version are then composed again
+const uint32_t kAtlasPageVersion = 2;
+
+// where a texture ended up, in pixels of its page's top level, without the gutter
+struct AtlasRect {
+    size_t page = 0;
+    int x = 0, y = 0;
+    int width = 0, height = 0;
+};
+
+struct AtlasPacking {
+    std::vector<AtlasRect> rects; // one per packed size, in input order
+    size_t pageCount = 0;
+    size_t texturePixels = 0;     // area covered by the textures themselves
+    size_t paddedPixels = 0;      // the same including gutters and grid alignment
+
+    // share of the page area covered by texture pixels
+    double efficiency(int pageSize) const
+    {
+        return pageCount ? double(texturePixels) / (double(pageSize) * pageSize * pageCount) : 0.0;
+    }
+};
+
+// mip levels of a page, the last one still has a one pixel gutter
+inline size_t AtlasMipLevels(const AtlasOptions &options)
+{
+    size_t levels = 1;
+    for(int gutter = options.gutter; gutter > 1; gutter /= 2)
+        levels++;
+    return levels;
+}
+
+namespace atlas
+{
+    // one horizontal segment of the skyline: [x, x + width) is filled up to y
+    struct SkylineNode {
+        int x, y, width;
+    };
+
+    // lowest y a width x height box starting at node index can sit at, -1 if it leaves the page
+    inline int SkylineFit(const std::vector<SkylineNode> &skyline, size_t index, int width, int height, int size)
+    {
+        if(skyline[index].x + width > size)
+            return -1;
+        int y = 0;
+        for(size_t i = index; width > 0; i++)
+        {
+            if(i == skyline.size())
+                return -1;
+            y = std::max(y, skyline[i].y);
+            if(y + height > size)
+                return -1;
+            width -= skyline[i].width;
+        }
+        return y;
+    }
+
+    // raises the skyline under a box placed at node index
+    inline void SkylineInsert(std::vector<SkylineNode> &skyline, size_t index, int y, int width, int height)
+    {
+        SkylineNode node = { skyline[index].x, y + height, width };
+        skyline.insert(skyline.begin() + index, node);
+        // shorten or drop the nodes the box covers now
+        for(size_t i = index + 1; i < skyline.size(); )
+        {
+            int shrink = node.x + node.width - skyline[i].x;
+            if(shrink <= 0)
+                break;
+            skyline[i].x += shrink;
+            skyline[i].width -= shrink;
+            if(skyline[i].width > 0)
+                break;
+            skyline.erase(skyline.begin() + i);
+        }
+        // neighbours at the same height become one node
+        for(size_t i = 0; i + 1 < skyline.size(); )
+        {
+            if(skyline[i].y == skyline[i + 1].y)
+            {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+            }
+            else
+                i++;
+        }
+    }
+
+    inline int AlignUp(int value, int alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+// bin packs textures of sizes (width, height) onto pages: tallest first, each at the lowest then
+// leftmost spot of the first page with room (bottom left skyline). Sizes larger than
+// maxTextureSize are the caller's business, they are packed if they fit a page at all.
+inline AtlasPacking PackAtlas(const std::vector<std::pair<int, int>> &sizes, const AtlasOptions &options)
+{
+    AtlasPacking packing;
+    packing.rects.resize(sizes.size());
+    int alignment = 1 << (AtlasMipLevels(options) - 1);
+    std::vector<size_t> order(sizes.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return std::max(sizes[a].first, sizes[a].second) > std::max(sizes[b].first, sizes[b].second);
+    });
+
+    // the gutter in front of a texture is rounded up to the grid, so the texture starts on it
+    int lead = atlas::AlignUp(options.gutter, alignment);
+    std::vector<std::vector<atlas::SkylineNode>> pages;
+    for(size_t i : order)
+    {
+        int width = atlas::AlignUp(lead + sizes[i].first + options.gutter, alignment);
+        int height = atlas::AlignUp(lead + sizes[i].second + options.gutter, alignment);
+        if(width > options.pageSize || height > options.pageSize)
+            continue;
+        size_t bestPage = pages.size(), bestNode = 0;
+        int bestY = -1, bestX = 0;
+        for(size_t page = 0; page < pages.size() && bestY < 0; page++)
+            for(size_t node = 0; node < pages[page].size(); node++)
+            {
+                int y = atlas::SkylineFit(pages[page], node, width, height, options.pageSize);
+                if(y >= 0 && (bestY < 0 || y < bestY || (y == bestY && pages[page][node].x < bestX)))
+                {
+                    bestPage = page;
+                    bestNode = node;
+                    bestY = y;
+                    bestX = pages[page][node].x;
+                }
+            }
+        if(bestY < 0)
+        {
+            pages.push_back(std::vector<atlas::SkylineNode>(1, atlas::SkylineNode{ 0, 0, options.pageSize }));
+            bestPage = pages.size() - 1;
+            bestNode = 0;
+            bestY = 0;
+            bestX = 0;
+        }
+        atlas::SkylineInsert(pages[bestPage], bestNode, bestY, width, height);
+        AtlasRect &rect = packing.rects[i];
+        rect.page = bestPage;
+        rect.x = bestX + lead;
+        rect.y = bestY + lead;
+        rect.width = sizes[i].first;
+        rect.height = sizes[i].second;
+        packing.texturePixels += size_t(rect.width) * rect.height;
+        packing.paddedPixels += size_t(width) * height;
+    }
+    packing.pageCount = pages.size();
+    return packing;
+}
+
+// the RGBA8 top level of page: images[i] (tightly packed RGBA8 of rects[i]'s size) at rects[i],
+// its gutter continuing the image as if it repeated. Rows are filled on the shared thread pool.
+inline std::vector<uint8_t> ComposeAtlasPage(const AtlasPacking &packing, size_t page, const std::vector<const uint8_t*> &images,
+                                             const AtlasOptions &options)
+{
+    size_t size = size_t(options.pageSize);
+    std::vector<uint8_t> pixels(size * size * 4, 0);
+    std::vector<size_t> members;
+    for(size_t i = 0; i < packing.rects.size(); i++)
+        if(packing.rects[i].page == page && images[i] && packing.rects[i].width > 0)
+            members.push_back(i);
+    SharedThreadPool().parallelFor(members.size(), 1, [&](size_t begin, size_t end) {
+        for(size_t m = begin; m < end; m++)
+        {
+            const AtlasRect &rect = packing.rects[members[m]];
+            const uint8_t *image = images[members[m]];
+            int g = options.gutter;
+            // the gutter can be wider than a tiny texture, so wrap with a modulo rather than a single step
+            auto wrap = [](int value, int size) { return (value % size + size) % size; };
+            for(int y = -g; y < rect.height + g; y++)
+            {
+                const uint8_t *row = image + size_t(wrap(y, rect.height)) * rect.width * 4;
+                uint8_t *target = pixels.data() + (size_t(rect.y + y) * size + rect.x) * 4;
+                for(int x = -g; x < 0; x++)
+                    memcpy(target + x * 4, row + size_t(wrap(x, rect.width)) * 4, 4);
+                memcpy(target, row, size_t(rect.width) * 4);
+                for(int x = rect.width; x < rect.width + g; x++)
+                    memcpy(target + x * 4, row + size_t(wrap(x, rect.width)) * 4, 4);
+            }
+        }
+    });
+    return pixels;
+}
+
+// texture coordinate offset (xy) and scale (zw) that map [0, 1] onto rect
+inline glm::vec4 AtlasUvRect(const AtlasRect &rect, int pageSize)
+{
+    float size = static_cast<float>(pageSize);
+    return glm::vec4(rect.x / size, rect.y / size, rect.width / size, rect.height / size);
+}
+#endif
@@ -0,0 +1,286 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/content_hash.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/texture_compression.h>
+#include <learnopengl/texture_loader.h>
+#include <learnopengl/texture_stream.h>
+#include <learnopengl/thread_pool.h>
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// a GL texture owned by the TextureCache. The texture is deleted when the last handle goes away,
+// so this must happen on the GL thread like every other GL call.
+struct TextureObject
+{
+    unsigned int id = 0;
+    uint64_t key = 0;     // content hash of the source file (+ upload options), 0 if loading failed
+    int width = 0;
+    int height = 0;
+    GLenum format = 0;    // block compression format, GL_RGBA8 with compression off
+    int layers = 0;       // layers of a GL_TEXTURE_2D_ARRAY (see texture_array.h), 0 for a 2D texture
+
+    ~TextureObject();
+};
+
+typedef std::shared_ptr<TextureObject> TextureHandle;
+
+// Process wide texture cache. Textures are identified by a hash of the file bytes, so the same
+// image reached through different paths, models or tutorials is uploaded exactly once. A path
+// index in front of it turns repeated requests for the same file into a single hash map lookup
+// without touching the disk. The index assumes files don't change while the process runs.
+// Textures are block compressed by role (see texture_compression.h) unless compression is
+// turned off. Either way their mip chains are built on the CPU and kept on disk next to their
+// sources, so later runs upload every level as is.
+class TextureCache
+{
+public:
+    // applies to textures loaded from now on, set it before the first load
+    TextureCompressionOptions compression;
+    // upload through a TextureStreamer: finish() returns right after allocating the texture and
+    // updateUploads() streams the contents in over the next frames
+    bool streamUploads = false;
+
+    // never destroyed: handles may still be released during static destruction
+    static TextureCache &instance()
+    {
+        static TextureCache *cache = new TextureCache();
+        return *cache;
+    }
+
+    TextureHandle acquire(const std::string &filename, bool gamma = false, TextureRole role = TEXTURE_ROLE_COLOR)
+    {
+        return acquireAll(std::vector<std::string>{ filename }, gamma, role)[0];
+    }
+
+    // returns one handle per filename. Files not resident yet are read, hashed and - unless the
+    // same bytes are already resident under another name - decoded on the shared thread pool,
+    // the GL uploads happen on the calling thread as the decodes finish.
+    std::vector<TextureHandle> acquireAll(const std::vector<std::string> &filenames, bool gamma = false, TextureRole role = TEXTURE_ROLE_COLOR)
+    {
+        std::vector<TextureHandle> handles(filenames.size());
+        std::vector<size_t> misses;
+        for(size_t i = 0; i < filenames.size(); i++)
+        {
+            handles[i] = findPath(filenames[i], gamma, role);
+            if(!handles[i])
+                misses.push_back(i);
+        }
+
+        ParallelProduce<PreparedTexture>(misses.size(),
+            [this, &filenames, &misses, gamma, role](size_t m) { return prepare(filenames[misses[m]], gamma, role); },
+            [this, &misses, &handles](size_t m, PreparedTexture &prepared) { handles[misses[m]] = finish(prepared); });
+        return handles;
+    }
+
+    // the part of a load that needs no GL context
+    struct PreparedTexture {
+        std::string filename;
+        bool gamma = false;
+        TextureRole role = TEXTURE_ROLE_COLOR;
+        uint64_t key = 0;      // 0 if the file couldn't be read
+        CompressedImage compressed; // empty if the content was resident when prepared
+    };
+
+    // reads and hashes filename and maps its encoded mip chain from the disk cache, decoding and
+    // encoding it first on a miss. Content that is already resident is skipped unless
+    // skipResident is off, e.g. to copy it into a texture array. Safe on any thread, takes no
+    // texture references, so a worker can never end up releasing a GL texture.
+    PreparedTexture prepare(const std::string &filename, bool gamma = false, TextureRole role = TEXTURE_ROLE_COLOR,
+                            bool skipResident = true)
+    {
+        PreparedTexture prepared;
+        prepared.filename = filename;
+        prepared.gamma = gamma;
+        prepared.role = role;
+        // a file that was loaded before doesn't even need to be read again
+        if(skipResident && isResidentPath(filename, gamma, role, prepared.key))
+            return prepared;
+        MappedFile file(filename);
+        if(!file.isOpen())
+            return prepared;
+        prepared.key = HashCombine(HashCombine(HashBytes(file.data(), file.size()), gamma), variant(role));
+        // identical content is already on the GPU, no need to decode it again
+        if(skipResident && isResident(prepared.key))
+            return prepared;
+        uint64_t cacheKey = HashCombine(prepared.key, kCompressedTextureVersion);
+        std::string cachePath = CompressedTexturePath(filename);
+        if(ReadCompressedTexture(cachePath, cacheKey, prepared.compressed))
+            return prepared;
+        DecodedImage image = DecodeImage(file.data(), file.size());
+        if(!image.valid())
+            return prepared;
+        prepared.compressed = CompressImage(image, role, compression);
+        if(compression.report && compression.enabled)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::cout << "TEXTURE::BCN:: " << filename << ": " << bcn::FormatName(prepared.compressed.format) << " "
+                      << image.width << "x" << image.height << ", " << prepared.compressed.bytes() / 1024 << " KiB with mips ("
+                      << size_t(image.width) * image.height * 4 * 4 / 3 / 1024 << " KiB as RGBA8), PSNR "
+                      << CompressionPsnr(image, prepared.compressed, role) << " dB" << std::endl;
+        }
+        if(!WriteCompressedTexture(cachePath, cacheKey, prepared.compressed))
+            std::cout << "WARNING::TEXTURE_CACHE:: failed to write " << cachePath << std::endl;
+        return prepared;
+    }
+
+    // GL thread: turns a prepared load into a handle, uploading the image unless the content
+    // became resident in the meantime
+    TextureHandle finish(PreparedTexture &prepared)
+    {
+        TextureHandle handle = prepared.key ? findContent(prepared.key) : TextureHandle();
+        if(!handle && prepared.key && !prepared.compressed.valid())
+            prepared = prepare(prepared.filename, prepared.gamma, prepared.role); // was resident when prepared, but got released since
+        if(!handle && prepared.compressed.valid())
+            handle = insert(prepared.key, prepared);
+        if(!handle)
+        {
+            std::cout << "Texture failed to load at path: " << prepared.filename << std::endl;
+            handle = std::make_shared<TextureObject>();
+            glGenTextures(1, &handle->id);
+            return handle;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        byPath[pathKey(prepared.filename, prepared.gamma, prepared.role)] = handle->key;
+        return handle;
+    }
+
+    // GL thread, once per frame while streaming uploads
+    void updateUploads()
+    {
+        if(streamer)
+            streamer->update();
+    }
+
+    // GL thread: blocks until every streamed upload landed
+    void flushUploads()
+    {
+        if(streamer)
+            streamer->flush();
+    }
+
+    // true while streamed uploads are on their way
+    bool uploading() const { return streamer && streamer->busy(); }
+
+    const TextureStreamer *uploadStreamer() const { return streamer.get(); }
+
+    // number of distinct textures currently alive
+    size_t residentCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return byContent.size();
+    }
+
+private:
+    friend struct TextureObject;
+
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::weak_ptr<TextureObject>> byContent;
+    std::unordered_map<std::string, uint64_t> byPath;
+    std::unique_ptr<TextureStreamer> streamer; // created by the first streamed upload, on the GL thread
+
+    TextureCache() = default;
+
+    // what besides the file content and gamma decides how a texture is stored
+    uint64_t variant(TextureRole role) const
+    {
+        return HashCombine(HashCombine(HashCombine(compression.enabled, role), compression.bc7), compression.mipFilter);
+    }
+
+    std::string pathKey(const std::string &filename, bool gamma, TextureRole role) const
+    {
+        std::string key = gamma ? filename + "#srgb" : filename;
+        return key + "#" + std::to_string(variant(role));
+    }
+
+    TextureHandle findContent(uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = byContent.find(key);
+        return it == byContent.end() ? TextureHandle() : it->second.lock();
+    }
+
+    bool isResident(uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = byContent.find(key);
+        return it != byContent.end() && !it->second.expired();
+    }
+
+    bool isResidentPath(const std::string &filename, bool gamma, TextureRole role, uint64_t &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto path = byPath.find(pathKey(filename, gamma, role));
+        if(path == byPath.end())
+            return false;
+        auto content = byContent.find(path->second);
+        if(content == byContent.end() || content->second.expired())
+            return false;
+        key = path->second;
+        return true;
+    }
+
+    TextureHandle findPath(const std::string &filename, bool gamma, TextureRole role)
+    {
+        uint64_t key;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = byPath.find(pathKey(filename, gamma, role));
+            if(it == byPath.end())
+                return TextureHandle();
+            key = it->second;
+        }
+        return findContent(key);
+    }
+
+    // uploads the mip chain of prepared, or with streamUploads hands it over to the streamer
+    TextureHandle insert(uint64_t key, PreparedTexture &prepared)
+    {
+        TextureHandle handle = std::make_shared<TextureObject>();
+        glGenTextures(1, &handle->id);
+        handle->width = prepared.compressed.width();
+        handle->height = prepared.compressed.height();
+        handle->format = prepared.compressed.format;
+        if(streamUploads)
+        {
+            if(!streamer)
+                streamer.reset(new TextureStreamer());
+            streamer->upload(handle->id, std::make_shared<CompressedImage>(std::move(prepared.compressed)), handle);
+        }
+        else
+            UploadCompressedImage(handle->id, prepared.compressed);
+        handle->key = key;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        byContent[key] = handle;
+        return handle;
+    }
+
+    // called by the last handle of key. A new texture with the same key might already have
+    // replaced the dying one, that entry is still alive and must stay.
+    void forget(uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = byContent.find(key);
+        if(it != byContent.end() && it->second.expired())
+            byContent.erase(it);
+    }
+};
+
+inline TextureObject::~TextureObject()
+{
+    GLState::instance().deleteTextures(1, &id);
+    if(key != 0)
+        TextureCache::instance().forget(key);
+}
+#endif
@@ -0,0 +1,935 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mipmap.h>
+#include <learnopengl/texture_loader.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Block compressed textures. Images are encoded on the CPU into 4x4 pixel blocks of one of the
+// BCn formats, which the GPU samples directly at 4 or 8 bits per pixel instead of 24/32:
+//   BC1 (DXT1)  8 bytes/block  opaque color
+//   BC3 (DXT5) 16 bytes/block  color + alpha
+//   BC4 (RGTC1) 8 bytes/block  one channel: specular, ao, height masks
+//   BC5 (RGTC2)16 bytes/block  two channels: tangent space normal maps (x, y)
+//   BC7 (BPTC) 16 bytes/block  color (+ alpha) at higher quality, mode 6 only
+// The whole mip chain is encoded, compressed textures can't glGenerateMipmap; the levels come from
+// BuildMipChain (mipmap.h). With compression off the same chain is stored as plain RGBA8. Encoded
+// textures are stored next to the source file (see CompressedTexturePath) and uploaded straight
+// from the mapping on later runs. The decoders exist to measure the error (CompressionPsnr) and to fall
+// back to plain RGBA uploads where the GL lacks a format.
+
+// not in the core 3.3 glad header
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+// what a texture is used for, picks its block format
+enum TextureRole {
+    TEXTURE_ROLE_COLOR,   // diffuse/albedo: BC1, BC3 with alpha, BC7 if asked for
+    TEXTURE_ROLE_MASK,    // single channel data (specular, ao, height): BC4 of the red channel
+    TEXTURE_ROLE_NORMAL   // normal maps: BC5 of x and y, shaders rebuild z
+};
+
+struct TextureCompressionOptions {
+    bool enabled = true;     // false keeps the (still cached) mip chain as plain RGBA8
+    bool bc7 = false;        // BC7 instead of BC1/BC3 for color textures, needs GL 4.2 or ARB_texture_compression_bptc
+    bool report = true;      // print size and PSNR of every freshly encoded texture
+    MipFilter mipFilter = MIP_FILTER_KAISER;
+};
+
+const uint32_t kCompressedTextureMagic   = 0x5447474c; // "LGGT"
+const uint32_t kCompressedTextureVersion = 2;          // bump whenever the encoders or the file layout change
+
+namespace bcn
+{
+    inline size_t BlockBytes(GLenum format)
+    {
+        return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1 ? 8 : 16;
+    }
+
+    // bytes of one width x height level, GL_RGBA8 is the uncompressed variant
+    inline size_t LevelBytes(GLenum format, int width, int height)
+    {
+        if(format == GL_RGBA8)
+            return size_t(width) * height * 4;
+        return size_t((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+    }
+
+    inline const char *FormatName(GLenum format)
+    {
+        switch(format)
+        {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:  return "BC1";
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return "BC3";
+        case GL_COMPRESSED_RED_RGTC1:          return "BC4";
+        case GL_COMPRESSED_RG_RGTC2:           return "BC5";
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:    return "BC7";
+        case GL_RGBA8:                         return "RGBA8";
+        default:                               return "unknown";
+        }
+    }
+
+    inline int Clamp255(float v)
+    {
+        return std::min(255, std::max(0, static_cast<int>(v + 0.5f)));
+    }
+
+    // the dominant direction of n points of dims floats each, by power iteration on their covariance
+    template<int dims>
+    void PrincipalAxis(const float (*points)[dims], int n, float mean[dims], float axis[dims])
+    {
+        for(int d = 0; d < dims; d++)
+        {
+            mean[d] = 0.0f;
+            for(int i = 0; i < n; i++)
+                mean[d] += points[i][d];
+            mean[d] /= n;
+        }
+        float covariance[dims][dims] = {};
+        for(int i = 0; i < n; i++)
+            for(int a = 0; a < dims; a++)
+                for(int b = 0; b < dims; b++)
+                    covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+        for(int d = 0; d < dims; d++)
+            axis[d] = 1.0f;
+        for(int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[dims] = {}, length = 0.0f;
+            for(int a = 0; a < dims; a++)
+            {
+                for(int b = 0; b < dims; b++)
+                    next[a] += covariance[a][b] * axis[b];
+                length = std::max(length, std::abs(next[a]));
+            }
+            if(length == 0.0f)
+                return; // flat block, any axis will do
+            for(int d = 0; d < dims; d++)
+                axis[d] = next[d] / length;
+        }
+    }
+
+    // endpoints of the points' extent along their principal axis
+    template<int dims>
+    void FitEndpoints(const float (*points)[dims], int n, float e0[dims], float e1[dims])
+    {
+        float mean[dims], axis[dims];
+        PrincipalAxis<dims>(points, n, mean, axis);
+        float lo = 0.0f, hi = 0.0f;
+        for(int i = 0; i < n; i++)
+        {
+            float t = 0.0f;
+            for(int d = 0; d < dims; d++)
+                t += (points[i][d] - mean[d]) * axis[d];
+            lo = std::min(lo, t);
+            hi = std::max(hi, t);
+        }
+        for(int d = 0; d < dims; d++)
+        {
+            e0[d] = std::min(255.0f, std::max(0.0f, mean[d] + axis[d] * hi));
+            e1[d] = std::min(255.0f, std::max(0.0f, mean[d] + axis[d] * lo));
+        }
+    }
+
+    inline uint16_t Pack565(const float c[3])
+    {
+        return static_cast<uint16_t>((Clamp255(c[0]) * 31 + 127) / 255 << 11 | (Clamp255(c[1]) * 63 + 127) / 255 << 5 | (Clamp255(c[2]) * 31 + 127) / 255);
+    }
+
+    inline void Unpack565(uint16_t c, int out[3])
+    {
+        int r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+        out[0] = (r << 3) | (r >> 2);
+        out[1] = (g << 2) | (g >> 4);
+        out[2] = (b << 3) | (b >> 2);
+    }
+
+    // the four colors of a BC1 block in four color mode
+    inline void Bc1Palette(uint16_t c0, uint16_t c1, int palette[4][3])
+    {
+        Unpack565(c0, palette[0]);
+        Unpack565(c1, palette[1]);
+        for(int d = 0; d < 3; d++)
+        {
+            palette[2][d] = (2 * palette[0][d] + palette[1][d]) / 3;
+            palette[3][d] = (palette[0][d] + 2 * palette[1][d]) / 3;
+        }
+    }
+
+    // nearest palette entry of every pixel, returns the squared error
+    inline int Bc1Indices(const float (*pixels)[3], uint16_t c0, uint16_t c1, uint8_t indices[16])
+    {
+        int palette[4][3];
+        Bc1Palette(c0, c1, palette);
+        int total = 0;
+        for(int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = INT32_MAX;
+            for(int k = 0; k < 4; k++)
+            {
+                int error = 0;
+                for(int d = 0; d < 3; d++)
+                {
+                    int delta = static_cast<int>(pixels[i][d]) - palette[k][d];
+                    error += delta * delta;
+                }
+                if(error < bestError)
+                {
+                    best = k;
+                    bestError = error;
+                }
+            }
+            indices[i] = static_cast<uint8_t>(best);
+            total += bestError;
+        }
+        return total;
+    }
+
+    // color block of BC1/BC3 from 16 RGBA pixels, always in four color mode. The principal axis
+    // gives the first endpoints, one least squares pass over the chosen indices refines them.
+    inline void EncodeBc1Block(const uint8_t rgba[64], uint8_t out[8])
+    {
+        float pixels[16][3];
+        for(int i = 0; i < 16; i++)
+            for(int d = 0; d < 3; d++)
+                pixels[i][d] = rgba[i * 4 + d];
+        float e0[3], e1[3];
+        FitEndpoints<3>(pixels, 16, e0, e1);
+        uint16_t c0 = Pack565(e0), c1 = Pack565(e1);
+        uint8_t indices[16];
+        int error = Bc1Indices(pixels, c0, c1, indices);
+
+        // least squares endpoints for these indices: p = a * e0 + b * e1
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f, ap[3] = {}, bp[3] = {};
+        for(int i = 0; i < 16; i++)
+        {
+            float a = weights[indices[i]], b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for(int d = 0; d < 3; d++)
+            {
+                ap[d] += a * pixels[i][d];
+                bp[d] += b * pixels[i][d];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if(std::abs(determinant) > 1e-6f)
+        {
+            float r0[3], r1[3];
+            for(int d = 0; d < 3; d++)
+            {
+                r0[d] = (bb * ap[d] - ab * bp[d]) / determinant;
+                r1[d] = (aa * bp[d] - ab * ap[d]) / determinant;
+            }
+            uint16_t refined0 = Pack565(r0), refined1 = Pack565(r1);
+            uint8_t refinedIndices[16];
+            int refinedError = Bc1Indices(pixels, refined0, refined1, refinedIndices);
+            if(refinedError < error)
+            {
+                c0 = refined0;
+                c1 = refined1;
+                std::copy(refinedIndices, refinedIndices + 16, indices);
+            }
+        }
+
+        // four color mode needs c0 > c1, equal endpoints only ever use index 0
+        if(c0 < c1)
+        {
+            std::swap(c0, c1);
+            static const uint8_t swapped[4] = { 1, 0, 3, 2 };
+            for(uint8_t &index : indices)
+                index = swapped[index];
+        }
+        else if(c0 == c1)
+            std::fill(indices, indices + 16, 0);
+        uint32_t bits = 0;
+        for(int i = 0; i < 16; i++)
+            bits |= uint32_t(indices[i]) << (2 * i);
+        memcpy(out, &c0, 2);
+        memcpy(out + 2, &c1, 2);
+        memcpy(out + 4, &bits, 4);
+    }
+
+    // BC1 color block into the RGB of 16 RGBA pixels. BC3 blocks are always four color mode.
+    inline void DecodeBc1Block(const uint8_t in[8], uint8_t rgba[64], bool fourColor = false)
+    {
+        uint16_t c0, c1;
+        uint32_t bits;
+        memcpy(&c0, in, 2);
+        memcpy(&c1, in + 2, 2);
+        memcpy(&bits, in + 4, 4);
+        int palette[4][3];
+        Bc1Palette(c0, c1, palette);
+        bool threeColor = !fourColor && c0 <= c1;
+        if(threeColor)
+            for(int d = 0; d < 3; d++)
+            {
+                palette[2][d] = (palette[0][d] + palette[1][d]) / 2;
+                palette[3][d] = 0;
+            }
+        for(int i = 0; i < 16; i++)
+        {
+            int index = (bits >> (2 * i)) & 3;
+            for(int d = 0; d < 3; d++)
+                rgba[i * 4 + d] = static_cast<uint8_t>(palette[index][d]);
+            rgba[i * 4 + 3] = threeColor && index == 3 ? 0 : 255;
+        }
+    }
+
+    inline void Bc4Palette(int a0, int a1, int palette[8])
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+        if(a0 > a1)
+            for(int i = 2; i < 8; i++)
+                palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+        else
+        {
+            for(int i = 2; i < 6; i++)
+                palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    // one channel block (BC4, the alpha of BC3, either half of BC5) from 16 values, eight level mode
+    inline void EncodeBc4Block(const uint8_t values[16], uint8_t out[8])
+    {
+        int lo = 255, hi = 0;
+        for(int i = 0; i < 16; i++)
+        {
+            lo = std::min<int>(lo, values[i]);
+            hi = std::max<int>(hi, values[i]);
+        }
+        int palette[8];
+        Bc4Palette(hi, lo, palette);
+        uint64_t bits = 0;
+        for(int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            for(int k = 1; k < 8; k++)
+                if(std::abs(palette[k] - values[i]) < std::abs(palette[best] - values[i]))
+                    best = k;
+            bits |= uint64_t(best) << (3 * i);
+        }
+        out[0] = static_cast<uint8_t>(hi);
+        out[1] = static_cast<uint8_t>(lo);
+        for(int i = 0; i < 6; i++)
+            out[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+
+    // one channel block into values[i * pitch]
+    inline void DecodeBc4Block(const uint8_t in[8], uint8_t *values, int pitch)
+    {
+        int palette[8];
+        Bc4Palette(in[0], in[1], palette);
+        uint64_t bits = 0;
+        for(int i = 0; i < 6; i++)
+            bits |= uint64_t(in[2 + i]) << (8 * i);
+        for(int i = 0; i < 16; i++)
+            values[i * pitch] = static_cast<uint8_t>(palette[(bits >> (3 * i)) & 7]);
+    }
+
+    static const int kBc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    inline void Bc7Palette(const int e0[4], const int e1[4], int palette[16][4])
+    {
+        for(int k = 0; k < 16; k++)
+            for(int d = 0; d < 4; d++)
+                palette[k][d] = ((64 - kBc7Weights4[k]) * e0[d] + kBc7Weights4[k] * e1[d] + 32) >> 6;
+    }
+
+    // appends count bits of value to a little endian 128 bit block
+    struct BitWriter {
+        uint8_t *out;
+        int position = 0;
+        void write(uint32_t value, int count)
+        {
+            for(int i = 0; i < count; i++, position++)
+                if(value & (1u << i))
+                    out[position >> 3] |= static_cast<uint8_t>(1u << (position & 7));
+        }
+    };
+
+    struct BitReader {
+        const uint8_t *in;
+        int position = 0;
+        uint32_t read(int count)
+        {
+            uint32_t value = 0;
+            for(int i = 0; i < count; i++, position++)
+                value |= uint32_t((in[position >> 3] >> (position & 7)) & 1) << i;
+            return value;
+        }
+    };
+
+    // BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a shared low bit each, 4 bit indices.
+    // Endpoints come from the principal axis of the block, every combination of low bits is tried.
+    inline void EncodeBc7Block(const uint8_t rgba[64], uint8_t out[16])
+    {
+        float pixels[16][4];
+        for(int i = 0; i < 16; i++)
+            for(int d = 0; d < 4; d++)
+                pixels[i][d] = rgba[i * 4 + d];
+        float e0[4], e1[4];
+        FitEndpoints<4>(pixels, 16, e0, e1);
+
+        int bestError = INT32_MAX, best7[2][4] = {}, bestP[2] = {};
+        uint8_t bestIndices[16] = {};
+        for(int p = 0; p < 4; p++)
+        {
+            int pbits[2] = { p & 1, p >> 1 }, q7[2][4], e[2][4];
+            for(int d = 0; d < 4; d++)
+            {
+                q7[0][d] = std::min(127, std::max(0, static_cast<int>(std::lround((e0[d] - pbits[0]) / 2.0f))));
+                q7[1][d] = std::min(127, std::max(0, static_cast<int>(std::lround((e1[d] - pbits[1]) / 2.0f))));
+                e[0][d] = (q7[0][d] << 1) | pbits[0];
+                e[1][d] = (q7[1][d] << 1) | pbits[1];
+            }
+            int palette[16][4], error = 0;
+            Bc7Palette(e[0], e[1], palette);
+            uint8_t indices[16];
+            for(int i = 0; i < 16; i++)
+            {
+                int bestK = 0, bestKError = INT32_MAX;
+                for(int k = 0; k < 16; k++)
+                {
+                    int kError = 0;
+                    for(int d = 0; d < 4; d++)
+                    {
+                        int delta = static_cast<int>(pixels[i][d]) - palette[k][d];
+                        kError += delta * delta;
+                    }
+                    if(kError < bestKError)
+                    {
+                        bestK = k;
+                        bestKError = kError;
+                    }
+                }
+                indices[i] = static_cast<uint8_t>(bestK);
+                error += bestKError;
+            }
+            if(error < bestError)
+            {
+                bestError = error;
+                memcpy(best7, q7, sizeof(q7));
+                bestP[0] = pbits[0];
+                bestP[1] = pbits[1];
+                std::copy(indices, indices + 16, bestIndices);
+            }
+        }
+        // the first index is stored without its top bit, so it has to be below 8
+        if(bestIndices[0] & 8)
+        {
+            for(int d = 0; d < 4; d++)
+                std::swap(best7[0][d], best7[1][d]);
+            std::swap(bestP[0], bestP[1]);
+            for(uint8_t &index : bestIndices)
+                index = static_cast<uint8_t>(15 - index);
+        }
+        memset(out, 0, 16);
+        BitWriter bits{ out };
+        bits.write(1u << 6, 7);
+        for(int d = 0; d < 4; d++)
+        {
+            bits.write(best7[0][d], 7);
+            bits.write(best7[1][d], 7);
+        }
+        bits.write(bestP[0], 1);
+        bits.write(bestP[1], 1);
+        bits.write(bestIndices[0], 3);
+        for(int i = 1; i < 16; i++)
+            bits.write(bestIndices[i], 4);
+    }
+
+    // BC7 block into 16 RGBA pixels. Only mode 6 (what EncodeBc7Block writes) is understood, any
+    // other mode decodes to magenta and returns false.
+    inline bool DecodeBc7Block(const uint8_t in[16], uint8_t rgba[64])
+    {
+        if((in[0] & 0x7f) != 0x40)
+        {
+            for(int i = 0; i < 16; i++)
+            {
+                const uint8_t magenta[4] = { 255, 0, 255, 255 };
+                memcpy(rgba + i * 4, magenta, 4);
+            }
+            return false;
+        }
+        BitReader bits{ in };
+        bits.read(7);
+        int q7[2][4], p[2], e[2][4];
+        for(int d = 0; d < 4; d++)
+        {
+            q7[0][d] = bits.read(7);
+            q7[1][d] = bits.read(7);
+        }
+        p[0] = bits.read(1);
+        p[1] = bits.read(1);
+        for(int d = 0; d < 4; d++)
+        {
+            e[0][d] = (q7[0][d] << 1) | p[0];
+            e[1][d] = (q7[1][d] << 1) | p[1];
+        }
+        int palette[16][4];
+        Bc7Palette(e[0], e[1], palette);
+        for(int i = 0; i < 16; i++)
+        {
+            int index = bits.read(i == 0 ? 3 : 4);
+            for(int d = 0; d < 4; d++)
+                rgba[i * 4 + d] = static_cast<uint8_t>(palette[index][d]);
+        }
+        return true;
+    }
+
+    // one block of format from 16 RGBA pixels
+    inline void EncodeBlock(GLenum format, const uint8_t rgba[64], uint8_t *out)
+    {
+        uint8_t channel[16];
+        auto gather = [&](int c) {
+            for(int i = 0; i < 16; i++)
+                channel[i] = rgba[i * 4 + c];
+        };
+        switch(format)
+        {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+            EncodeBc1Block(rgba, out);
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            gather(3);
+            EncodeBc4Block(channel, out);
+            EncodeBc1Block(rgba, out + 8);
+            break;
+        case GL_COMPRESSED_RED_RGTC1:
+            gather(0);
+            EncodeBc4Block(channel, out);
+            break;
+        case GL_COMPRESSED_RG_RGTC2:
+            gather(0);
+            EncodeBc4Block(channel, out);
+            gather(1);
+            EncodeBc4Block(channel, out + 8);
+            break;
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+            EncodeBc7Block(rgba, out);
+            break;
+        }
+    }
+
+    // one block of format into 16 RGBA pixels, as the texture samples: BC4 as (r, r, r, 1),
+    // BC5 as (r, g, 1, 1), matching the swizzles UploadCompressedImage sets
+    inline void DecodeBlock(GLenum format, const uint8_t *in, uint8_t rgba[64])
+    {
+        switch(format)
+        {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+            DecodeBc1Block(in, rgba);
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            DecodeBc1Block(in + 8, rgba, true);
+            DecodeBc4Block(in, rgba + 3, 4);
+            break;
+        case GL_COMPRESSED_RED_RGTC1:
+            DecodeBc4Block(in, rgba, 4);
+            for(int i = 0; i < 16; i++)
+            {
+                rgba[i * 4 + 1] = rgba[i * 4 + 2] = rgba[i * 4];
+                rgba[i * 4 + 3] = 255;
+            }
+            break;
+        case GL_COMPRESSED_RG_RGTC2:
+            DecodeBc4Block(in, rgba, 4);
+            DecodeBc4Block(in + 8, rgba + 1, 4);
+            for(int i = 0; i < 16; i++)
+                rgba[i * 4 + 2] = rgba[i * 4 + 3] = 255;
+            break;
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+            DecodeBc7Block(in, rgba);
+            break;
+        }
+    }
+}
+
+struct CompressedLevel {
+    int width = 0;
+    int height = 0;
+    size_t offset = 0;   // into CompressedImage::data()
+    size_t size = 0;
+};
+
+// a block compressed (or plain RGBA8) mip chain, either encoded in memory or mapped from its cache file
+struct CompressedImage {
+    GLenum format = 0;
+    std::vector<CompressedLevel> levels;
+    std::vector<uint8_t> storage;
+    std::unique_ptr<MappedFile> file;  // set when the levels live in a mapped cache file
+
+    bool valid() const { return format != 0 && !levels.empty(); }
+    int width() const { return levels.empty() ? 0 : levels[0].width; }
+    int height() const { return levels.empty() ? 0 : levels[0].height; }
+    const uint8_t *data() const { return file ? file->data() : storage.data(); }
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for(const CompressedLevel &level : levels)
+            total += level.size;
+        return total;
+    }
+};
+
+// pixels of a decoded image as tightly packed RGBA8, gray expands to all three color channels
+inline std::vector<uint8_t> ToRgba8(const DecodedImage &image)
+{
+    return mip::ExpandToRgba8(image.pixels, size_t(image.width) * image.height, image.components);
+}
+
+// the block format for an image of role, see TextureRole
+inline GLenum ChooseCompressedFormat(TextureRole role, const std::vector<uint8_t> &rgba, int components, bool bc7)
+{
+    if(role == TEXTURE_ROLE_NORMAL)
+        return GL_COMPRESSED_RG_RGTC2;
+    if(role == TEXTURE_ROLE_MASK || components == 1)
+        return GL_COMPRESSED_RED_RGTC1;
+    bool alpha = false;
+    if(components == 2 || components == 4)
+        for(size_t i = 3; i < rgba.size() && !alpha; i += 4)
+            alpha = rgba[i] != 255;
+    if(bc7)
+        return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    return alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+// one level of an RGBA8 image into blocks of format. Rows of blocks are encoded on the shared
+// thread pool, edge blocks of sizes that aren't a multiple of 4 repeat the last row/column.
+inline void EncodeLevel(GLenum format, const uint8_t *rgba, int width, int height, uint8_t *out)
+{
+    if(format == GL_RGBA8)
+    {
+        memcpy(out, rgba, bcn::LevelBytes(format, width, height));
+        return;
+    }
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    size_t blockBytes = bcn::BlockBytes(format);
+    SharedThreadPool().parallelFor(blocksY, 4, [&](size_t begin, size_t end) {
+        uint8_t block[64];
+        for(size_t by = begin; by < end; by++)
+            for(int bx = 0; bx < blocksX; bx++)
+            {
+                for(int i = 0; i < 16; i++)
+                {
+                    int x = std::min(bx * 4 + (i & 3), width - 1), y = std::min(int(by) * 4 + (i >> 2), height - 1);
+                    memcpy(block + i * 4, rgba + (size_t(y) * width + x) * 4, 4);
+                }
+                bcn::EncodeBlock(format, block, out + (by * blocksX + bx) * blockBytes);
+            }
+    });
+}
+
+// level of a compressed image back to RGBA8, as the GPU would sample it
+inline std::vector<uint8_t> DecodeCompressedLevel(const CompressedImage &image, size_t level)
+{
+    const CompressedLevel &l = image.levels[level];
+    if(image.format == GL_RGBA8)
+        return std::vector<uint8_t>(image.data() + l.offset, image.data() + l.offset + l.size);
+    int blocksX = (l.width + 3) / 4, blocksY = (l.height + 3) / 4;
+    size_t blockBytes = bcn::BlockBytes(image.format);
+    std::vector<uint8_t> rgba(size_t(l.width) * l.height * 4);
+    const uint8_t *blocks = image.data() + l.offset;
+    uint8_t block[64];
+    for(int by = 0; by < blocksY; by++)
+        for(int bx = 0; bx < blocksX; bx++)
+        {
+            bcn::DecodeBlock(image.format, blocks + (size_t(by) * blocksX + bx) * blockBytes, block);
+            for(int i = 0; i < 16; i++)
+            {
+                int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+                if(x < l.width && y < l.height)
+                    memcpy(rgba.data() + (size_t(y) * l.width + x) * 4, block + i * 4, 4);
+            }
+        }
+    return rgba;
+}
+
+// the mip chain of a tightly packed RGBA8 image in the block format of its role, or as RGBA8 if
+// compression is off. components is what the pixels came from, only 2 and 4 can carry alpha.
+// Levels are filtered in linear light for color and renormalized for normal maps, then all of
+// them are encoded at once on the shared thread pool. maxLevels 0 keeps every level down to 1x1.
+inline CompressedImage CompressRgba8(const std::vector<uint8_t> &rgba, int width, int height, int components, TextureRole role,
+                                     const TextureCompressionOptions &options = TextureCompressionOptions(), size_t maxLevels = 0)
+{
+    CompressedImage compressed;
+    compressed.format = options.enabled ? ChooseCompressedFormat(role, rgba, components, options.bc7) : GL_RGBA8;
+    MipOptions mipOptions;
+    mipOptions.srgb = role == TEXTURE_ROLE_COLOR;
+    mipOptions.normalMap = role == TEXTURE_ROLE_NORMAL;
+    mipOptions.filter = options.mipFilter;
+    mipOptions.levels = maxLevels;
+    std::vector<MipLevel> chain = BuildMipChain(rgba.data(), width, height, mipOptions);
+    for(const MipLevel &source : chain)
+    {
+        CompressedLevel level;
+        level.width = source.width;
+        level.height = source.height;
+        level.offset = compressed.storage.size();
+        level.size = bcn::LevelBytes(compressed.format, source.width, source.height);
+        compressed.levels.push_back(level);
+        compressed.storage.resize(level.offset + level.size);
+    }
+    SharedThreadPool().parallelFor(chain.size(), 1, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+            EncodeLevel(compressed.format, chain[i].rgba.data(), chain[i].width, chain[i].height,
+                        compressed.storage.data() + compressed.levels[i].offset);
+    });
+    return compressed;
+}
+
+// the full mip chain of image, see CompressRgba8
+inline CompressedImage CompressImage(const DecodedImage &image, TextureRole role, const TextureCompressionOptions &options = TextureCompressionOptions())
+{
+    if(!image.valid())
+        return CompressedImage();
+    return CompressRgba8(ToRgba8(image), image.width, image.height, image.components, role, options);
+}
+
+// peak signal to noise ratio of the top level against the source image, over the channels the
+// role keeps: RGB(A) for color, red for masks, red and green for normals. Higher is better,
+// 40 dB and up is hard to tell apart from the source.
+inline double CompressionPsnr(const DecodedImage &source, const CompressedImage &compressed, TextureRole role)
+{
+    std::vector<uint8_t> original = ToRgba8(source), decoded = DecodeCompressedLevel(compressed, 0);
+    int channels = role == TEXTURE_ROLE_MASK || compressed.format == GL_COMPRESSED_RED_RGTC1 ? 1
+                 : role == TEXTURE_ROLE_NORMAL ? 2
+                 : source.components == 2 || source.components == 4 ? 4 : 3;
+    double squared = 0.0;
+    for(size_t i = 0; i < original.size(); i += 4)
+        for(int c = 0; c < channels; c++)
+        {
+            double delta = double(original[i + c]) - decoded[i + c];
+            squared += delta * delta;
+        }
+    double mse = squared / (double(original.size() / 4) * channels);
+    return mse == 0.0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+// file layout of a cached compressed texture, every level starts on a 16 byte boundary:
+//   CompressedTextureHeader
+//   CompressedTextureLevel[levelCount]
+//   level blocks
+struct CompressedTextureHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;        // content hash of the source and everything that picks the encoding
+    uint32_t format;     // GL internal format
+    uint32_t levelCount;
+};
+
+struct CompressedTextureLevel {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// the cache sits right next to the texture, e.g. diffuse.png -> diffuse.png.bcn
+inline std::string CompressedTexturePath(const std::string &texturePath)
+{
+    return texturePath + ".bcn";
+}
+
+// maps the cached texture at path if it was written for key and is intact
+inline bool ReadCompressedTexture(const std::string &path, uint64_t key, CompressedImage &image)
+{
+    std::unique_ptr<MappedFile> file(new MappedFile(path));
+    if(!file->isOpen() || file->size() < sizeof(CompressedTextureHeader))
+        return false;
+    const CompressedTextureHeader *header = reinterpret_cast<const CompressedTextureHeader*>(file->data());
+    if(header->magic != kCompressedTextureMagic || header->version != kCompressedTextureVersion || header->key != key ||
+       header->levelCount == 0 || header->levelCount > 32 ||
+       sizeof(CompressedTextureHeader) + header->levelCount * sizeof(CompressedTextureLevel) > file->size())
+        return false;
+    GLenum format = header->format;
+    if(format != GL_COMPRESSED_RGB_S3TC_DXT1_EXT && format != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT && format != GL_COMPRESSED_RED_RGTC1 &&
+       format != GL_COMPRESSED_RG_RGTC2 && format != GL_COMPRESSED_RGBA_BPTC_UNORM && format != GL_RGBA8)
+        return false;
+    const CompressedTextureLevel *levels = reinterpret_cast<const CompressedTextureLevel*>(header + 1);
+    image.levels.clear();
+    for(uint32_t i = 0; i < header->levelCount; i++)
+    {
+        const CompressedTextureLevel &l = levels[i];
+        if(l.width == 0 || l.height == 0 || l.size != bcn::LevelBytes(format, l.width, l.height) ||
+           l.offset + l.size > file->size())
+            return false;
+        image.levels.push_back({ int(l.width), int(l.height), size_t(l.offset), size_t(l.size) });
+    }
+    image.format = format;
+    image.storage.clear();
+    image.file = std::move(file);
+    return true;
+}
+
+// writes image for key to path. Writes to a temporary file first and renames it into place, like the mesh cache.
+inline bool WriteCompressedTexture(const std::string &path, uint64_t key, const CompressedImage &image)
+{
+    auto align16 = [](uint64_t offset) { return (offset + 15) & ~uint64_t(15); };
+    CompressedTextureHeader header = {};
+    header.magic = kCompressedTextureMagic;
+    header.version = kCompressedTextureVersion;
+    header.key = key;
+    header.format = image.format;
+    header.levelCount = static_cast<uint32_t>(image.levels.size());
+    std::vector<CompressedTextureLevel> levels(image.levels.size());
+    uint64_t offset = align16(sizeof(header) + levels.size() * sizeof(CompressedTextureLevel));
+    for(size_t i = 0; i < levels.size(); i++)
+    {
+        levels[i].width = image.levels[i].width;
+        levels[i].height = image.levels[i].height;
+        levels[i].offset = offset;
+        levels[i].size = image.levels[i].size;
+        offset = align16(offset + levels[i].size);
+    }
+
+    std::string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if(!out)
+        return false;
+    uint64_t written = 0;
+    auto write = [&](const void *data, uint64_t size) {
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        written += size;
+    };
+    write(&header, sizeof(header));
+    write(levels.data(), levels.size() * sizeof(CompressedTextureLevel));
+    for(size_t i = 0; i < levels.size(); i++)
+    {
+        static const char zeros[16] = {};
+        write(zeros, levels[i].offset - written);
+        write(image.data() + image.levels[i].offset, levels[i].size);
+    }
+    out.close();
+    if(!out)
+    {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+// the block compression extensions of the current context. RGTC is core since 3.0, S3TC and
+// BPTC are extensions on a 3.3 context (BPTC is core from 4.2 on). GL thread only.
+struct CompressedFormatSupport {
+    bool s3tc = false;
+    bool bptc = false;
+};
+
+inline CompressedFormatSupport QueryCompressedFormatSupport()
+{
+    CompressedFormatSupport support;
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(GLint i = 0; i < count; i++)
+    {
+        const char *extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if(!extension)
+            continue;
+        if(strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+            support.s3tc = true;
+        else if(strcmp(extension, "GL_ARB_texture_compression_bptc") == 0)
+            support.bptc = true;
+    }
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    support.bptc = support.bptc || major > 4 || (major == 4 && minor >= 2);
+    return support;
+}
+
+// whether the context samples format. The extensions are queried on the first call, the
+// tutorials only ever have one context. GL thread only.
+inline bool CompressedFormatUsable(GLenum format)
+{
+    static const CompressedFormatSupport support = QueryCompressedFormatSupport();
+    if(format == GL_RGBA8 || format == GL_COMPRESSED_RED_RGTC1 || format == GL_COMPRESSED_RG_RGTC2)
+        return true;
+    return format == GL_COMPRESSED_RGBA_BPTC_UNORM ? support.bptc : support.s3tc;
+}
+
+// sampling state of a texture holding image, on the texture bound to target (a 2D texture or an
+// array of images like it)
+inline void SetCompressedImageParameters(const CompressedImage &image, GLenum target = GL_TEXTURE_2D)
+{
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, GLint(image.levels.size() - 1));
+    // one and two channel formats sample like their decoded RGBA, see bcn::DecodeBlock
+    bool supported = CompressedFormatUsable(image.format);
+    if(supported && image.format == GL_COMPRESSED_RED_RGTC1)
+    {
+        glTexParameteri(target, GL_TEXTURE_SWIZZLE_G, GL_RED);
+        glTexParameteri(target, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    }
+    else if(supported && image.format == GL_COMPRESSED_RG_RGTC2)
+        glTexParameteri(target, GL_TEXTURE_SWIZZLE_B, GL_ONE);
+
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+// uploads every level of image into textureID, no mips are generated by the driver. Formats the
+// context can't sample are decoded on the CPU and uploaded as RGBA8 instead.
+inline void UploadCompressedImage(unsigned int textureID, const CompressedImage &image)
+{
+    bool supported = CompressedFormatUsable(image.format);
+    GLState::instance().bindTexture(GL_TEXTURE_2D, textureID);
+    for(size_t i = 0; i < image.levels.size(); i++)
+    {
+        const CompressedLevel &level = image.levels[i];
+        if(image.format == GL_RGBA8)
+            glTexImage2D(GL_TEXTURE_2D, GLint(i), GL_RGBA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.data() + level.offset);
+        else if(supported)
+            glCompressedTexImage2D(GL_TEXTURE_2D, GLint(i), image.format, level.width, level.height, 0,
+                                   GLsizei(level.size), image.data() + level.offset);
+        else
+        {
+            std::vector<uint8_t> rgba = DecodeCompressedLevel(image, i);
+            glTexImage2D(GL_TEXTURE_2D, GLint(i), GL_RGBA, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+        }
+    }
+    SetCompressedImageParameters(image);
+}
+
+// allocates every level of image in textureID without filling them, for an uploader that
+// streams the contents in afterwards (see texture_stream.h). Only for formats the context samples.
+inline void AllocateCompressedImage(unsigned int textureID, const CompressedImage &image)
+{
+    GLState::instance().bindTexture(GL_TEXTURE_2D, textureID);
+    for(size_t i = 0; i < image.levels.size(); i++)
+    {
+        const CompressedLevel &level = image.levels[i];
+        if(image.format == GL_RGBA8)
+            glTexImage2D(GL_TEXTURE_2D, GLint(i), GL_RGBA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        else
+            glCompressedTexImage2D(GL_TEXTURE_2D, GLint(i), image.format, level.width, level.height, 0, GLsizei(level.size), nullptr);
+    }
+    SetCompressedImageParameters(image);
+}
+#endif
@@ -0,0 +1,90 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <std_image.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/mipmap.h>
+#include <learnopengl/thread_pool.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// pixels decoded by stb_image, owns the buffer. Decoding needs no GL context so it can run on any
+// thread, only UploadImage has to happen on the GL thread.
+struct DecodedImage
+{
+    unsigned char *pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+
+    DecodedImage() = default;
+    ~DecodedImage()
+    {
+        if(pixels)
+            stbi_image_free(pixels);
+    }
+    DecodedImage(DecodedImage &&other) noexcept
+    {
+        *this = std::move(other);
+    }
+    DecodedImage& operator=(DecodedImage &&other) noexcept
+    {
+        std::swap(pixels, other.pixels);
+        std::swap(width, other.width);
+        std::swap(height, other.height);
+        std::swap(components, other.components);
+        return *this;
+    }
+    DecodedImage(const DecodedImage&) = delete;
+    DecodedImage& operator=(const DecodedImage&) = delete;
+
+    bool valid() const { return pixels != nullptr; }
+};
+
+inline DecodedImage DecodeImage(const std::string &filename)
+{
+    DecodedImage image;
+    image.pixels = stbi_load(filename.c_str(), &image.width, &image.height, &image.components, 0);
+    return image;
+}
+
+// same as above for a file that is already in memory (e.g. mapped to hash it)
+inline DecodedImage DecodeImage(const unsigned char *data, size_t size)
+{
+    DecodedImage image;
+    image.pixels = stbi_load_from_memory(data, static_cast<int>(size), &image.width, &image.height, &image.components, 0);
+    return image;
+}
+
+// uploads a decoded image into textureID with a mip chain built by BuildMipChain, see mipmap.h
+inline void UploadImage(unsigned int textureID, const DecodedImage &image, const MipOptions &mips = MipOptions())
+{
+    std::vector<uint8_t> rgba = mip::ExpandToRgba8(image.pixels, size_t(image.width) * image.height, image.components);
+    std::vector<MipLevel> levels = BuildMipChain(rgba.data(), image.width, image.height, mips);
+
+    GLState::instance().bindTexture(GL_TEXTURE_2D, textureID);
+    for(size_t i = 0; i < levels.size(); i++)
+        glTexImage2D(GL_TEXTURE_2D, GLint(i), GL_RGBA8, levels[i].width, levels[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, levels[i].rgba.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(levels.size() - 1));
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+// two phase load: every file is decoded on the shared thread pool while the calling (GL) thread
+// receives the results in completion order and runs upload(index, image) for each of them.
+// Total time is roughly the slowest decode plus the uploads instead of the sum of all decodes.
+template<typename UploadFn>
+void DecodeImagesParallel(const std::vector<std::string> &filenames, UploadFn upload)
+{
+    ParallelProduce<DecodedImage>(filenames.size(),
+                                  [&filenames](size_t i) { return DecodeImage(filenames[i]); },
+                                  upload);
+}
+#endif
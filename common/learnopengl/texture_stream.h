@@ -0,0 +1,276 @@
+#ifndef TEXTURE_STREAM_H
+#define TEXTURE_STREAM_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/texture_compression.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Streams texture contents to the GPU through a ring of pixel buffer objects instead of
+// glTexImage2D from client memory, which copies synchronously on the GL thread. upload() only
+// allocates the levels; update() maps free ring slots, lets a worker copy the next pieces of the
+// queued levels into the mapping, and once a copy is done unmaps the slot and issues
+// glTexSubImage2D / glCompressedTexSubImage2D from it. A fence per slot tells when the GPU has
+// read it and the slot can be mapped again. The GL thread never touches the pixel bytes, so
+// streaming costs a handful of GL calls per frame however large the textures are.
+//
+// Pieces are bands of whole rows (of 4x4 blocks for compressed formats) of one level, small mip
+// levels share a slot. Until its last piece landed a texture samples undefined contents.
+class TextureStreamer
+{
+public:
+    // totals since construction
+    struct Stats {
+        size_t textures = 0;       // uploads queued
+        size_t bytes = 0;          // bytes copied through the ring
+        size_t slotsIssued = 0;    // slots handed to the GPU
+        double slowestUpdate = 0.0;// milliseconds of the slowest update() call
+    };
+
+    // GL thread. slotBytes should hold at least one row (of blocks) of the widest level
+    explicit TextureStreamer(size_t slotCount = 4, size_t slotBytes = 4 << 20) : slotBytes(slotBytes)
+    {
+        for(size_t i = 0; i < slotCount; i++)
+        {
+            std::unique_ptr<Slot> slot(new Slot());
+            glGenBuffers(1, &slot->buffer);
+            GLState::instance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, slotBytes, nullptr, GL_STREAM_DRAW);
+            slots.push_back(std::move(slot));
+        }
+        GLState::instance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // GL thread. Waits for copies still running on a worker, they write into the mappings.
+    ~TextureStreamer()
+    {
+        for(std::unique_ptr<Slot> &slot : slots)
+        {
+            while(slot->state == SLOT_COPYING && !slot->copied.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            if(slot->state == SLOT_COPYING)
+            {
+                GLState::instance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+            if(slot->fence)
+                glDeleteSync(slot->fence);
+            GLState::instance().deleteBuffers(1, &slot->buffer);
+        }
+        GLState::instance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // GL thread: allocates every level of image in textureID and queues its contents. The levels
+    // are written as long as owner is alive, so a texture deleted before it streamed in (or its
+    // name reused) is never written to. Formats the context can't sample, and rows that don't fit
+    // a slot, are uploaded right away instead.
+    void upload(unsigned int textureID, std::shared_ptr<const CompressedImage> image, std::weak_ptr<const void> owner)
+    {
+        if(!image->valid())
+            return;
+        bool rgba = image->format == GL_RGBA8;
+        if((!rgba && !CompressedFormatUsable(image->format)) || rowBytes(*image, 0) > slotBytes)
+        {
+            UploadCompressedImage(textureID, *image);
+            return;
+        }
+        AllocateCompressedImage(textureID, *image);
+        stats.textures++;
+        for(size_t level = 0; level < image->levels.size(); level++)
+        {
+            const CompressedLevel &l = image->levels[level];
+            int unit = rgba ? 1 : 4, rows = rgba ? l.height : (l.height + 3) / 4;
+            int band = static_cast<int>(std::min<size_t>(rows, slotBytes / rowBytes(*image, level)));
+            for(int row = 0; row < rows; row += band)
+            {
+                Piece piece;
+                piece.texture = textureID;
+                piece.owner = owner;
+                piece.image = image;
+                piece.level = level;
+                piece.y = row * unit;
+                piece.height = std::min(band * unit, l.height - piece.y);
+                piece.source = image->data() + l.offset + size_t(row) * rowBytes(*image, level);
+                piece.size = size_t(std::min(band, rows - row)) * rowBytes(*image, level);
+                queue.push_back(std::move(piece));
+            }
+        }
+    }
+
+    // GL thread, once per frame: issues the slots whose copies finished, recycles the slots the
+    // GPU is done with and starts copies into every free one. Never blocks.
+    void update()
+    {
+        auto start = std::chrono::steady_clock::now();
+        for(std::unique_ptr<Slot> &slot : slots)
+        {
+            if(slot->state == SLOT_COPYING && slot->copied.load(std::memory_order_acquire))
+                issue(*slot);
+            if(slot->state == SLOT_IN_FLIGHT)
+                signaled(*slot, 0);
+            if(slot->state == SLOT_FREE && !queue.empty())
+                fill(*slot);
+        }
+        GLState::instance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        stats.slowestUpdate = std::max(stats.slowestUpdate,
+                                       std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    // GL thread: streams everything queued, waiting for the workers and the GPU as needed
+    void flush()
+    {
+        while(busy())
+        {
+            update();
+            for(std::unique_ptr<Slot> &slot : slots)
+                if(slot->state == SLOT_IN_FLIGHT)
+                    signaled(*slot, 1000000);
+        }
+    }
+
+    // true while pieces are queued or in a slot
+    bool busy() const
+    {
+        if(!queue.empty())
+            return true;
+        for(const std::unique_ptr<Slot> &slot : slots)
+            if(slot->state != SLOT_FREE)
+                return true;
+        return false;
+    }
+
+    const Stats &statistics() const { return stats; }
+
+private:
+    // a band of rows of one level
+    struct Piece {
+        unsigned int texture = 0;
+        std::weak_ptr<const void> owner;
+        std::shared_ptr<const CompressedImage> image; // keeps the source bytes (or their mapping) alive
+        size_t level = 0;
+        int y = 0, height = 0;
+        const uint8_t *source = nullptr;
+        size_t size = 0;
+        size_t offset = 0; // into the slot
+    };
+
+    enum SlotState {
+        SLOT_FREE,      // unmapped, the GPU is done with it
+        SLOT_COPYING,   // mapped, a worker is copying pieces in
+        SLOT_IN_FLIGHT  // unmapped, sub image uploads from it are queued behind fence
+    };
+
+    struct Slot {
+        unsigned int buffer = 0;
+        SlotState state = SLOT_FREE;
+        std::atomic<bool> copied{false};
+        uint8_t *mapped = nullptr;
+        std::vector<Piece> pieces;
+        GLsync fence = nullptr;
+    };
+
+    size_t slotBytes;
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::deque<Piece> queue;
+    Stats stats;
+
+    static size_t rowBytes(const CompressedImage &image, size_t level)
+    {
+        return image.format == GL_RGBA8 ? size_t(image.levels[level].width) * 4
+                                        : bcn::LevelBytes(image.format, image.levels[level].width, 4);
+    }
+
+    // maps slot, moves as many queued pieces as fit into it and has a worker copy them
+    void fill(Slot &slot)
+    {
+        GLState::instance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        // the fence was signaled, nothing reads the buffer anymore
+        slot.mapped = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotBytes,
+                                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+        if(!slot.mapped)
+            return;
+        size_t used = 0;
+        while(!queue.empty() && used + queue.front().size <= slotBytes)
+        {
+            Piece piece = std::move(queue.front());
+            queue.pop_front();
+            if(piece.owner.expired())
+                continue;
+            piece.offset = used;
+            used = (used + piece.size + 15) & ~size_t(15);
+            slot.pieces.push_back(std::move(piece));
+        }
+        slot.state = SLOT_COPYING;
+        slot.copied.store(false, std::memory_order_relaxed);
+        stats.bytes += used;
+        Slot *target = &slot;
+        SharedThreadPool().submit([target] {
+            for(const Piece &piece : target->pieces)
+                memcpy(target->mapped + piece.offset, piece.source, piece.size);
+            target->copied.store(true, std::memory_order_release);
+        });
+    }
+
+    // unmaps slot and uploads its pieces out of it
+    void issue(Slot &slot)
+    {
+        GLState::instance().bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        bool intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE; // false if the mapping got lost, e.g. on a mode switch
+        slot.mapped = nullptr;
+        for(Piece &piece : slot.pieces)
+        {
+            if(piece.owner.expired())
+                continue;
+            if(!intact)
+            {
+                queue.push_front(std::move(piece)); // copy again
+                continue;
+            }
+            const CompressedLevel &l = piece.image->levels[piece.level];
+            const void *offset = reinterpret_cast<const void*>(piece.offset);
+            GLState::instance().bindTexture(GL_TEXTURE_2D, piece.texture);
+            if(piece.image->format == GL_RGBA8)
+                glTexSubImage2D(GL_TEXTURE_2D, GLint(piece.level), 0, piece.y, l.width, piece.height, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+            else
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, GLint(piece.level), 0, piece.y, l.width, piece.height, piece.image->format,
+                                          GLsizei(piece.size), offset);
+        }
+        slot.pieces.clear();
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.state = SLOT_IN_FLIGHT;
+        stats.slotsIssued++;
+    }
+
+    // frees slot once the GPU is done reading it, waits up to timeout nanoseconds for that
+    bool signaled(Slot &slot, GLuint64 timeout)
+    {
+        GLenum result = glClientWaitSync(slot.fence, timeout ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, timeout);
+        if(result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+            return false;
+        release(slot);
+        return true;
+    }
+
+    void release(Slot &slot)
+    {
+        if(slot.fence)
+            glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        slot.state = SLOT_FREE;
+    }
+};
+#endif
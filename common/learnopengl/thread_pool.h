@@ -0,0 +1,179 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// fixed set of worker threads pulling jobs from one FIFO queue. Nothing in here touches OpenGL,
+// jobs must hand their results back to the thread that owns the context.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for(unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(std::thread &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+    void submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        wake.notify_one();
+    }
+
+    // calls fn(begin, end) over [0, count) in chunks of at most grain items and blocks until all
+    // chunks are done. The calling thread works on chunks as well, so this is safe to call from
+    // inside a job without starving the pool.
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &fn)
+    {
+        if(count == 0)
+            return;
+        grain = std::max<size_t>(grain, 1);
+        size_t chunks = (count + grain - 1) / grain;
+        if(chunks == 1)
+        {
+            fn(0, count);
+            return;
+        }
+
+        // shared with the helper jobs, which may only get to run after this call returned
+        struct Range {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            size_t count, grain, chunks;
+            const std::function<void(size_t, size_t)> *fn;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto range = std::make_shared<Range>();
+        range->count = count;
+        range->grain = grain;
+        range->chunks = chunks;
+        range->fn = &fn;
+
+        auto work = [range] {
+            for(;;)
+            {
+                size_t chunk = range->next.fetch_add(1);
+                if(chunk >= range->chunks)
+                    return;
+                size_t begin = chunk * range->grain;
+                (*range->fn)(begin, std::min(begin + range->grain, range->count));
+                if(range->done.fetch_add(1) + 1 == range->chunks)
+                {
+                    std::lock_guard<std::mutex> lock(range->mutex);
+                    range->finished.notify_all();
+                }
+            }
+        };
+
+        size_t helpers = std::min<size_t>(chunks - 1, size());
+        for(size_t i = 0; i < helpers; i++)
+            submit(work);
+        work();
+
+        std::unique_lock<std::mutex> lock(range->mutex);
+        range->finished.wait(lock, [&] { return range->done.load() == range->chunks; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for(;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if(stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+
+// process wide pool sized to the machine, created on first use
+inline ThreadPool &SharedThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+// runs produce(i) for every i in [0, count) on the shared pool and hands each result to
+// consume(i, result) on the calling thread, in completion order. This is the shape of every
+// "decode on workers, upload on the GL thread" load in the project.
+template<typename Result, typename ProduceFn, typename ConsumeFn>
+void ParallelProduce(size_t count, ProduceFn produce, ConsumeFn consume)
+{
+    if(count == 0)
+        return;
+
+    struct Finished {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<std::pair<size_t, Result>> results;
+    };
+    auto finished = std::make_shared<Finished>();
+
+    ThreadPool &pool = SharedThreadPool();
+    for(size_t i = 0; i < count; i++)
+    {
+        pool.submit([finished, i, produce] {
+            Result result = produce(i);
+            {
+                std::lock_guard<std::mutex> lock(finished->mutex);
+                finished->results.emplace_back(i, std::move(result));
+            }
+            finished->ready.notify_one();
+        });
+    }
+
+    for(size_t received = 0; received < count; received++)
+    {
+        std::pair<size_t, Result> next;
+        {
+            std::unique_lock<std::mutex> lock(finished->mutex);
+            finished->ready.wait(lock, [&] { return !finished->results.empty(); });
+            next = std::move(finished->results.front());
+            finished->results.pop_front();
+        }
+        consume(next.first, next.second);
+    }
+}
+#endif
@@ -2,6 +2,9 @@
 #include <std_image.h>
 
 #include <glad/glad.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/instancing.h>
+#include <learnopengl/render_queue.h>
 #include <GLFW/glfw3.h>
 
 #include <glm/glm.hpp>
@@ -18,6 +21,10 @@ void processInput(GLFWwindow *window);
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// CUBE_COUNT cubes as instances of one draw call (instancing.h), every third one turning like in
+// the tutorial; off for the tutorial's 10 cubes with a draw call each
+const bool INSTANCED_CUBES = true;
+const size_t CUBE_COUNT = 100000;
 
 int main()
 {
@@ -54,7 +61,7 @@ int main()
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    GLState::instance().enable(GL_DEPTH_TEST);
 
     // build and compile our shader zprogram
     // ------------------------------------
@@ -110,9 +117,9 @@ int main()
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
 
-    glBindVertexArray(VAO);
+    GLState::instance().bindVertexArray(VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
     // position attribute
@@ -129,7 +136,7 @@ int main()
     // texture 1
     // ---------
     glGenTextures(1, &texture1);
-    glBindTexture(GL_TEXTURE_2D, texture1);
+    GLState::instance().bindTexture(GL_TEXTURE_2D, texture1);
     // set the texture wrapping parameters
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -157,7 +164,7 @@ int main()
     // texture 2
     // ---------
     glGenTextures(1, &texture2);
-    glBindTexture(GL_TEXTURE_2D, texture2);
+    GLState::instance().bindTexture(GL_TEXTURE_2D, texture2);
     // set the texture wrapping parameters
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -187,6 +194,17 @@ int main()
     ourShader.use();
     ourShader.setInt("texture1", 0);
     ourShader.setInt("texture2", 1);
+    // the same with the model matrix per instance
+    Shader instancedShader("../trans_instanced_vs.glsl", "../trans_fs.glsl");
+    instancedShader.use();
+    instancedShader.setInt("texture1", 0);
+    instancedShader.setInt("texture2", 1);
+
+    // a field of cubes in front of the camera, matrices recomputed and uploaded every frame
+    InstanceField cubeField = ScatterInstances(CUBE_COUNT, glm::vec3(0.0f, 0.0f, -45.0f), 80.0f, 1.0f / 3.0f);
+    std::vector<glm::mat4> cubeModels;
+    InstanceBuffer instances;
+    instances.attach(VAO);
 
     // more cubes
     glm::vec3 cubePositions[] = {
@@ -202,6 +220,10 @@ int main()
             glm::vec3(-1.3f,  1.0f, -1.5f)
     };
 
+    // draws of a frame, submitted in sort key order (render_queue.h)
+    RenderQueue renderQueue;
+    glm::mat4 boxModels[10];
+
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window))
@@ -215,12 +237,6 @@ int main()
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // also clear the depth buffer now!
 
-        // bind textures on corresponding texture units
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture1);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texture2);
-
         // activate shader
         ourShader.use();
 
@@ -240,21 +256,53 @@ int main()
         // note: currently we set the projection matrix each frame, but since the projection matrix rarely changes it's often best practice to set it outside the main loop only once.
         ourShader.setMat4("projection", projection);
 
-        // render box
-        glBindVertexArray(VAO);
-        for(unsigned int i = 0; i < 10; i++)
+        if(INSTANCED_CUBES)
         {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            if (i % 3 == 0){
-                angle = (float)glfwGetTime() * 25.0f;
+            // render all boxes at once, the queue only gets the one draw
+            InstanceMatrices(cubeField, (float)glfwGetTime(), cubeModels);
+            instances.upload(cubeModels.data(), cubeModels.size());
+            instancedShader.use();
+            instancedShader.setMat4("view", view);
+            instancedShader.setMat4("projection", projection);
+            uint32_t field = renderQueue.addSource([&](uint32_t) {
+                GLState::instance().bindTexture(0, GL_TEXTURE_2D, texture1);
+                GLState::instance().bindTexture(1, GL_TEXTURE_2D, texture2);
+                instancedShader.use();
+                GLState::instance().bindVertexArray(VAO);
+                glDrawArraysInstanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(instances.size()));
+            });
+            renderQueue.push(MakeRenderKey(RENDER_PASS_OPAQUE, instancedShader.ID, HashCombine(texture1, texture2), VAO, 0), field, 0);
+        }
+        else
+        {
+            // render box: recorded into the queue, which draws them sorted by state and front to back
+            uint32_t boxes = renderQueue.addSource([&](uint32_t i) {
+                // bind textures on corresponding texture units, free after the first box
+                GLState::instance().bindTexture(0, GL_TEXTURE_2D, texture1);
+                GLState::instance().bindTexture(1, GL_TEXTURE_2D, texture2);
+                ourShader.use();
+                GLState::instance().bindVertexArray(VAO);
+                ourShader.setMat4("model", boxModels[i]);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+            });
+            for(unsigned int i = 0; i < 10; i++)
+            {
+                glm::mat4 model = glm::mat4(1.0f);
+                model = glm::translate(model, cubePositions[i]);
+                float angle = 20.0f * i;
+                if (i % 3 == 0){
+                    angle = (float)glfwGetTime() * 25.0f;
+                }
+                model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+                boxModels[i] = model;
+
+                float distance = -(view * model[3]).z;
+                renderQueue.push(MakeRenderKey(RENDER_PASS_OPAQUE, ourShader.ID, HashCombine(texture1, texture2), VAO,
+                                               QuantizeRenderDepth(distance, 0.1f, 100.0f)), boxes, i);
             }
-            model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            ourShader.setMat4("model", model);
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
         }
+        renderQueue.sort();
+        renderQueue.submit();
 
         //glDrawArrays(GL_TRIANGLES, 0, 36);
 
@@ -267,9 +315,11 @@ int main()
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    GLState::instance().deleteVertexArrays(1, &VAO);
+    GLState::instance().deleteBuffers(1, &VBO);
+    instances.release();
 
+    GLState::instance().report();
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
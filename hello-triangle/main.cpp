@@ -2,19 +2,20 @@
 #include <vector>
 
 #include "glad/glad.h"
+#include <learnopengl/gl_state.h>
 #include <GLFW/glfw3.h>
 
 #define SHOUD_RETURN_N3 if (!ret) { \
     glDeleteShader(vertex_shader);  \
-    glDeleteVertexArrays(2, vao); \
-    glDeleteBuffers(2, vbo); \
+    GLState::instance().deleteVertexArrays(2, vao); \
+    GLState::instance().deleteBuffers(2, vbo); \
     glfwTerminate(); \
     return -3; \
 }
 
 #define SHOUD_RETURN_N4 if (!ret) { \
-    glDeleteVertexArrays(2, vao); \
-    glDeleteBuffers(2, vbo); \
+    GLState::instance().deleteVertexArrays(2, vao); \
+    GLState::instance().deleteBuffers(2, vbo); \
     glfwTerminate(); \
     return -4; \
 }
@@ -55,8 +56,8 @@ inline void processInput(GLFWwindow* window) {
 }
 
 inline void drawTris(unsigned int shader_program, unsigned int vao) {
-    glUseProgram(shader_program);
-    glBindVertexArray(vao);
+    GLState::instance().useProgram(shader_program);
+    GLState::instance().bindVertexArray(vao);
     glDrawArrays(GL_TRIANGLES, 0, 3);
 }
 
@@ -113,8 +114,8 @@ int main() {
     unsigned int vertex_shader = 0;
     bool ret = genShaders(GL_VERTEX_SHADER, vertex_shader_source, vertex_shader);
     if (!ret) {
-        glDeleteVertexArrays(2, vao);
-        glDeleteBuffers(2, vbo);
+        GLState::instance().deleteVertexArrays(2, vao);
+        GLState::instance().deleteBuffers(2, vbo);
         glfwTerminate();
         return -2;
     }
@@ -153,10 +154,11 @@ int main() {
         glfwPollEvents();
     }
 
-    glDeleteProgram(shader_yellow_program);
-    glDeleteProgram(shader_blue_program);
-    glDeleteVertexArrays(2, vao);
-    glDeleteBuffers(2, vbo);
+    GLState::instance().deleteProgram(shader_yellow_program);
+    GLState::instance().deleteProgram(shader_blue_program);
+    GLState::instance().deleteVertexArrays(2, vao);
+    GLState::instance().deleteBuffers(2, vbo);
+    GLState::instance().report();
     glfwTerminate();
     return 0;
 }
@@ -192,15 +194,15 @@ bool genShaderProgram(const std::vector<unsigned int>& shader_vec, unsigned int&
     if (success == 0) {
         glGetProgramInfoLog(shader_program, 512, nullptr, info);
         std::clog << "Failed to link gl shaders. Reason: " << info << "\n";
-        glDeleteProgram(shader_program);
+        GLState::instance().deleteProgram(shader_program);
         return false;
     }
     return true;
 }
 
 void genVertexData(const std::vector<float>& vertex_vec, unsigned int& vao, unsigned int& vbo) {
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    GLState::instance().bindVertexArray(vao);
+    GLState::instance().bindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * static_cast<GLsizeiptr>(vertex_vec.size()), vertex_vec.data(), GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)nullptr);
     glEnableVertexAttribArray(0);
@@ -0,0 +1,767 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <assimp/anim.h>
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <learnopengl/simd.h>
+#include <learnopengl/thread_pool.h>
+
+#include "scene_graph.h"
+#include "skeleton.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Keyframe animation for many skeletons at once. Clips are resampled at import to a fixed frame
+// rate and bound to the node order of a model, so a frame is ten tracks (translation xyz, rotation
+// xyzw, scale xyz) of one float per node. Every node shares the same pair of frames and the same
+// blend factor, which makes sampling a straight lerp over contiguous floats, four nodes per SIMD
+// instruction, followed by renormalizing the quaternions (nlerp). AnimationRig turns a pose into
+// the bone palette of skeleton.h, AnimateInstances spreads whole crowds over the thread pool.
+// Models keep their clips as CompressedClip, a fraction of the size that samples from one block.
+const float kAnimationSampleRate = 30.0f; // frames per second of resampled clips
+const size_t kAnimationGrain = 16;        // instances per task of AnimateInstances
+
+enum AnimationTrack {
+    TRACK_TX, TRACK_TY, TRACK_TZ,
+    TRACK_RX, TRACK_RY, TRACK_RZ, TRACK_RW,
+    TRACK_SX, TRACK_SY, TRACK_SZ,
+    kTrackCount
+};
+
+// floats per track: the node count rounded up to whole SIMD vectors
+inline size_t TrackStride(size_t nodeCount)
+{
+    return (nodeCount + 3) & ~size_t(3);
+}
+
+struct AnimationClip {
+    string name;
+    float duration = 0.0f;          // seconds
+    float sampleRate = kAnimationSampleRate;
+    unsigned int frameCount = 0;
+    unsigned int nodeCount = 0;     // of the SceneGraph the clip is bound to
+    vector<float> keys;             // [frame][track][node], TrackStride(nodeCount) floats per track
+
+    size_t stride() const { return TrackStride(nodeCount); }
+    const float *frame(unsigned int f) const { return keys.data() + size_t(f) * kTrackCount * stride(); }
+};
+
+// the local transform of every node, laid out like one clip frame
+struct Pose {
+    unsigned int nodeCount = 0;
+    vector<float> tracks;
+
+    // identity transforms for nodes when the node count changes. The padding lanes stay identity,
+    // so normalizing them never divides by zero.
+    void resize(unsigned int nodes)
+    {
+        if(nodes == nodeCount && !tracks.empty())
+            return;
+        nodeCount = nodes;
+        tracks.assign(kTrackCount * stride(), 0.0f);
+        for(int k : { TRACK_RW, TRACK_SX, TRACK_SY, TRACK_SZ })
+            std::fill(track(k), track(k) + stride(), 1.0f);
+    }
+    size_t stride() const { return TrackStride(nodeCount); }
+    float *track(int t) { return tracks.data() + t * stride(); }
+    const float *track(int t) const { return tracks.data() + t * stride(); }
+
+    void set(unsigned int node, const glm::vec3 &t, const glm::quat &r, const glm::vec3 &s)
+    {
+        const float values[kTrackCount] = { t.x, t.y, t.z, r.x, r.y, r.z, r.w, s.x, s.y, s.z };
+        for(int k = 0; k < kTrackCount; k++)
+            track(k)[node] = values[k];
+    }
+    glm::vec3 translation(unsigned int node) const { return glm::vec3(track(TRACK_TX)[node], track(TRACK_TY)[node], track(TRACK_TZ)[node]); }
+    glm::quat rotation(unsigned int node) const
+    {
+        return glm::quat(track(TRACK_RW)[node], track(TRACK_RX)[node], track(TRACK_RY)[node], track(TRACK_RZ)[node]);
+    }
+    glm::vec3 scale(unsigned int node) const { return glm::vec3(track(TRACK_SX)[node], track(TRACK_SY)[node], track(TRACK_SZ)[node]); }
+};
+
+namespace animation
+{
+    // the value of an assimp key track at tick, linearly interpolated between the keys around it
+    template<typename Key, typename Value, typename Interpolate>
+    Value SampleKeys(const Key *keys, unsigned int count, double tick, Value fallback, Interpolate interpolate)
+    {
+        if(count == 0)
+            return fallback;
+        if(count == 1 || tick <= keys[0].mTime)
+            return keys[0].mValue;
+        if(tick >= keys[count - 1].mTime)
+            return keys[count - 1].mValue;
+        const Key *next = std::upper_bound(keys, keys + count, tick, [](double t, const Key &key) { return t < key.mTime; });
+        const Key *prev = next - 1;
+        float alpha = static_cast<float>((tick - prev->mTime) / (next->mTime - prev->mTime));
+        return interpolate(prev->mValue, next->mValue, alpha);
+    }
+
+    // a * b for matrices whose last row is (0, 0, 0, 1), column by column on SIMD lanes
+    inline void MulAffine(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out)
+    {
+        using namespace simd;
+        float4 a0 = load4(&a[0][0]), a1 = load4(&a[1][0]), a2 = load4(&a[2][0]), a3 = load4(&a[3][0]);
+        for(int j = 0; j < 4; j++)
+        {
+            float4 column = add4(add4(mul4(a0, splat4(b[j][0])), mul4(a1, splat4(b[j][1]))), mul4(a2, splat4(b[j][2])));
+            if(j == 3)
+                column = add4(column, a3);
+            store4(&out[j][0], column);
+        }
+    }
+
+    // unit length for the rotation lanes of tracks
+    inline void NormalizeRotations(float *tracks, size_t stride)
+    {
+        using namespace simd;
+        float *x = tracks + TRACK_RX * stride, *y = tracks + TRACK_RY * stride;
+        float *z = tracks + TRACK_RZ * stride, *w = tracks + TRACK_RW * stride;
+        for(size_t i = 0; i < stride; i += 4)
+        {
+            float4 qx = load4(x + i), qy = load4(y + i), qz = load4(z + i), qw = load4(w + i);
+            float4 length = sqrt4(add4(add4(mul4(qx, qx), mul4(qy, qy)), add4(mul4(qz, qz), mul4(qw, qw))));
+            store4(x + i, div4(qx, length));
+            store4(y + i, div4(qy, length));
+            store4(z + i, div4(qz, length));
+            store4(w + i, div4(qw, length));
+        }
+    }
+}
+
+// resamples an assimp animation onto the nodes of a model. Nodes without a channel keep their
+// bind pose, consecutive rotations are kept in the same hemisphere so a plain lerp takes the short way.
+inline AnimationClip ImportAnimation(const aiAnimation *animation, const SceneGraph &nodes)
+{
+    AnimationClip clip;
+    clip.name = animation->mName.C_Str();
+    double ticksPerSecond = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+    clip.duration = static_cast<float>(animation->mDuration / ticksPerSecond);
+    clip.frameCount = std::max(2u, static_cast<unsigned int>(std::ceil(clip.duration * clip.sampleRate)) + 1);
+    clip.nodeCount = static_cast<unsigned int>(nodes.size());
+    size_t stride = clip.stride();
+    clip.keys.assign(size_t(clip.frameCount) * kTrackCount * stride, 0.0f);
+
+    Pose bind;
+    bind.resize(clip.nodeCount);
+    for(unsigned int n = 0; n < clip.nodeCount; n++)
+        bind.set(n, nodes.translation(n), nodes.rotation(n), nodes.scale(n));
+    for(unsigned int f = 0; f < clip.frameCount; f++)
+        std::copy(bind.tracks.begin(), bind.tracks.end(), clip.keys.begin() + size_t(f) * kTrackCount * stride);
+
+    auto lerp = [](const aiVector3D &a, const aiVector3D &b, float alpha) { return a + (b - a) * alpha; };
+    auto slerp = [](const aiQuaternion &a, const aiQuaternion &b, float alpha) {
+        aiQuaternion q;
+        aiQuaternion::Interpolate(q, a, b, alpha);
+        return q;
+    };
+    for(unsigned int c = 0; c < animation->mNumChannels; c++)
+    {
+        const aiNodeAnim *channel = animation->mChannels[c];
+        int node = nodes.find(channel->mNodeName.C_Str());
+        if(node < 0)
+            continue;
+        glm::vec3 t0 = nodes.translation(node), s0 = nodes.scale(node);
+        glm::quat r0 = nodes.rotation(node), previous = r0;
+        for(unsigned int f = 0; f < clip.frameCount; f++)
+        {
+            double tick = std::min(double(f) / clip.sampleRate, double(clip.duration)) * ticksPerSecond;
+            aiVector3D t = animation::SampleKeys(channel->mPositionKeys, channel->mNumPositionKeys, tick, aiVector3D(t0.x, t0.y, t0.z), lerp);
+            aiQuaternion r = animation::SampleKeys(channel->mRotationKeys, channel->mNumRotationKeys, tick, aiQuaternion(r0.w, r0.x, r0.y, r0.z), slerp);
+            aiVector3D s = animation::SampleKeys(channel->mScalingKeys, channel->mNumScalingKeys, tick, aiVector3D(s0.x, s0.y, s0.z), lerp);
+            glm::quat rotation = glm::normalize(glm::quat(r.w, r.x, r.y, r.z));
+            if(f > 0 && glm::dot(rotation, previous) < 0.0f)
+                rotation = -rotation;
+            previous = rotation;
+            float *keys = clip.keys.data() + size_t(f) * kTrackCount * stride;
+            const float values[kTrackCount] = { t.x, t.y, t.z, rotation.x, rotation.y, rotation.z, rotation.w, s.x, s.y, s.z };
+            for(int k = 0; k < kTrackCount; k++)
+                keys[k * stride + node] = values[k];
+        }
+    }
+    return clip;
+}
+
+// the pose of clip at time seconds. Looping clips wrap around, others hold their last frame.
+inline void SampleClip(const AnimationClip &clip, float time, Pose &pose, bool loop = true)
+{
+    using namespace simd;
+    pose.resize(clip.nodeCount);
+    if(loop && clip.duration > 0.0f)
+    {
+        time = std::fmod(time, clip.duration);
+        if(time < 0.0f)
+            time += clip.duration;
+    }
+    float position = std::min(std::max(time, 0.0f), clip.duration) * clip.sampleRate;
+    unsigned int f0 = std::min(static_cast<unsigned int>(position), clip.frameCount - 1);
+    unsigned int f1 = std::min(f0 + 1, clip.frameCount - 1);
+    const float *a = clip.frame(f0), *b = clip.frame(f1);
+    float *out = pose.tracks.data();
+    float4 alpha = splat4(position - f0);
+    for(size_t i = 0; i < pose.tracks.size(); i += 4)
+    {
+        float4 va = load4(a + i);
+        store4(out + i, add4(va, mul4(sub4(load4(b + i), va), alpha)));
+    }
+    animation::NormalizeRotations(out, pose.stride());
+}
+
+// out = a blended towards b by weight (0 = a, 1 = b). The two poses come from different clips, so
+// the rotations of b are flipped into a's hemisphere lane by lane first. out may be a or b.
+inline void BlendPoses(const Pose &a, const Pose &b, float weight, Pose &out)
+{
+    using namespace simd;
+    out.resize(a.nodeCount);
+    size_t stride = a.stride();
+    const float *pa = a.tracks.data(), *pb = b.tracks.data();
+    float *po = out.tracks.data();
+    float4 w = splat4(weight);
+    auto lerp = [&](size_t i, float4 vb) {
+        float4 va = load4(pa + i);
+        store4(po + i, add4(va, mul4(sub4(vb, va), w)));
+    };
+    for(size_t i = 0; i < stride; i += 4)
+    {
+        float4 dot = zero4();
+        for(int k = TRACK_RX; k <= TRACK_RW; k++)
+            dot = add4(dot, mul4(load4(pa + k * stride + i), load4(pb + k * stride + i)));
+        for(int k = 0; k < kTrackCount; k++)
+        {
+            float4 vb = load4(pb + k * stride + i);
+            lerp(k * stride + i, k >= TRACK_RX && k <= TRACK_RW ? xorsign4(vb, dot) : vb);
+        }
+    }
+    animation::NormalizeRotations(po, stride);
+}
+
+// Compressed clips. A resampled clip is cut into blocks of kClipBlockFrames frames (plus the first
+// frame of the next block, so sampling never straddles two blocks) and every block is one
+// contiguous run of bytes:
+//
+//   uint32 keyCount, components, constantFloats, rangeFloats
+//   uint16 frames[keyCount]               kept frames relative to the block start, padded to 4 bytes
+//   uint8  flags[nodeCount]               CLIP_ANIMATED_* per node, padded to 4 bytes
+//   float  constants[constantFloats]      t xyz, r xyzw, s xyz of the groups that don't move in the block
+//   float  ranges[rangeFloats]            min xyz, extent xyz of the animated t and s groups
+//   uint16 values[keyCount][components]   three quantized components per animated group
+//
+// Frames that the lerp of their neighbours reproduces within the error budget are dropped, groups
+// that stay within the budget over the whole block are stored once at full precision. Translations
+// and scales quantize to 16 bits over their range in the block, rotations to the smallest three
+// components at 15 bits with the index of the dropped largest one in the low bits. Sampling decodes
+// the two kept keys around the time from one block and blends them.
+const unsigned int kClipBlockFrames = 16;
+
+enum ClipGroupFlags {
+    CLIP_ANIMATED_T = 1,
+    CLIP_ANIMATED_R = 2,
+    CLIP_ANIMATED_S = 4
+};
+
+// the largest error compression may introduce on a node's local transform, before quantization
+struct ClipCompression {
+    float translationError = 0.0005f; // model units
+    float rotationError = 0.0005f;    // radians
+    float scaleError = 0.0005f;
+};
+
+struct CompressedClip {
+    string name;
+    float duration = 0.0f;          // seconds
+    float sampleRate = kAnimationSampleRate;
+    unsigned int frameCount = 0;    // of the resampled clip
+    unsigned int nodeCount = 0;
+    vector<uint32_t> blocks;        // byte offset of every block in data
+    vector<uint8_t> data;
+
+    size_t bytes() const { return data.size() + blocks.size() * sizeof(uint32_t); }
+    // the size of the same clip as an AnimationClip
+    size_t rawBytes() const { return size_t(frameCount) * kTrackCount * TrackStride(nodeCount) * sizeof(float); }
+};
+
+namespace animation
+{
+    struct ClipBlock {
+        unsigned int keyCount = 0, components = 0;
+        const uint16_t *frames = nullptr;
+        const uint8_t *flags = nullptr;
+        const float *constants = nullptr;
+        const float *ranges = nullptr;
+        const uint16_t *values = nullptr;
+        size_t bytes = 0;
+    };
+
+    inline size_t Align4(size_t bytes)
+    {
+        return (bytes + 3) & ~size_t(3);
+    }
+
+    // the sections of the block at offset, or false if they run past size
+    inline bool ParseClipBlock(const uint8_t *data, size_t size, size_t offset, unsigned int nodeCount, ClipBlock &block)
+    {
+        if(offset % 4 != 0 || offset + 4 * sizeof(uint32_t) > size)
+            return false;
+        const uint32_t *header = reinterpret_cast<const uint32_t*>(data + offset);
+        block.keyCount = header[0];
+        block.components = header[1];
+        size_t at = offset + 4 * sizeof(uint32_t);
+        block.frames = reinterpret_cast<const uint16_t*>(data + at);
+        at += Align4(block.keyCount * sizeof(uint16_t));
+        block.flags = data + at;
+        at += Align4(nodeCount);
+        block.constants = reinterpret_cast<const float*>(data + at);
+        at += size_t(header[2]) * sizeof(float);
+        block.ranges = reinterpret_cast<const float*>(data + at);
+        at += size_t(header[3]) * sizeof(float);
+        block.values = reinterpret_cast<const uint16_t*>(data + at);
+        at += Align4(size_t(block.keyCount) * block.components * sizeof(uint16_t));
+        block.bytes = at - offset;
+        return block.keyCount > 0 && at <= size;
+    }
+
+    // angle between two unit quaternions
+    inline float RotationError(const glm::quat &a, const glm::quat &b)
+    {
+        // atan2 of the relative rotation, acos loses everything below ~1e-3 near a dot of one
+        glm::quat d = glm::conjugate(a) * b;
+        return 2.0f * std::atan2(glm::length(glm::vec3(d.x, d.y, d.z)), std::abs(d.w));
+    }
+
+    inline float MaxDifference(const glm::vec3 &a, const glm::vec3 &b)
+    {
+        glm::vec3 d = glm::abs(a - b);
+        return std::max(d.x, std::max(d.y, d.z));
+    }
+
+    // whether every frame strictly between first and last is the lerp of those two within budget
+    inline bool LerpFits(const AnimationClip &clip, unsigned int first, unsigned int last, const ClipCompression &budget)
+    {
+        Pose a, b;
+        a.nodeCount = b.nodeCount = clip.nodeCount;
+        a.tracks.assign(clip.frame(first), clip.frame(first) + kTrackCount * clip.stride());
+        b.tracks.assign(clip.frame(last), clip.frame(last) + kTrackCount * clip.stride());
+        Pose frame, lerped;
+        frame.nodeCount = clip.nodeCount;
+        for(unsigned int f = first + 1; f < last; f++)
+        {
+            frame.tracks.assign(clip.frame(f), clip.frame(f) + kTrackCount * clip.stride());
+            BlendPoses(a, b, float(f - first) / float(last - first), lerped);
+            for(unsigned int n = 0; n < clip.nodeCount; n++)
+            {
+                if(MaxDifference(frame.translation(n), lerped.translation(n)) > budget.translationError ||
+                   RotationError(frame.rotation(n), lerped.rotation(n)) > budget.rotationError ||
+                   MaxDifference(frame.scale(n), lerped.scale(n)) > budget.scaleError)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    inline uint16_t Quantize16(float value, float min, float extent)
+    {
+        if(extent <= 0.0f)
+            return 0;
+        return static_cast<uint16_t>(std::lround(std::min(std::max((value - min) / extent, 0.0f), 1.0f) * 65535.0f));
+    }
+
+    // smallest three: the largest component is dropped (made positive and rebuilt from the unit
+    // length), the others lie in [-1/sqrt2, 1/sqrt2] and keep 15 bits. The index of the dropped
+    // component goes into the low bits of the first two.
+    inline void EncodeRotation(glm::quat q, uint16_t out[3])
+    {
+        float c[4] = { q.x, q.y, q.z, q.w };
+        int largest = 0;
+        for(int i = 1; i < 4; i++)
+            if(std::abs(c[i]) > std::abs(c[largest]))
+                largest = i;
+        float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+        for(int i = 0, j = 0; i < 4; i++)
+        {
+            if(i == largest)
+                continue;
+            float unit = std::min(std::max(c[i] * sign * 0.70710678f + 0.5f, 0.0f), 1.0f);
+            out[j++] = static_cast<uint16_t>(std::lround(unit * 32767.0f) << 1);
+        }
+        out[0] |= largest & 1;
+        out[1] |= (largest >> 1) & 1;
+    }
+
+    inline void DecodeRotation(const uint16_t in[3], float c[4])
+    {
+        // where each of x, y, z, w comes from in { three stored components, rebuilt one }, per dropped index
+        static const int slots[4][4] = { { 3, 0, 1, 2 }, { 0, 3, 1, 2 }, { 0, 1, 3, 2 }, { 0, 1, 2, 3 } };
+        float v[4];
+        for(int i = 0; i < 3; i++)
+            v[i] = ((in[i] >> 1) * (1.0f / 32767.0f) - 0.5f) * 1.41421356f;
+        v[3] = std::sqrt(std::max(0.0f, 1.0f - v[0] * v[0] - v[1] * v[1] - v[2] * v[2]));
+        const int *slot = slots[(in[0] & 1) | ((in[1] & 1) << 1)];
+        for(int i = 0; i < 4; i++)
+            c[i] = v[slot[i]];
+    }
+
+    // pose = keys a and b of block lerped by alpha, in one pass over the block. Groups that don't
+    // move in the block are copied, rotations take the short way. The pose must already have the
+    // clip's node count, its rotations still need normalizing.
+    inline void DecodeClipKeys(const ClipBlock &block, unsigned int a, unsigned int b, float alpha, unsigned int nodeCount, Pose &pose)
+    {
+        const float *constants = block.constants, *ranges = block.ranges;
+        const uint16_t *va = block.values + size_t(a) * block.components, *vb = block.values + size_t(b) * block.components;
+        size_t stride = pose.stride();
+        float *tracks = pose.tracks.data();
+        const float unit = 1.0f / 65535.0f;
+        auto vector3 = [&](unsigned int n, int track, bool animated) {
+            if(!animated)
+            {
+                for(int i = 0; i < 3; i++)
+                    tracks[(track + i) * stride + n] = constants[i];
+                constants += 3;
+                return;
+            }
+            for(int i = 0; i < 3; i++)
+            {
+                float qa = va[i], q = qa + (float(vb[i]) - qa) * alpha;
+                tracks[(track + i) * stride + n] = ranges[i] + q * unit * ranges[3 + i];
+            }
+            ranges += 6;
+            va += 3;
+            vb += 3;
+        };
+        for(unsigned int n = 0; n < nodeCount; n++)
+        {
+            uint8_t flags = block.flags[n];
+            vector3(n, TRACK_TX, (flags & CLIP_ANIMATED_T) != 0);
+            float r[4];
+            if(flags & CLIP_ANIMATED_R)
+            {
+                float ra[4], rb[4];
+                DecodeRotation(va, ra);
+                DecodeRotation(vb, rb);
+                // smallest three keeps the largest component positive, which may flip neighbouring keys
+                float dot = ra[0] * rb[0] + ra[1] * rb[1] + ra[2] * rb[2] + ra[3] * rb[3];
+                float w = dot < 0.0f ? -alpha : alpha;
+                for(int i = 0; i < 4; i++)
+                    r[i] = ra[i] * (1.0f - alpha) + rb[i] * w;
+                va += 3;
+                vb += 3;
+            }
+            else
+            {
+                std::copy(constants, constants + 4, r);
+                constants += 4;
+            }
+            for(int i = 0; i < 4; i++)
+                tracks[(TRACK_RX + i) * stride + n] = r[i];
+            vector3(n, TRACK_SX, (flags & CLIP_ANIMATED_S) != 0);
+        }
+    }
+
+    inline void AppendBytes(vector<uint8_t> &data, const void *bytes, size_t size)
+    {
+        const uint8_t *p = static_cast<const uint8_t*>(bytes);
+        data.insert(data.end(), p, p + size);
+        data.resize(Align4(data.size()), 0);
+    }
+}
+
+// clip with redundant frames dropped and the rest quantized, see kClipBlockFrames
+inline CompressedClip CompressClip(const AnimationClip &clip, const ClipCompression &budget = ClipCompression())
+{
+    CompressedClip out;
+    out.name = clip.name;
+    out.duration = clip.duration;
+    out.sampleRate = clip.sampleRate;
+    out.frameCount = clip.frameCount;
+    out.nodeCount = clip.nodeCount;
+    if(clip.frameCount == 0)
+        return out;
+    size_t stride = clip.stride();
+    auto value = [&](unsigned int f, int track, unsigned int n) { return clip.frame(f)[track * stride + n]; };
+    auto vector3 = [&](unsigned int f, int track, unsigned int n) { return glm::vec3(value(f, track, n), value(f, track + 1, n), value(f, track + 2, n)); };
+    auto rotation = [&](unsigned int f, unsigned int n) {
+        return glm::quat(value(f, TRACK_RW, n), value(f, TRACK_RX, n), value(f, TRACK_RY, n), value(f, TRACK_RZ, n));
+    };
+
+    unsigned int blockCount = std::max(1u, (clip.frameCount - 1 + kClipBlockFrames - 1) / kClipBlockFrames);
+    for(unsigned int b = 0; b < blockCount; b++)
+    {
+        unsigned int first = b * kClipBlockFrames, last = std::min(first + kClipBlockFrames, clip.frameCount - 1);
+        // greedy key reduction: from every kept frame, jump as far as the lerp stays within budget
+        vector<uint16_t> frames = { 0 };
+        for(unsigned int key = first; key < last; )
+        {
+            unsigned int next = key + 1;
+            while(next < last && animation::LerpFits(clip, key, next + 1, budget))
+                next++;
+            frames.push_back(static_cast<uint16_t>(next - first));
+            key = next;
+        }
+
+        // groups that stay within budget of the block's first frame are stored once
+        vector<uint8_t> flags(clip.nodeCount, 0);
+        vector<float> constants, ranges;
+        unsigned int components = 0;
+        for(unsigned int n = 0; n < clip.nodeCount; n++)
+        {
+            glm::vec3 t0 = vector3(first, TRACK_TX, n), s0 = vector3(first, TRACK_SX, n);
+            glm::quat r0 = rotation(first, n);
+            for(unsigned int f = first + 1; f <= last; f++)
+            {
+                if(animation::MaxDifference(vector3(f, TRACK_TX, n), t0) > budget.translationError)
+                    flags[n] |= CLIP_ANIMATED_T;
+                if(animation::RotationError(rotation(f, n), r0) > budget.rotationError)
+                    flags[n] |= CLIP_ANIMATED_R;
+                if(animation::MaxDifference(vector3(f, TRACK_SX, n), s0) > budget.scaleError)
+                    flags[n] |= CLIP_ANIMATED_S;
+            }
+            auto range = [&](int track) {
+                float min[3], max[3];
+                for(int i = 0; i < 3; i++)
+                {
+                    min[i] = max[i] = value(first, track + i, n);
+                    for(uint16_t frame : frames)
+                    {
+                        min[i] = std::min(min[i], value(first + frame, track + i, n));
+                        max[i] = std::max(max[i], value(first + frame, track + i, n));
+                    }
+                }
+                ranges.insert(ranges.end(), { min[0], min[1], min[2], max[0] - min[0], max[1] - min[1], max[2] - min[2] });
+                components += 3;
+            };
+            if(flags[n] & CLIP_ANIMATED_T)
+                range(TRACK_TX);
+            else
+                constants.insert(constants.end(), { t0.x, t0.y, t0.z });
+            if(flags[n] & CLIP_ANIMATED_R)
+                components += 3;
+            else
+                constants.insert(constants.end(), { r0.x, r0.y, r0.z, r0.w });
+            if(flags[n] & CLIP_ANIMATED_S)
+                range(TRACK_SX);
+            else
+                constants.insert(constants.end(), { s0.x, s0.y, s0.z });
+        }
+
+        vector<uint16_t> values;
+        values.reserve(frames.size() * components);
+        for(uint16_t frame : frames)
+        {
+            unsigned int f = first + frame;
+            const float *range = ranges.data();
+            for(unsigned int n = 0; n < clip.nodeCount; n++)
+            {
+                for(int track : { TRACK_TX, TRACK_RX, TRACK_SX })
+                {
+                    uint8_t animated = track == TRACK_TX ? CLIP_ANIMATED_T : track == TRACK_RX ? CLIP_ANIMATED_R : CLIP_ANIMATED_S;
+                    if(!(flags[n] & animated))
+                        continue;
+                    if(track == TRACK_RX)
+                    {
+                        uint16_t q[3];
+                        animation::EncodeRotation(rotation(f, n), q);
+                        values.insert(values.end(), q, q + 3);
+                        continue;
+                    }
+                    for(int i = 0; i < 3; i++)
+                        values.push_back(animation::Quantize16(value(f, track + i, n), range[i], range[3 + i]));
+                    range += 6;
+                }
+            }
+        }
+
+        out.blocks.push_back(static_cast<uint32_t>(out.data.size()));
+        const uint32_t header[4] = { static_cast<uint32_t>(frames.size()), components,
+                                     static_cast<uint32_t>(constants.size()), static_cast<uint32_t>(ranges.size()) };
+        animation::AppendBytes(out.data, header, sizeof(header));
+        animation::AppendBytes(out.data, frames.data(), frames.size() * sizeof(uint16_t));
+        animation::AppendBytes(out.data, flags.data(), flags.size());
+        animation::AppendBytes(out.data, constants.data(), constants.size() * sizeof(float));
+        animation::AppendBytes(out.data, ranges.data(), ranges.size() * sizeof(float));
+        animation::AppendBytes(out.data, values.data(), values.size() * sizeof(uint16_t));
+    }
+    out.data.shrink_to_fit();
+    return out;
+}
+
+// whether the blocks of a compressed clip lie within its data and agree with its frame and node
+// count, e.g. before trusting a clip read from a cache file
+inline bool ValidateClipBlocks(const uint32_t *blocks, size_t blockCount, const uint8_t *data, size_t size,
+                               unsigned int frameCount, unsigned int nodeCount)
+{
+    if(frameCount == 0)
+        return blockCount == 0;
+    if(blockCount != std::max(1u, (frameCount - 1 + kClipBlockFrames - 1) / kClipBlockFrames))
+        return false;
+    for(size_t b = 0; b < blockCount; b++)
+    {
+        animation::ClipBlock block;
+        if(!animation::ParseClipBlock(data, size, blocks[b], nodeCount, block))
+            return false;
+        unsigned int length = std::min<unsigned int>(kClipBlockFrames, frameCount - 1 - unsigned(b) * kClipBlockFrames);
+        if(block.frames[0] != 0 || block.frames[block.keyCount - 1] != length)
+            return false;
+        for(unsigned int k = 1; k < block.keyCount; k++)
+            if(block.frames[k] <= block.frames[k - 1])
+                return false;
+        // the sections must match the flags
+        size_t constants = 0, ranges = 0, components = 0;
+        for(unsigned int n = 0; n < nodeCount; n++)
+        {
+            uint8_t flags = block.flags[n];
+            constants += (flags & CLIP_ANIMATED_T ? 0 : 3) + (flags & CLIP_ANIMATED_R ? 0 : 4) + (flags & CLIP_ANIMATED_S ? 0 : 3);
+            ranges += (flags & CLIP_ANIMATED_T ? 6 : 0) + (flags & CLIP_ANIMATED_S ? 6 : 0);
+            components += (flags & CLIP_ANIMATED_T ? 3 : 0) + (flags & CLIP_ANIMATED_R ? 3 : 0) + (flags & CLIP_ANIMATED_S ? 3 : 0);
+        }
+        if(components != block.components || block.ranges - block.constants != std::ptrdiff_t(constants) ||
+           reinterpret_cast<const uint8_t*>(block.values) - reinterpret_cast<const uint8_t*>(block.ranges) != std::ptrdiff_t(ranges * sizeof(float)))
+            return false;
+    }
+    return true;
+}
+
+// the pose of a compressed clip at time seconds, like SampleClip of an AnimationClip. Only the two
+// kept keys around time are decoded, both from the same block.
+inline void SampleClip(const CompressedClip &clip, float time, Pose &pose, bool loop = true)
+{
+    pose.resize(clip.nodeCount);
+    if(clip.blocks.empty())
+        return;
+    if(loop && clip.duration > 0.0f)
+    {
+        time = std::fmod(time, clip.duration);
+        if(time < 0.0f)
+            time += clip.duration;
+    }
+    float position = std::min(std::min(std::max(time, 0.0f), clip.duration) * clip.sampleRate, float(clip.frameCount - 1));
+    size_t b = std::min<size_t>(static_cast<size_t>(position / kClipBlockFrames), clip.blocks.size() - 1);
+    animation::ClipBlock block;
+    animation::ParseClipBlock(clip.data.data(), clip.data.size(), clip.blocks[b], clip.nodeCount, block);
+    float local = position - float(b * kClipBlockFrames);
+    unsigned int key = 0;
+    while(key + 2 < block.keyCount && block.frames[key + 1] <= local)
+        key++;
+    unsigned int next = std::min(key + 1, block.keyCount - 1);
+    float alpha = next == key ? 0.0f : (local - block.frames[key]) / float(block.frames[next] - block.frames[key]);
+    animation::DecodeClipKeys(block, key, next, std::min(std::max(alpha, 0.0f), 1.0f), clip.nodeCount, pose);
+    animation::NormalizeRotations(pose.tracks.data(), pose.stride());
+}
+
+// writes a pose into a scene graph, e.g. to play a clip on a Model's own nodes
+inline void ApplyPose(const Pose &pose, SceneGraph &nodes)
+{
+    unsigned int count = std::min<unsigned int>(pose.nodeCount, static_cast<unsigned int>(nodes.size()));
+    for(unsigned int n = 0; n < count; n++)
+        nodes.setLocal(n, pose.translation(n), pose.rotation(n), pose.scale(n));
+}
+
+// what a pose needs to become a bone palette: the bones of a skeleton and the nodes above them,
+// parent before child. Nodes that no bone depends on are skipped.
+class AnimationRig
+{
+public:
+    Pose bindPose; // the nodes' own transforms, for instances without a clip
+
+    AnimationRig() = default;
+    AnimationRig(const SceneGraph &nodes, const Skeleton &skeleton)
+    {
+        vector<char> needed(nodes.size(), 0);
+        for(const Bone &bone : skeleton.bones)
+            for(int n = bone.node; n >= 0 && !needed[n]; n = nodes.parent(n))
+                needed[n] = 1;
+        vector<int> jointOf(nodes.size(), -1);
+        for(unsigned int n = 0; n < nodes.size(); n++)
+        {
+            if(!needed[n])
+                continue;
+            jointOf[n] = static_cast<int>(joints.size());
+            joints.push_back(n);
+            parents.push_back(nodes.parent(n) >= 0 ? jointOf[nodes.parent(n)] : -1);
+        }
+        for(const Bone &bone : skeleton.bones)
+        {
+            boneJoints.push_back(bone.node >= 0 ? jointOf[bone.node] : -1);
+            offsets.push_back(bone.offset);
+        }
+        bindPose.resize(static_cast<unsigned int>(nodes.size()));
+        for(unsigned int n = 0; n < nodes.size(); n++)
+            bindPose.set(n, nodes.translation(n), nodes.rotation(n), nodes.scale(n));
+    }
+
+    size_t boneCount() const { return offsets.size(); }
+    size_t jointCount() const { return joints.size(); }
+
+    // the skinning matrices of pose into palette[0, boneCount()). worlds is scratch.
+    void palette(const Pose &pose, glm::mat4 *palette, vector<glm::mat4> &worlds) const
+    {
+        worlds.resize(joints.size());
+        for(size_t j = 0; j < joints.size(); j++)
+        {
+            unsigned int n = joints[j];
+            glm::mat4 local = ComposeTrs(pose.translation(n), pose.rotation(n), pose.scale(n));
+            if(parents[j] < 0)
+                worlds[j] = local;
+            else
+                animation::MulAffine(worlds[parents[j]], local, worlds[j]);
+        }
+        for(size_t b = 0; b < offsets.size(); b++)
+        {
+            if(boneJoints[b] >= 0)
+                animation::MulAffine(worlds[boneJoints[b]], offsets[b], palette[b]);
+            else
+                palette[b] = glm::mat4(1.0f);
+        }
+    }
+
+private:
+    vector<unsigned int> joints; // scene graph node of every joint
+    vector<int> parents;         // joint index of the parent, -1 for the root
+    vector<int> boneJoints;      // joint of every bone, -1 for bones without a node
+    vector<glm::mat4> offsets;   // inverse bind matrix of every bone
+};
+
+// one animated character: clip at time, optionally blended towards blendClip at blendTime
+struct AnimationInstance {
+    const CompressedClip *clip = nullptr; // nullptr holds the bind pose
+    float time = 0.0f;
+    const CompressedClip *blendClip = nullptr;
+    float blendTime = 0.0f;
+    float blendWeight = 0.0f;            // 0 = only clip, 1 = only blendClip
+};
+
+// the bone palettes of all instances, rig.boneCount() matrices each and back to back. Sampling,
+// blending and the palette of every instance run on the shared thread pool.
+inline void AnimateInstances(const AnimationRig &rig, const vector<AnimationInstance> &instances, vector<glm::mat4> &palettes)
+{
+    size_t bones = rig.boneCount();
+    palettes.resize(instances.size() * bones);
+    SharedThreadPool().parallelFor(instances.size(), kAnimationGrain, [&](size_t begin, size_t end) {
+        // per thread scratch, reused across frames
+        thread_local Pose pose, blend;
+        thread_local vector<glm::mat4> worlds;
+        for(size_t i = begin; i < end; i++)
+        {
+            const AnimationInstance &instance = instances[i];
+            if(instance.clip)
+                SampleClip(*instance.clip, instance.time, pose);
+            else
+                pose = rig.bindPose;
+            if(instance.blendClip && instance.blendWeight > 0.0f)
+            {
+                SampleClip(*instance.blendClip, instance.blendTime, blend);
+                BlendPoses(pose, blend, instance.blendWeight, pose);
+            }
+            rig.palette(pose, palettes.data() + i * bones, worlds);
+        }
+    });
+}
+#endif
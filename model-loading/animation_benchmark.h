@@ -0,0 +1,119 @@
+#ifndef ANIMATION_BENCHMARK_H
+#define ANIMATION_BENCHMARK_H
+
+#include <learnopengl/thread_pool.h>
+
+#include "animation.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+// CPU cost of AnimateInstances for crowds of synthetic skeletons: every instance samples two
+// compressed clips, blends them and builds its palette, which is the worst case a frame can ask
+// for. Also compares the size and sampling cost of the clips before and after compression.
+namespace animation
+{
+    // a clip of smooth random swings around the bind pose of nodes, every node with its own
+    // amplitude, frequency and phase per axis
+    inline AnimationClip RandomClip(const SceneGraph &nodes, float seconds, unsigned int seed)
+    {
+        mt19937 rng(seed);
+        uniform_real_distribution<float> amplitude(0.0f, 0.5f), frequency(0.2f, 2.0f), phase(0.0f, 6.2831853f);
+        vector<glm::vec3> amplitudes(nodes.size()), frequencies(nodes.size()), phases(nodes.size());
+        for(size_t n = 0; n < nodes.size(); n++)
+        {
+            amplitudes[n] = glm::vec3(amplitude(rng), amplitude(rng), amplitude(rng));
+            frequencies[n] = glm::vec3(frequency(rng), frequency(rng), frequency(rng));
+            phases[n] = glm::vec3(phase(rng), phase(rng), phase(rng));
+        }
+        AnimationClip clip;
+        clip.name = "random" + to_string(seed);
+        clip.duration = seconds;
+        clip.frameCount = static_cast<unsigned int>(seconds * clip.sampleRate) + 1;
+        clip.nodeCount = static_cast<unsigned int>(nodes.size());
+        clip.keys.assign(size_t(clip.frameCount) * kTrackCount * clip.stride(), 0.0f);
+        Pose frame;
+        for(unsigned int f = 0; f < clip.frameCount; f++)
+        {
+            frame.resize(clip.nodeCount);
+            float time = f / clip.sampleRate;
+            for(unsigned int n = 0; n < clip.nodeCount; n++)
+            {
+                glm::quat r = glm::quat(amplitudes[n] * glm::sin(frequencies[n] * 6.2831853f * time + phases[n]));
+                frame.set(n, nodes.translation(n), nodes.rotation(n) * r, nodes.scale(n));
+            }
+            std::copy(frame.tracks.begin(), frame.tracks.end(), clip.keys.begin() + size_t(f) * kTrackCount * clip.stride());
+        }
+        return clip;
+    }
+}
+
+inline void RunAnimationBenchmark(const vector<size_t> &boneCounts, const vector<size_t> &instanceCounts, unsigned int frames = 20)
+{
+    for(size_t bones : boneCounts)
+    {
+        // a balanced binary tree of joints, every node is a bone
+        SceneGraph nodes;
+        Skeleton skeleton;
+        for(size_t i = 0; i < bones; i++)
+        {
+            string name = "joint" + to_string(i);
+            nodes.add(name, i == 0 ? -1 : int((i - 1) / 2), ComposeTrs(glm::vec3(0.0f, 0.1f, 0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f)));
+            skeleton.add(name, glm::mat4(1.0f));
+        }
+        skeleton.bind(nodes);
+        AnimationRig rig(nodes, skeleton);
+        AnimationClip rawWalk = animation::RandomClip(nodes, 1.0f, 1), rawRun = animation::RandomClip(nodes, 0.7f, 2);
+        CompressedClip walk = CompressClip(rawWalk), run = CompressClip(rawRun);
+        cout << "ANIMATION::BENCHMARK:: " << bones << " bones, clips compressed to " << (walk.bytes() + run.bytes()) / 1024.0
+             << " KiB from " << (rawWalk.keys.size() + rawRun.keys.size()) * sizeof(float) / 1024.0 << " KiB" << endl;
+        {
+            // one pose at a time, raw keys against decoding the blocks
+            Pose pose;
+            const unsigned int samples = 2000;
+            auto start = chrono::steady_clock::now();
+            for(unsigned int i = 0; i < samples; i++)
+                SampleClip(rawWalk, i * 0.013f, pose);
+            double raw = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / samples;
+            start = chrono::steady_clock::now();
+            for(unsigned int i = 0; i < samples; i++)
+                SampleClip(walk, i * 0.013f, pose);
+            double compressed = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / samples;
+            cout << "ANIMATION::BENCHMARK:: " << bones << " bones, " << raw << " us per sample resampled, "
+                 << compressed << " us per sample compressed" << endl;
+        }
+
+        for(size_t count : instanceCounts)
+        {
+            vector<AnimationInstance> instances(count);
+            for(size_t i = 0; i < count; i++)
+            {
+                instances[i].clip = &walk;
+                instances[i].time = i * 0.37f;
+                instances[i].blendClip = &run;
+                instances[i].blendTime = i * 0.21f;
+                instances[i].blendWeight = 0.5f;
+            }
+            vector<glm::mat4> palettes;
+            AnimateInstances(rig, instances, palettes); // warm up the scratch buffers
+            auto start = chrono::steady_clock::now();
+            for(unsigned int f = 0; f < frames; f++)
+            {
+                for(AnimationInstance &instance : instances)
+                {
+                    instance.time += 1.0f / 60.0f;
+                    instance.blendTime += 1.0f / 60.0f;
+                }
+                AnimateInstances(rig, instances, palettes);
+            }
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frames;
+            cout << "ANIMATION::BENCHMARK:: " << bones << " bones x " << count << " instances: " << ms << " ms per frame, "
+                 << ms * 1e3 / count << " us per instance (" << SharedThreadPool().size() + 1 << " threads)" << endl;
+        }
+    }
+}
+#endif
@@ -7,9 +7,15 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <learnopengl/gl_state.h>
+#include <learnopengl/render_queue.h>
+
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "model_loader.h"
+#include "animation_benchmark.h"
+#include "vertex_layout_benchmark.h"
 
 #include <iostream>
 
@@ -21,6 +27,20 @@ void processInput(GLFWwindow *window);
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// quantized vertex layout (vertex_format.h), flip to compare against the plain Vertex layout
+const bool COMPACT_VERTICES = true;
+// GPU skinning with model-loading-skinned.vs, for models with bones. Takes the plain layout.
+const bool SKINNED_VERTICES = false;
+// textures as layers of texture arrays (texture_array.h): the whole model draws without a texture rebind
+const bool TEXTURE_ARRAYS = true;
+// time AnimateInstances for crowds of synthetic skeletons (animation_benchmark.h) before anything
+// loads, takes seconds
+const bool ANIMATION_BENCHMARK = false;
+// GPU time of a full detail draw in the plain and in the compact vertex layout, before anything
+// else loads. Loads the model twice more.
+const bool VERTEX_LAYOUT_BENCHMARK = false;
+// GL upload time per frame while the model streams in
+const double UPLOAD_BUDGET_MS = 2.0;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -75,16 +95,72 @@ int main()
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    GLState::instance().enable(GL_DEPTH_TEST);
+    // meshlet cone culling drops back faces, let GL drop the rest of them too
+    GLState::instance().enable(GL_CULL_FACE);
 
     // build and compile shaders
     // -------------------------
-    Shader ourShader("/Users/yuelu/develop/Graphics/LearnOpenGl/model-loading/model-loading.vs",
-                     "/Users/yuelu/develop/Graphics/LearnOpenGl/model-loading/model-loading.fs");
+    const char *plainVertexShader = "/Users/yuelu/develop/Graphics/LearnOpenGl/model-loading/model-loading.vs";
+    const char *compactVertexShader = "/Users/yuelu/develop/Graphics/LearnOpenGl/model-loading/model-loading-compact.vs";
+    const char *fragmentShader = TEXTURE_ARRAYS ? "/Users/yuelu/develop/Graphics/LearnOpenGl/model-loading/model-loading-array.fs"
+                                                : "/Users/yuelu/develop/Graphics/LearnOpenGl/model-loading/model-loading.fs";
+    Shader ourShader(SKINNED_VERTICES ? "/Users/yuelu/develop/Graphics/LearnOpenGl/model-loading/model-loading-skinned.vs"
+                     : COMPACT_VERTICES ? compactVertexShader : plainVertexShader,
+                     fragmentShader);
+    const char *modelPath = "/Users/yuelu/develop/Graphics/LearnOpenGl/common/resources/backpack/backpack.obj";
+
+    // synthetic skeletons only, so it runs up front instead of stalling a frame or competing with the loader
+    if(ANIMATION_BENCHMARK)
+        RunAnimationBenchmark({ 32, 64, 128 }, { 100, 1000, 4000 });
 
     // load models
     // -----------
-    Model ourModel("/Users/yuelu/develop/Graphics/LearnOpenGl/common/resources/backpack/backpack.obj");
+    ModelOptions options;
+    options.compactVertices = COMPACT_VERTICES && !SKINNED_VERTICES;
+    options.vertexAttributes = ActiveVertexAttributes(ourShader.ID);
+    options.sharedBuffers = true; // one VAO for the whole model
+    options.textureArrays = TEXTURE_ARRAYS;
+    options.atlas.enabled = true; // small textures share atlas pages, reported as MODEL::ATLAS
+    options.buildMeshlets = true;
+    options.lodErrors = { 0.002f, 0.008f, 0.03f, 0.1f };
+    options.releaseCpuData = true; // nothing here reads the vertices back
+    if(VERTEX_LAYOUT_BENCHMARK)
+    {
+        Shader plainShader(plainVertexShader, fragmentShader), compactShader(compactVertexShader, fragmentShader);
+        RunVertexLayoutBenchmark(modelPath, options, plainShader, compactShader,
+                                 glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f),
+                                 camera.GetViewMatrix());
+        GLState::instance().deleteProgram(plainShader.ID);
+        GLState::instance().deleteProgram(compactShader.ID);
+    }
+    // texture contents stream in through a ring of pixel buffers (texture_stream.h) instead of stalling a frame each
+    TextureCache::instance().streamUploads = true;
+    // loads in the background, the render loop starts right away and the meshes show up as they arrive
+    ModelLoader loader;
+    float loadStart = static_cast<float>(glfwGetTime());
+    float slowestLoadingFrame = 0.0f;
+    bool firstFrame = true;
+    std::shared_ptr<Model> ourModel = loader.load(modelPath, false, options);
+
+    // GPU time of the model draw, reported as vertex fetch throughput once per second. Two queries
+    // take turns: a frame reads the previous frame's one, and only if the GPU already has its result,
+    // so the timing never makes the CPU wait for the GPU. Each query remembers the indices its frame
+    // submitted after lod selection and meshlet culling, those are what the GPU fetched.
+    unsigned int drawQueries[2];
+    glGenQueries(2, drawQueries);
+    bool drawQueryPending[2] = { false, false };
+    size_t drawQueryIndices[2] = { 0, 0 };
+    unsigned int frameIndex = 0;
+    double drawSeconds = 0.0;
+    size_t drawIndices = 0;
+    unsigned int drawSamples = 0;
+    unsigned int reportFrames = 0;
+    float lastReport = 0.0f;
+    // every frame's draws, submitted in sort key order (render_queue.h)
+    RenderQueue renderQueue;
+    // pose of the clip the model plays, if it has any
+    Pose pose;
 
 
     // draw in wireframe
@@ -104,6 +180,35 @@ int main()
         // -----
         processInput(window);
 
+        // stream in whatever the loader has ready
+        if(loader.busy())
+        {
+            if(!firstFrame)
+                slowestLoadingFrame = std::max(slowestLoadingFrame, deltaTime);
+            bool wasReady = ourModel->isReady();
+            loader.update(UPLOAD_BUDGET_MS);
+            if(!wasReady && ourModel->isReady())
+            {
+                std::cout << "model ready after " << (glfwGetTime() - loadStart) * 1e3 << " ms, slowest frame while loading "
+                          << slowestLoadingFrame * 1e3 << " ms" << std::endl;
+                ourModel->printVertexStats();
+                // triangles drawn vs screen space error over a sweep of distances
+                ourModel->printLodChart(glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f), (float)SCR_HEIGHT);
+            }
+            const TextureStreamer *streamer = TextureCache::instance().uploadStreamer();
+            if(!loader.busy() && streamer)
+                std::cout << "textures streamed after " << (glfwGetTime() - loadStart) * 1e3 << " ms: " << streamer->statistics().textures
+                          << " textures, " << streamer->statistics().bytes / 1024 << " KiB in " << streamer->statistics().slotsIssued
+                          << " buffers, slowest update " << streamer->statistics().slowestUpdate << " ms" << std::endl;
+        }
+
+        // play the first clip of animated models, skinned meshes need SKINNED_VERTICES to show it
+        if(ourModel->isReady() && !ourModel->animations.empty())
+        {
+            SampleClip(ourModel->animations[0], currentFrame, pose);
+            ApplyPose(pose, ourModel->nodes);
+        }
+
         // render
         // ------
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
@@ -122,16 +227,87 @@ int main()
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
         model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));	// it's a bit too big for our scene, so scale it down
-        ourShader.setMat4("model", model);
-        ourModel.Draw(ourShader);
+        ourModel->transform = model; // Draw combines it with the node matrix of every mesh
+        unsigned int current = frameIndex & 1, previous = current ^ 1;
+        size_t submittedBefore = ourModel->lodStats.triangles - ourModel->cullStats.frustumRejected - ourModel->cullStats.coneRejected;
+        glBeginQuery(GL_TIME_ELAPSED, drawQueries[current]);
+        LodView lod = MakeLodView(projection, view, model, (float)SCR_HEIGHT);
+        // recorded into the queue, sorted by state and depth, then drawn
+        ourModel->Enqueue(renderQueue, ourShader, view, 0.1f, 100.0f, MakeMeshletCullView(projection, view, model), &lod);
+        renderQueue.sort();
+        renderQueue.submit();
+        glEndQuery(GL_TIME_ELAPSED);
+        drawQueryPending[current] = true;
+        drawQueryIndices[current] = 3 * (ourModel->lodStats.triangles - ourModel->cullStats.frustumRejected
+                                         - ourModel->cullStats.coneRejected - submittedBefore);
+
+        // a result that isn't there yet is dropped, its query is reused next frame
+        if(drawQueryPending[previous])
+        {
+            GLuint available = 0;
+            glGetQueryObjectuiv(drawQueries[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+            if(available)
+            {
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(drawQueries[previous], GL_QUERY_RESULT, &elapsed);
+                drawSeconds += elapsed * 1e-9;
+                drawIndices += drawQueryIndices[previous];
+                drawSamples++;
+            }
+            drawQueryPending[previous] = false;
+        }
+        frameIndex++;
+        reportFrames++;
+        if(currentFrame - lastReport >= 1.0f && drawSeconds > 0.0)
+        {
+            std::cout << "vertex fetch: " << drawIndices / drawSeconds / 1e6 << " M indices/s, "
+                      << drawIndices / drawSamples << " indices and " << drawSeconds / drawSamples * 1e3 << " ms per draw" << std::endl;
+            const MeshletCullStats &cull = ourModel->cullStats;
+            if(cull.triangles > 0 && cull.seconds > 0.0)
+            {
+                size_t rejected = cull.frustumRejected + cull.coneRejected;
+                std::cout << "meshlet culling: " << rejected / (cull.seconds * 1e3) << " triangles rejected per ms, "
+                          << 100.0 * rejected / cull.triangles << "% culled (frustum "
+                          << 100.0 * cull.frustumRejected / cull.triangles << "%, cone "
+                          << 100.0 * cull.coneRejected / cull.triangles << "%)" << std::endl;
+            }
+            ourModel->cullStats = MeshletCullStats();
+            const LodStats &lods = ourModel->lodStats;
+            if(lods.fullTriangles > 0)
+                std::cout << "lod: " << lods.triangles / reportFrames << " triangles per frame, "
+                          << 100.0 * lods.triangles / lods.fullTriangles << "% of full detail" << std::endl;
+            ourModel->lodStats = LodStats();
+            const RenderQueue::Stats &queued = renderQueue.statistics();
+            if(queued.frames > 0)
+                std::cout << "render queue: " << queued.items / queued.frames << " draws per frame, sorted in "
+                          << queued.sortSeconds / queued.frames * 1e6 << " us" << std::endl;
+            renderQueue.resetStatistics();
+            // binds, program switches and enables that reached the driver vs. those the shadow state dropped
+            GLState::instance().report("last second");
+            GLState::instance().resetStatistics();
+            drawSeconds = 0.0;
+            drawIndices = 0;
+            drawSamples = 0;
+            reportFrames = 0;
+            lastReport = currentFrame;
+        }
 
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+        if(firstFrame)
+        {
+            std::cout << "first frame after " << (glfwGetTime() - loadStart) * 1e3 << " ms" << std::endl;
+            firstFrame = false;
+        }
     }
 
+    // the textures have to go while the context is still alive
+    ourModel.reset();
+    glDeleteQueries(2, drawQueries);
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -0,0 +1,70 @@
+#ifndef MAPPED_IO_SYSTEM_H
+#define MAPPED_IO_SYSTEM_H
+
+#include <assimp/IOSystem.hpp>
+#include <assimp/MemoryIOWrapper.h>
+
+#include <learnopengl/mapped_file.h>
+
+#include <sys/stat.h>
+
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+using namespace std;
+
+// assimp file access through read-only mappings instead of DefaultIOSystem's buffered stdio. The
+// model and every side file the importer asks for (.mtl, external buffers, ...) are mmapped and
+// advised sequential, the streams are plain MemoryIOStreams over the mapping: Read is a single
+// memcpy out of the page cache, Seek/Tell are pointer arithmetic and no read syscalls are made.
+// Only reading is supported, Open fails for any write mode. Hand it to Importer::SetIOHandler,
+// which takes ownership.
+class MappedIOSystem : public Assimp::IOSystem
+{
+public:
+    size_t filesOpened = 0;
+    size_t bytesMapped = 0;
+
+    ~MappedIOSystem() override
+    {
+        for(auto &open : files)
+            delete open.first;
+    }
+
+    bool Exists(const char *path) const override
+    {
+        struct stat st;
+        return ::stat(path, &st) == 0 && S_ISREG(st.st_mode);
+    }
+
+    char getOsSeparator() const override { return '/'; }
+
+    Assimp::IOStream *Open(const char *path, const char *mode = "rb") override
+    {
+        if(strchr(mode, 'w') || strchr(mode, 'a') || strchr(mode, '+'))
+            return nullptr;
+        unique_ptr<MappedFile> file(new MappedFile());
+        if(!file->open(path))
+            return nullptr;
+        file->adviseSequential();
+        filesOpened++;
+        bytesMapped += file->size();
+        Assimp::IOStream *stream = new Assimp::MemoryIOStream(file->data(), file->size());
+        files.emplace(stream, std::move(file));
+        return stream;
+    }
+
+    // deletes the stream and unmaps its file
+    void Close(Assimp::IOStream *stream) override
+    {
+        auto found = files.find(stream);
+        if(found == files.end())
+            return;
+        delete stream;
+        files.erase(found);
+    }
+
+private:
+    unordered_map<Assimp::IOStream*, unique_ptr<MappedFile>> files; // open streams and the mapping each reads
+};
+#endif
@@ -12,35 +12,25 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <learnopengl/gl_state.h>
+#include <learnopengl/texture_cache.h>
+
+#include "mesh_lod.h"
+#include "meshlet.h"
 #include "shader.h"
+#include "vertex_format.h"
 
 #include <string>
 #include <vector>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-    //bone indexes which will influence this vertex
-    int m_BoneIDs[MAX_BONE_INFLUENCE];
-    //weights from each bone
-    float m_Weights[MAX_BONE_INFLUENCE];
-};
-
 struct Texture {
     unsigned int id;
     string type;
     string path;
+    TextureHandle handle; // keeps the shared GL texture alive while a mesh uses it
+    unsigned int layer = 0; // in handle's texture array, for ModelOptions::textureArrays
+    glm::vec4 rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f); // uv offset (xy) and scale (zw) into an atlas page, see texture_atlas.h
 };
 
 class Mesh {
@@ -49,30 +39,255 @@ public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    unsigned int VAO = 0;
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    VertexFormat format;
+    VertexLayout layout;
+    vector<MeshLod> lods;     // level 0 is the full mesh, coarser levels follow its indices (see mesh_lod.h)
+    vector<Meshlet> meshlets; // optional, see meshlet.h, only cover level 0
+    glm::vec3 boundsCenter = glm::vec3(0.0f); // bounding sphere, in the space of the mesh's own vertices
+    float boundsRadius = 0.0f;
+    unsigned int node = 0;    // the scene graph node that places the mesh in the model (see scene_graph.h)
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, move the arrays in to avoid copying them. Without upload no GL objects are
+    // created, the mesh is then either uploaded later (see Upload) or drawn from a buffer shared
+    // with other meshes (see ModelBuffer).
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, VertexFormat format = VertexFormat(),
+         bool upload = true)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size(), format, upload);
+    }
+
+    // constructor for data that lives elsewhere (e.g. a mapped mesh cache): the arrays are uploaded
+    // directly from the given pointers and no CPU-side copy is kept in vertices/indices.
+    Mesh(const Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount, vector<Texture> textures,
+         VertexFormat format = VertexFormat(), bool upload = true)
+    {
+        this->textures = std::move(textures);
+        setupMesh(vertices, vertexCount, indices, indexCount, format, upload);
     }
 
+    // a mesh owns its GL objects, so it can be moved but not copied. Must be destroyed on the GL thread
+    // once it has been uploaded.
+    Mesh(const Mesh&) = delete;
+    Mesh &operator=(const Mesh&) = delete;
+    Mesh(Mesh &&other) noexcept
+    {
+        *this = std::move(other);
+    }
+    Mesh &operator=(Mesh &&other) noexcept
+    {
+        if(this == &other)
+            return *this;
+        deleteBuffers();
+        vertices = std::move(other.vertices);
+        indices = std::move(other.indices);
+        textures = std::move(other.textures);
+        vertexCount = other.vertexCount;
+        indexCount = other.indexCount;
+        indexType = other.indexType;
+        format = other.format;
+        layout = other.layout;
+        lods = std::move(other.lods);
+        meshlets = std::move(other.meshlets);
+        boundsCenter = other.boundsCenter;
+        boundsRadius = other.boundsRadius;
+        node = other.node;
+        VAO = other.VAO;
+        VBO = other.VBO;
+        EBO = other.EBO;
+        vertexBufferSize = other.vertexBufferSize;
+        indexBufferSize = other.indexBufferSize;
+        other.VAO = other.VBO = other.EBO = 0;
+        other.vertexBufferSize = other.indexBufferSize = 0;
+        return *this;
+    }
+    ~Mesh()
+    {
+        deleteBuffers();
+    }
+
+    // frees vertices/indices, e.g. once the mesh is uploaded. Bounds, levels of detail and meshlets
+    // stay, they are all culling and LOD selection needs.
+    void ReleaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+    // RAM held by the CPU-side copy of the arrays
+    size_t cpuBytes() const { return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int); }
+
+    // creates the VAO/VBO/EBO from the given arrays, for meshes constructed without upload. Must run
+    // on the GL thread, the arrays only have to stay valid for the duration of the call.
+    void Upload(const Vertex *vertexData, const unsigned int *indexData)
+    {
+        deleteBuffers();
+        // create buffers/arrays
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        GLState::instance().bindVertexArray(VAO);
+        // load data into vertex buffers
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        if(layout.compact)
+        {
+            vector<unsigned char> packed = PackVertices(vertexData, vertexCount, layout);
+            vertexBufferSize = packed.size();
+            glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+        }
+        else
+        {
+            // A great thing about structs is that their memory layout is sequential for all its items.
+            // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+            // again translates to 3/2 floats which translates to a byte array.
+            vertexBufferSize = vertexCount * sizeof(Vertex);
+            glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, vertexData, GL_STATIC_DRAW);
+        }
+
+        GLState::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if(layout.compact && IndexSize(vertexCount) == sizeof(uint16_t))
+        {
+            // small meshes get 16 bit indices
+            vector<unsigned char> packed = PackIndices(indexData, indexCount, vertexCount);
+            indexType = GL_UNSIGNED_SHORT;
+            indexBufferSize = packed.size();
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+        }
+        else
+        {
+            indexType = GL_UNSIGNED_INT;
+            indexBufferSize = indexCount * sizeof(unsigned int);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, indexData, GL_STATIC_DRAW);
+        }
+
+        // set the vertex attribute pointers
+        SetVertexAttributes(layout);
+        GLState::instance().bindVertexArray(0);
+    }
+
+    // GPU memory of the vertex and index buffers
+    size_t vertexBytes() const { return vertexBufferSize; }
+    size_t indexBytes() const { return indexBufferSize; }
+
     // render the mesh
     void Draw(Shader &shader)
+    {
+        BindTextures(shader);
+
+        // compact positions are stored relative to the mesh bounds
+        if(layout.compact)
+        {
+            shader.setVec3("positionOffset", layout.positionOffset);
+            shader.setVec3("positionScale", layout.positionScale);
+        }
+
+        // draw mesh
+        // the VAO and textures stay bound, the next mesh only pays for what differs (see gl_state.h)
+        GLState::instance().bindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(lods[0].indexCount), indexType, 0);
+    }
+
+    // render one level of detail, level 0 only the meshlets that survive frustum and cone culling.
+    // Without meshlets the whole level is drawn.
+    void Draw(Shader &shader, const MeshletCullView &cull, MeshletCullStats &stats, unsigned int level = 0)
+    {
+        if(level > 0 || meshlets.empty())
+        {
+            DrawLod(shader, level);
+            return;
+        }
+        visibleRanges.clear();
+        CullMeshlets(meshlets, cull, visibleRanges, stats);
+        if(visibleRanges.empty())
+            return;
+
+        BindTextures(shader);
+        if(layout.compact)
+        {
+            shader.setVec3("positionOffset", layout.positionOffset);
+            shader.setVec3("positionScale", layout.positionScale);
+        }
+
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+        counts.clear();
+        offsets.clear();
+        for(const IndexRange &range : visibleRanges)
+        {
+            counts.push_back(static_cast<GLsizei>(range.count));
+            offsets.push_back(reinterpret_cast<const void*>(range.first * indexSize));
+        }
+        GLState::instance().bindVertexArray(VAO);
+        glMultiDrawElements(GL_TRIANGLES, counts.data(), indexType, offsets.data(), static_cast<GLsizei>(counts.size()));
+    }
+
+    // render all of the given level of detail
+    void DrawLod(Shader &shader, unsigned int level)
+    {
+        BindTextures(shader);
+        if(layout.compact)
+        {
+            shader.setVec3("positionOffset", layout.positionOffset);
+            shader.setVec3("positionScale", layout.positionScale);
+        }
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+        GLState::instance().bindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(lods[level].indexCount), indexType,
+                       reinterpret_cast<const void*>(lods[level].firstIndex * indexSize));
+    }
+
+    // level of detail to draw for the given view
+    unsigned int SelectLod(const LodView &view) const
+    {
+        return ::SelectLod(lods, boundsCenter, boundsRadius, view);
+    }
+
+    // layer of the first texture of each type in its texture array: diffuse, specular, normal, height
+    glm::vec4 TextureLayers() const
+    {
+        static const char *const types[4] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+        glm::vec4 layers(0.0f);
+        bool found[4] = {};
+        for(const Texture &texture : textures)
+            for(int t = 0; t < 4; t++)
+                if(!found[t] && texture.type == types[t])
+                {
+                    layers[t] = static_cast<float>(texture.layer);
+                    found[t] = true;
+                }
+        return layers;
+    }
+
+    // binds the mesh textures to consecutive units and points the matching samplers at them.
+    // Texture arrays go to the <type>_array samplers, their layers to kTextureLayersLocation.
+    // Every sampler gets its atlas rectangle in <sampler>_rect.
+    void BindTextures(Shader &shader)
     {
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
+        bool arrays = false;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+            const glm::vec4 &rect = textures[i].rect;
+            if(textures[i].handle && textures[i].handle->layers > 0)
+            {
+                glUniform1i(glGetUniformLocation(shader.ID, (textures[i].type + "_array").c_str()), i);
+                glUniform4f(glGetUniformLocation(shader.ID, (textures[i].type + "_array_rect").c_str()), rect.x, rect.y, rect.z, rect.w);
+                GLState::instance().bindTexture(i, GL_TEXTURE_2D_ARRAY, textures[i].id);
+                arrays = true;
+                continue;
+            }
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -87,66 +302,80 @@ public:
 
             // now set the sampler to the correct texture unit
             glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            glUniform4f(glGetUniformLocation(shader.ID, (name + number + "_rect").c_str()), rect.x, rect.y, rect.z, rect.w);
+            // and finally bind the texture, the unit only becomes active if it changes
+            GLState::instance().bindTexture(i, GL_TEXTURE_2D, textures[i].id);
+        }
+        if(arrays)
+        {
+            glm::vec4 layers = TextureLayers();
+            glVertexAttrib4f(kTextureLayersLocation, layers.x, layers.y, layers.z, layers.w);
         }
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    // true if both meshes bind exactly the same textures. Meshes in the same texture arrays do,
+    // whatever their layers.
+    bool SharesTextures(const Mesh &other) const
+    {
+        if(textures.size() != other.textures.size())
+            return false;
+        for(size_t i = 0; i < textures.size(); i++)
+            if(textures[i].id != other.textures[i].id || textures[i].type != other.textures[i].type || textures[i].rect != other.textures[i].rect)
+                return false;
+        return true;
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // equal for meshes that share textures (see SharesTextures), the material field of a render queue key
+    uint64_t MaterialKey() const
+    {
+        uint64_t key = textures.size();
+        for(const Texture &texture : textures)
+            key = HashBytes(&texture.rect, sizeof(texture.rect), HashCombine(key, texture.id));
+        return key;
     }
 
 private:
     // render data
-    unsigned int VBO, EBO;
+    unsigned int VBO = 0, EBO = 0;
+    size_t vertexBufferSize = 0;
+    size_t indexBufferSize = 0;
+    // per frame scratch for the meshlet draw
+    vector<IndexRange> visibleRanges;
+    vector<GLsizei> counts;
+    vector<const void*> offsets;
 
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    void deleteBuffers()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        // nothing to do for meshes that were never uploaded or have been moved from
+        if(VAO)
+            GLState::instance().deleteVertexArrays(1, &VAO);
+        if(VBO)
+            GLState::instance().deleteBuffers(1, &VBO);
+        if(EBO)
+            GLState::instance().deleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+    }
 
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-        // ids
-        glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-        // weights
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+    // initializes all the buffer objects/arrays
+    void setupMesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount,
+                   const VertexFormat &format, bool upload)
+    {
+        this->vertexCount = static_cast<unsigned int>(vertexCount);
+        this->indexCount = static_cast<unsigned int>(indexCount);
+        this->format = format;
+        layout = MakeVertexLayout(format, vertexData, vertexCount);
+        lods.assign(1, MeshLod{ 0, this->indexCount, 0.0f });
+        glm::vec3 lo(0.0f), hi(0.0f);
+        if(vertexCount > 0)
+        {
+            lo = hi = vertexData[0].Position;
+            ExpandBounds(vertexData, vertexCount, lo, hi);
+        }
+        boundsCenter = (lo + hi) * 0.5f;
+        boundsRadius = glm::length(hi - lo) * 0.5f;
+        indexType = GL_UNSIGNED_INT;
+        if(upload)
+            Upload(vertexData, indexData);
     }
 };
 #endif
@@ -0,0 +1,458 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/content_hash.h>
+#include <learnopengl/mapped_file.h>
+
+#include "animation.h"
+#include "mesh.h"
+#include "scene_graph.h"
+#include "skeleton.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Binary snapshot of everything Model builds out of an assimp import: the final Vertex and index
+// arrays of every mesh, the material texture references, the node hierarchy, the bones and the
+// compressed animation clips. On a warm start the file is mmapped and the arrays are uploaded
+// straight from the mapping, so assimp never runs.
+//
+// file layout, every blob starts on a 16 byte boundary:
+//   MeshCacheHeader
+//   MeshCacheMesh[meshCount]
+//   MeshCacheTexture[textureCount]
+//   MeshCacheLod[lodCount]
+//   MeshCacheNode[nodeCount], breadth first like SceneGraph
+//   MeshCacheBone[boneCount]
+//   MeshCacheAnimation[animationCount]
+//   string bytes (texture types and paths, node, bone and clip names)
+//   vertex/index blobs
+//   animation block offsets and block data, see CompressedClip
+//
+// bump kMeshCacheVersion whenever the layout or the meaning of the stored data changes,
+// older files are then treated as a miss and silently rewritten.
+const uint32_t kMeshCacheMagic   = 0x4d474f4c; // "LOGM"
+const uint32_t kMeshCacheVersion = 8;
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;           // hash of source bytes + version + import flags + vertex layout
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t vertexStride;  // sizeof(Vertex) of the writer, guards against struct changes
+    uint32_t lodCount;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint32_t nodeCount;
+    uint32_t boneCount;
+    uint32_t animationCount;
+    uint32_t reserved;
+};
+
+struct MeshCacheMesh {
+    uint64_t vertexOffset;
+    uint64_t vertexCount;
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    uint32_t firstTexture;
+    uint32_t textureCount;
+    uint32_t attributes;    // VertexAttribute bits the source mesh provides
+    uint32_t firstLod;
+    uint32_t lodCount;      // levels of detail, their indices are part of the mesh's index blob
+    uint32_t node;          // the node that places the mesh
+};
+
+struct MeshCacheTexture {
+    uint32_t typeOffset;
+    uint32_t typeLength;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+};
+
+struct MeshCacheLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+    uint32_t reserved;
+};
+
+struct MeshCacheNode {
+    int32_t parent;         // -1 for the root, otherwise an earlier node
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t reserved;
+    float local[16];        // column major, relative to the parent
+};
+
+struct MeshCacheBone {
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    int32_t node;           // -1 for bones without a node
+    uint32_t reserved;
+    float offset[16];       // column major
+};
+
+struct MeshCacheAnimation {
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t frameCount;
+    uint32_t nodeCount;
+    float duration;
+    float sampleRate;
+    uint32_t blockCount;
+    uint32_t reserved;
+    uint64_t blocksOffset;  // blockCount uint32 offsets into the block data
+    uint64_t dataOffset;
+    uint64_t dataSize;
+};
+
+// the cache sits right next to the model, e.g. backpack.obj -> backpack.obj.meshcache
+inline string MeshCachePath(const string &modelPath)
+{
+    return modelPath + ".meshcache";
+}
+
+// everything that changes the imported result has to end up in the key: importFlags are the assimp
+// post-processing steps, pipelineFlags the options of our own processing passes
+inline uint64_t MeshCacheKey(const MappedFile &source, unsigned int importFlags, uint64_t pipelineFlags)
+{
+    uint64_t key = HashBytes(source.data(), source.size());
+    key = HashCombine(key, kMeshCacheVersion);
+    key = HashCombine(key, importFlags);
+    key = HashCombine(key, pipelineFlags);
+    key = HashCombine(key, sizeof(Vertex));
+    return key;
+}
+
+// read side: maps the file, validates it against the expected key and hands out pointers into the mapping
+class MeshCacheReader
+{
+public:
+    bool open(const string &cachePath, uint64_t expectedKey)
+    {
+        if(!file.open(cachePath))
+            return false;
+        if(file.size() < sizeof(MeshCacheHeader))
+            return fail();
+        header = reinterpret_cast<const MeshCacheHeader*>(file.data());
+        if(header->magic != kMeshCacheMagic || header->version != kMeshCacheVersion ||
+           header->key != expectedKey || header->vertexStride != sizeof(Vertex))
+            return fail();
+
+        uint64_t tablesEnd = sizeof(MeshCacheHeader) + header->meshCount * sizeof(MeshCacheMesh)
+                           + header->textureCount * sizeof(MeshCacheTexture) + header->lodCount * sizeof(MeshCacheLod)
+                           + header->nodeCount * sizeof(MeshCacheNode) + header->boneCount * sizeof(MeshCacheBone)
+                           + header->animationCount * sizeof(MeshCacheAnimation);
+        if(tablesEnd > file.size() || header->stringsOffset + header->stringsSize > file.size())
+            return fail();
+        meshTable = reinterpret_cast<const MeshCacheMesh*>(file.data() + sizeof(MeshCacheHeader));
+        textureTable = reinterpret_cast<const MeshCacheTexture*>(meshTable + header->meshCount);
+        lodTable = reinterpret_cast<const MeshCacheLod*>(textureTable + header->textureCount);
+        nodeTable = reinterpret_cast<const MeshCacheNode*>(lodTable + header->lodCount);
+        boneTable = reinterpret_cast<const MeshCacheBone*>(nodeTable + header->nodeCount);
+        animationTable = reinterpret_cast<const MeshCacheAnimation*>(boneTable + header->boneCount);
+
+        // a truncated write must never be mistaken for a valid cache
+        for(uint32_t i = 0; i < header->meshCount; i++)
+        {
+            const MeshCacheMesh &m = meshTable[i];
+            if(m.vertexOffset + m.vertexCount * sizeof(Vertex) > file.size() ||
+               m.indexOffset + m.indexCount * sizeof(unsigned int) > file.size() ||
+               uint64_t(m.firstTexture) + m.textureCount > header->textureCount ||
+               uint64_t(m.firstLod) + m.lodCount > header->lodCount || m.node >= std::max<uint32_t>(header->nodeCount, 1))
+                return fail();
+            for(uint32_t j = 0; j < m.lodCount; j++)
+                if(uint64_t(lodTable[m.firstLod + j].firstIndex) + lodTable[m.firstLod + j].indexCount > m.indexCount)
+                    return fail();
+        }
+        // SceneGraph::add relies on the breadth first order
+        vector<uint32_t> depths(header->nodeCount);
+        for(uint32_t i = 0; i < header->nodeCount; i++)
+        {
+            const MeshCacheNode &n = nodeTable[i];
+            if(n.parent < -1 || n.parent >= int32_t(i) || uint64_t(n.nameOffset) + n.nameLength > header->stringsSize)
+                return fail();
+            depths[i] = n.parent < 0 ? 0 : depths[n.parent] + 1;
+            if(i > 0 && depths[i] < depths[i - 1])
+                return fail();
+        }
+        for(uint32_t i = 0; i < header->boneCount; i++)
+        {
+            const MeshCacheBone &b = boneTable[i];
+            if(b.node < -1 || b.node >= int32_t(header->nodeCount) || uint64_t(b.nameOffset) + b.nameLength > header->stringsSize)
+                return fail();
+        }
+        for(uint32_t i = 0; i < header->animationCount; i++)
+        {
+            const MeshCacheAnimation &a = animationTable[i];
+            if(a.nodeCount != header->nodeCount || uint64_t(a.nameOffset) + a.nameLength > header->stringsSize ||
+               a.blocksOffset + uint64_t(a.blockCount) * sizeof(uint32_t) > file.size() || a.dataOffset + a.dataSize > file.size() ||
+               a.blocksOffset % 16 != 0 || a.dataOffset % 16 != 0 ||
+               !ValidateClipBlocks(reinterpret_cast<const uint32_t*>(file.data() + a.blocksOffset), a.blockCount,
+                                   file.data() + a.dataOffset, a.dataSize, a.frameCount, a.nodeCount))
+                return fail();
+        }
+        return true;
+    }
+
+    unsigned int meshCount() const { return header->meshCount; }
+    const MeshCacheMesh &mesh(unsigned int i) const { return meshTable[i]; }
+
+    const Vertex *vertices(unsigned int i) const
+    {
+        return reinterpret_cast<const Vertex*>(file.data() + meshTable[i].vertexOffset);
+    }
+    const unsigned int *indices(unsigned int i) const
+    {
+        return reinterpret_cast<const unsigned int*>(file.data() + meshTable[i].indexOffset);
+    }
+
+    // the level of detail chain of mesh i, empty for caches of meshes without one
+    vector<MeshLod> lods(unsigned int i) const
+    {
+        vector<MeshLod> result;
+        for(uint32_t j = 0; j < meshTable[i].lodCount; j++)
+        {
+            const MeshCacheLod &lod = lodTable[meshTable[i].firstLod + j];
+            result.push_back({ lod.firstIndex, lod.indexCount, lod.error });
+        }
+        return result;
+    }
+
+    // the node hierarchy, an empty graph for models without one
+    void nodes(SceneGraph &graph) const
+    {
+        graph = SceneGraph();
+        const char *strings = reinterpret_cast<const char*>(file.data() + header->stringsOffset);
+        for(uint32_t i = 0; i < header->nodeCount; i++)
+        {
+            const MeshCacheNode &n = nodeTable[i];
+            glm::mat4 local;
+            memcpy(&local[0][0], n.local, sizeof(n.local));
+            graph.add(string(strings + n.nameOffset, n.nameLength), n.parent, local);
+        }
+    }
+
+    // the bones the vertices' bone ids refer to, in id order
+    void skeleton(Skeleton &skeleton) const
+    {
+        skeleton = Skeleton();
+        const char *strings = reinterpret_cast<const char*>(file.data() + header->stringsOffset);
+        for(uint32_t i = 0; i < header->boneCount; i++)
+        {
+            const MeshCacheBone &b = boneTable[i];
+            glm::mat4 offset;
+            memcpy(&offset[0][0], b.offset, sizeof(b.offset));
+            skeleton.add(string(strings + b.nameOffset, b.nameLength), offset);
+            skeleton.bones.back().node = b.node;
+        }
+    }
+
+    // the compressed animation clips, their blocks are copied out of the mapping
+    vector<CompressedClip> animations() const
+    {
+        vector<CompressedClip> clips(header->animationCount);
+        const char *strings = reinterpret_cast<const char*>(file.data() + header->stringsOffset);
+        for(uint32_t i = 0; i < header->animationCount; i++)
+        {
+            const MeshCacheAnimation &a = animationTable[i];
+            CompressedClip &clip = clips[i];
+            clip.name.assign(strings + a.nameOffset, a.nameLength);
+            clip.duration = a.duration;
+            clip.sampleRate = a.sampleRate;
+            clip.frameCount = a.frameCount;
+            clip.nodeCount = a.nodeCount;
+            const uint32_t *blocks = reinterpret_cast<const uint32_t*>(file.data() + a.blocksOffset);
+            clip.blocks.assign(blocks, blocks + a.blockCount);
+            clip.data.assign(file.data() + a.dataOffset, file.data() + a.dataOffset + a.dataSize);
+        }
+        return clips;
+    }
+
+    // texture j of mesh i, returns the type ("texture_diffuse", ...) and the path relative to the model
+    void texture(unsigned int i, unsigned int j, string &type, string &path) const
+    {
+        const MeshCacheTexture &t = textureTable[meshTable[i].firstTexture + j];
+        const char *strings = reinterpret_cast<const char*>(file.data() + header->stringsOffset);
+        type.assign(strings + t.typeOffset, t.typeLength);
+        path.assign(strings + t.pathOffset, t.pathLength);
+    }
+
+private:
+    MappedFile file;
+    const MeshCacheHeader  *header = nullptr;
+    const MeshCacheMesh    *meshTable = nullptr;
+    const MeshCacheTexture *textureTable = nullptr;
+    const MeshCacheLod     *lodTable = nullptr;
+    const MeshCacheNode    *nodeTable = nullptr;
+    const MeshCacheBone    *boneTable = nullptr;
+    const MeshCacheAnimation *animationTable = nullptr;
+
+    bool fail()
+    {
+        file.close();
+        header = nullptr;
+        return false;
+    }
+};
+
+// write side: serializes the meshes, nodes, bones and clips of a freshly imported model. Writes to a temporary file first
+// and renames it into place so a crash mid-write can't leave a half written cache behind.
+inline bool WriteMeshCache(const string &cachePath, uint64_t key, const vector<Mesh> &meshes, const SceneGraph &nodes,
+                           const Skeleton &skeleton, const vector<CompressedClip> &animations)
+{
+    auto align16 = [](uint64_t offset) { return (offset + 15) & ~uint64_t(15); };
+
+    vector<MeshCacheMesh> meshTable(meshes.size());
+    vector<MeshCacheTexture> textureTable;
+    vector<MeshCacheLod> lodTable;
+    string strings;
+    for(size_t i = 0; i < meshes.size(); i++)
+    {
+        meshTable[i].firstTexture = static_cast<uint32_t>(textureTable.size());
+        meshTable[i].textureCount = static_cast<uint32_t>(meshes[i].textures.size());
+        meshTable[i].attributes = meshes[i].format.available;
+        meshTable[i].firstLod = static_cast<uint32_t>(lodTable.size());
+        meshTable[i].lodCount = static_cast<uint32_t>(meshes[i].lods.size());
+        meshTable[i].node = meshes[i].node;
+        for(const MeshLod &lod : meshes[i].lods)
+            lodTable.push_back({ lod.firstIndex, lod.indexCount, lod.error, 0 });
+        for(const Texture &texture : meshes[i].textures)
+        {
+            MeshCacheTexture t;
+            t.typeOffset = static_cast<uint32_t>(strings.size());
+            t.typeLength = static_cast<uint32_t>(texture.type.size());
+            strings += texture.type;
+            t.pathOffset = static_cast<uint32_t>(strings.size());
+            t.pathLength = static_cast<uint32_t>(texture.path.size());
+            strings += texture.path;
+            textureTable.push_back(t);
+        }
+    }
+    vector<MeshCacheNode> nodeTable(nodes.size());
+    for(unsigned int i = 0; i < nodes.size(); i++)
+    {
+        MeshCacheNode &n = nodeTable[i];
+        n.parent = nodes.parent(i);
+        n.nameOffset = static_cast<uint32_t>(strings.size());
+        n.nameLength = static_cast<uint32_t>(nodes.name(i).size());
+        n.reserved = 0;
+        memcpy(n.local, &nodes.local(i)[0][0], sizeof(n.local));
+        strings += nodes.name(i);
+    }
+    vector<MeshCacheBone> boneTable(skeleton.bones.size());
+    for(size_t i = 0; i < skeleton.bones.size(); i++)
+    {
+        const Bone &bone = skeleton.bones[i];
+        MeshCacheBone &b = boneTable[i];
+        b.nameOffset = static_cast<uint32_t>(strings.size());
+        b.nameLength = static_cast<uint32_t>(bone.name.size());
+        b.node = bone.node;
+        b.reserved = 0;
+        memcpy(b.offset, &bone.offset[0][0], sizeof(b.offset));
+        strings += bone.name;
+    }
+    vector<MeshCacheAnimation> animationTable(animations.size());
+    for(size_t i = 0; i < animations.size(); i++)
+    {
+        const CompressedClip &clip = animations[i];
+        MeshCacheAnimation &a = animationTable[i];
+        a.nameOffset = static_cast<uint32_t>(strings.size());
+        a.nameLength = static_cast<uint32_t>(clip.name.size());
+        a.frameCount = clip.frameCount;
+        a.nodeCount = clip.nodeCount;
+        a.duration = clip.duration;
+        a.sampleRate = clip.sampleRate;
+        a.blockCount = static_cast<uint32_t>(clip.blocks.size());
+        a.reserved = 0;
+        strings += clip.name;
+    }
+
+    MeshCacheHeader header = {};
+    header.magic = kMeshCacheMagic;
+    header.version = kMeshCacheVersion;
+    header.key = key;
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    header.textureCount = static_cast<uint32_t>(textureTable.size());
+    header.vertexStride = sizeof(Vertex);
+    header.lodCount = static_cast<uint32_t>(lodTable.size());
+    header.nodeCount = static_cast<uint32_t>(nodeTable.size());
+    header.boneCount = static_cast<uint32_t>(boneTable.size());
+    header.animationCount = static_cast<uint32_t>(animationTable.size());
+    header.stringsOffset = sizeof(MeshCacheHeader) + meshTable.size() * sizeof(MeshCacheMesh)
+                         + textureTable.size() * sizeof(MeshCacheTexture) + lodTable.size() * sizeof(MeshCacheLod)
+                         + nodeTable.size() * sizeof(MeshCacheNode) + boneTable.size() * sizeof(MeshCacheBone)
+                         + animationTable.size() * sizeof(MeshCacheAnimation);
+    header.stringsSize = strings.size();
+
+    uint64_t offset = align16(header.stringsOffset + header.stringsSize);
+    for(size_t i = 0; i < meshes.size(); i++)
+    {
+        meshTable[i].vertexOffset = offset;
+        meshTable[i].vertexCount = meshes[i].vertices.size();
+        offset = align16(offset + meshTable[i].vertexCount * sizeof(Vertex));
+        meshTable[i].indexOffset = offset;
+        meshTable[i].indexCount = meshes[i].indices.size();
+        offset = align16(offset + meshTable[i].indexCount * sizeof(unsigned int));
+    }
+    for(size_t i = 0; i < animations.size(); i++)
+    {
+        animationTable[i].blocksOffset = offset;
+        offset = align16(offset + animations[i].blocks.size() * sizeof(uint32_t));
+        animationTable[i].dataOffset = offset;
+        animationTable[i].dataSize = animations[i].data.size();
+        offset = align16(offset + animations[i].data.size());
+    }
+
+    string tmpPath = cachePath + ".tmp";
+    ofstream out(tmpPath, ios::binary | ios::trunc);
+    if(!out)
+        return false;
+    uint64_t written = 0;
+    auto write = [&](const void *data, uint64_t size) {
+        out.write(static_cast<const char*>(data), static_cast<streamsize>(size));
+        written += size;
+    };
+    auto pad = [&](uint64_t target) {
+        static const char zeros[16] = {};
+        write(zeros, target - written);
+    };
+
+    write(&header, sizeof(header));
+    write(meshTable.data(), meshTable.size() * sizeof(MeshCacheMesh));
+    write(textureTable.data(), textureTable.size() * sizeof(MeshCacheTexture));
+    write(lodTable.data(), lodTable.size() * sizeof(MeshCacheLod));
+    write(nodeTable.data(), nodeTable.size() * sizeof(MeshCacheNode));
+    write(boneTable.data(), boneTable.size() * sizeof(MeshCacheBone));
+    write(animationTable.data(), animationTable.size() * sizeof(MeshCacheAnimation));
+    write(strings.data(), strings.size());
+    for(size_t i = 0; i < meshes.size(); i++)
+    {
+        pad(meshTable[i].vertexOffset);
+        write(meshes[i].vertices.data(), meshTable[i].vertexCount * sizeof(Vertex));
+        pad(meshTable[i].indexOffset);
+        write(meshes[i].indices.data(), meshTable[i].indexCount * sizeof(unsigned int));
+    }
+    for(size_t i = 0; i < animations.size(); i++)
+    {
+        pad(animationTable[i].blocksOffset);
+        write(animations[i].blocks.data(), animations[i].blocks.size() * sizeof(uint32_t));
+        pad(animationTable[i].dataOffset);
+        write(animations[i].data.data(), animations[i].data.size());
+    }
+    out.close();
+    if(!out)
+    {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return std::rename(tmpPath.c_str(), cachePath.c_str()) == 0;
+}
+#endif
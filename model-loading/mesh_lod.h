@@ -0,0 +1,362 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/content_hash.h>
+
+#include "mesh_optimizer.h"
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Level of detail chain of a mesh. Every level is a separate index buffer over the same vertices,
+// all levels are appended to the mesh's index array so one VBO/EBO serves the whole chain.
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error; // geometric deviation from the full mesh, in model units
+};
+
+// where the model is looked at from, in the model space of the meshes (see MakeLodView)
+struct LodView {
+    glm::vec3 cameraPosition;
+    float pixelsPerUnit;   // screen pixels covered by one unit at distance 1
+    float maxPixelError;   // coarsest level whose error projects to at most this many pixels wins
+};
+
+// triangles submitted by Model::Draw next to what the full meshes would have cost
+struct LodStats {
+    size_t triangles = 0;
+    size_t fullTriangles = 0;
+};
+
+// the projection's vertical scale turns a distance into pixels, with the viewport height in pixels
+inline LodView MakeLodView(const glm::mat4 &projection, const glm::mat4 &view, const glm::mat4 &model, float viewportHeight,
+                           float maxPixelError = 1.0f)
+{
+    LodView lod;
+    lod.cameraPosition = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    lod.pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+    lod.maxPixelError = maxPixelError;
+    return lod;
+}
+
+// the same view in the space of a mesh that matrix places in the model. Errors and distances
+// scale alike, so only the camera moves (exact for uniform scale).
+inline LodView TransformLodView(const LodView &lod, const glm::mat4 &matrix)
+{
+    LodView result = lod;
+    result.cameraPosition = glm::vec3(glm::inverse(matrix) * glm::vec4(lod.cameraPosition, 1.0f));
+    return result;
+}
+
+// the index of the coarsest level that still looks like the full mesh from the lod view. The
+// distance is taken to the closest point of the bounding sphere, so a camera inside it always
+// gets the full mesh.
+inline unsigned int SelectLod(const vector<MeshLod> &lods, glm::vec3 center, float radius, const LodView &view)
+{
+    float distance = glm::length(center - view.cameraPosition) - radius;
+    if(distance <= 0.0f)
+        return 0;
+    unsigned int level = 0;
+    for(unsigned int i = 1; i < lods.size(); i++)
+        if(lods[i].error * view.pixelsPerUnit / distance <= view.maxPixelError)
+            level = i;
+    return level;
+}
+
+namespace simplify
+{
+    // plane quadric, symmetric 4x4 matrix stored as its upper triangle plus the accumulated area weight
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+        double a11 = 0, a12 = 0, a13 = 0;
+        double a22 = 0, a23 = 0;
+        double a33 = 0;
+        double weight = 0;
+
+        void addPlane(glm::dvec3 n, double d, double w)
+        {
+            a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+            a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+            a22 += w * n.z * n.z; a23 += w * n.z * d;
+            a33 += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric &q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+            a11 += q.a11; a12 += q.a12; a13 += q.a13;
+            a22 += q.a22; a23 += q.a23;
+            a33 += q.a33;
+            weight += q.weight;
+        }
+
+        // area weighted mean squared distance of p to the accumulated planes
+        double error(glm::vec3 p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                     + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                     + a22 * z * z + 2 * a23 * z
+                     + a33;
+            return weight > 0 ? std::max(e, 0.0) / weight : 0.0;
+        }
+    };
+
+    struct Collapse {
+        unsigned int from, to;
+        double cost;
+    };
+
+    inline glm::vec3 triangleNormal(glm::vec3 a, glm::vec3 b, glm::vec3 c)
+    {
+        return glm::cross(b - a, c - a);
+    }
+}
+
+// Quadric error simplification (Garland & Heckbert) by half edge collapses: a vertex is only ever
+// merged into one of its neighbours, so the result indexes the original vertex array and can share
+// its vertex buffer. Vertices on open borders and on attribute seams (several vertices at one
+// position) are never removed, which keeps silhouettes and uv charts intact at the price of a
+// lower reduction on heavily seamed meshes.
+//
+// Collapses are applied cheapest first until the next one would move the surface by more than
+// targetError (model units). Returns the new index buffer, the error actually reached goes to resultError.
+inline vector<unsigned int> SimplifyMesh(const Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount,
+                                         float targetError, float *resultError = nullptr)
+{
+    using namespace simplify;
+    vector<unsigned int> result(indices, indices + indexCount);
+    if(resultError)
+        *resultError = 0.0f;
+    if(indexCount < 3 || vertexCount == 0)
+        return result;
+
+    // 1. vertices at bit-identical positions form one group, the first of them represents it
+    vector<unsigned int> group(vertexCount);
+    vector<unsigned int> groupSize(vertexCount, 0);
+    {
+        unordered_map<uint64_t, vector<unsigned int>> byPosition;
+        byPosition.reserve(vertexCount);
+        for(unsigned int v = 0; v < vertexCount; v++)
+        {
+            vector<unsigned int> &bucket = byPosition[HashBytes(&vertices[v].Position, sizeof(glm::vec3))];
+            group[v] = v;
+            for(unsigned int other : bucket)
+            {
+                if(memcmp(&vertices[other].Position, &vertices[v].Position, sizeof(glm::vec3)) == 0)
+                {
+                    group[v] = other;
+                    break;
+                }
+            }
+            if(group[v] == v)
+                bucket.push_back(v);
+            groupSize[group[v]]++;
+        }
+    }
+
+    // 2. lock seams and borders. An edge is a border if only one triangle uses it, counted on the
+    //    position groups so seams don't look like holes.
+    vector<char> locked(vertexCount, 0);
+    for(unsigned int v = 0; v < vertexCount; v++)
+        locked[v] = groupSize[group[v]] > 1;
+    {
+        unordered_map<uint64_t, unsigned int> edgeUse;
+        edgeUse.reserve(indexCount);
+        auto edgeKey = [&](unsigned int a, unsigned int b) {
+            a = group[a];
+            b = group[b];
+            return a < b ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+        };
+        for(size_t i = 0; i < indexCount; i += 3)
+            for(int k = 0; k < 3; k++)
+                edgeUse[edgeKey(indices[i + k], indices[i + (k + 1) % 3])]++;
+        for(size_t i = 0; i < indexCount; i += 3)
+        {
+            for(int k = 0; k < 3; k++)
+            {
+                unsigned int a = indices[i + k], b = indices[i + (k + 1) % 3];
+                if(edgeUse[edgeKey(a, b)] == 1)
+                    locked[a] = locked[b] = 1;
+            }
+        }
+    }
+
+    // 3. one quadric per position group from the planes of the adjacent triangles
+    vector<Quadric> quadrics(vertexCount);
+    for(size_t i = 0; i < indexCount; i += 3)
+    {
+        glm::vec3 p0 = vertices[indices[i]].Position, p1 = vertices[indices[i + 1]].Position, p2 = vertices[indices[i + 2]].Position;
+        glm::dvec3 n = glm::dvec3(triangleNormal(p0, p1, p2));
+        double area = glm::length(n);
+        if(area <= 0.0)
+            continue;
+        n /= area;
+        double d = -glm::dot(n, glm::dvec3(p0));
+        for(int k = 0; k < 3; k++)
+            quadrics[group[indices[i + k]]].addPlane(n, d, area);
+    }
+
+    // 4. passes of independent collapses: every pass sorts all candidate edges by cost and applies
+    //    the cheapest ones whose neighbourhoods don't overlap, then the triangles are rewritten
+    double limit = double(targetError) * targetError;
+    double reached = 0.0;
+    vector<unsigned int> triangleStart(vertexCount + 1), vertexTriangles;
+    vector<char> touched(vertexCount);
+    vector<unsigned int> collapseTo(vertexCount);
+    vector<Collapse> candidates;
+    vector<double> bestCost(vertexCount);
+    vector<unsigned int> bestTarget(vertexCount);
+    for(int pass = 0; pass < 64; pass++)
+    {
+        size_t triangleCount = result.size() / 3;
+
+        // vertex -> triangle adjacency of the current triangles
+        std::fill(triangleStart.begin(), triangleStart.end(), 0);
+        for(unsigned int index : result)
+            triangleStart[index + 1]++;
+        for(size_t v = 0; v < vertexCount; v++)
+            triangleStart[v + 1] += triangleStart[v];
+        vertexTriangles.resize(result.size());
+        {
+            vector<unsigned int> fill(triangleStart.begin(), triangleStart.end() - 1);
+            for(size_t i = 0; i < result.size(); i++)
+                vertexTriangles[fill[result[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+
+        // the cheapest collapse of every vertex, the others have to wait for a later pass
+        std::fill(bestCost.begin(), bestCost.end(), -1.0);
+        for(size_t t = 0; t < triangleCount; t++)
+        {
+            for(int k = 0; k < 3; k++)
+            {
+                unsigned int a = result[t * 3 + k], b = result[t * 3 + (k + 1) % 3];
+                for(int direction = 0; direction < 2; direction++)
+                {
+                    if(!locked[a] && group[a] != group[b])
+                    {
+                        Quadric q = quadrics[group[a]];
+                        q.add(quadrics[group[b]]);
+                        double cost = q.error(vertices[b].Position);
+                        if(cost <= limit && (bestCost[a] < 0.0 || cost < bestCost[a]))
+                        {
+                            bestCost[a] = cost;
+                            bestTarget[a] = b;
+                        }
+                    }
+                    std::swap(a, b);
+                }
+            }
+        }
+        candidates.clear();
+        for(unsigned int v = 0; v < vertexCount; v++)
+            if(bestCost[v] >= 0.0)
+                candidates.push_back({ v, bestTarget[v], bestCost[v] });
+        if(candidates.empty())
+            break;
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse &x, const Collapse &y) { return x.cost < y.cost; });
+
+        std::fill(touched.begin(), touched.end(), 0);
+        for(unsigned int v = 0; v < vertexCount; v++)
+            collapseTo[v] = v;
+        size_t collapses = 0;
+        for(const Collapse &c : candidates)
+        {
+            if(touched[group[c.from]] || touched[group[c.to]])
+                continue;
+
+            // moving 'from' onto 'to' must not flip any triangle that survives the collapse
+            bool flips = false;
+            glm::vec3 target = vertices[c.to].Position;
+            for(unsigned int k = triangleStart[c.from]; k < triangleStart[c.from + 1] && !flips; k++)
+            {
+                const unsigned int *tri = &result[vertexTriangles[k] * 3];
+                if(group[tri[0]] == group[c.to] || group[tri[1]] == group[c.to] || group[tri[2]] == group[c.to])
+                    continue; // degenerates and disappears
+                glm::vec3 p[3], q[3];
+                for(int j = 0; j < 3; j++)
+                {
+                    p[j] = vertices[tri[j]].Position;
+                    q[j] = tri[j] == c.from ? target : p[j];
+                }
+                glm::vec3 before = triangleNormal(p[0], p[1], p[2]);
+                glm::vec3 after = triangleNormal(q[0], q[1], q[2]);
+                flips = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+            }
+            if(flips)
+                continue;
+
+            collapseTo[c.from] = c.to;
+            quadrics[group[c.to]].add(quadrics[group[c.from]]);
+            reached = std::max(reached, c.cost);
+            collapses++;
+            // the whole one-ring is off limits for the rest of the pass, its quadrics and positions are stale
+            for(unsigned int k = triangleStart[c.from]; k < triangleStart[c.from + 1]; k++)
+                for(int j = 0; j < 3; j++)
+                    touched[group[result[vertexTriangles[k] * 3 + j]]] = 1;
+        }
+        if(collapses == 0)
+            break;
+
+        // rewrite the triangles, dropping the ones that became degenerate
+        size_t write = 0;
+        for(size_t t = 0; t < triangleCount; t++)
+        {
+            unsigned int a = collapseTo[result[t * 3]], b = collapseTo[result[t * 3 + 1]], c = collapseTo[result[t * 3 + 2]];
+            if(group[a] == group[b] || group[b] == group[c] || group[a] == group[c])
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if(resultError)
+        *resultError = static_cast<float>(std::sqrt(reached));
+    return result;
+}
+
+// Builds a LOD chain for a mesh. Every entry of relativeErrors is a target error relative to the
+// mesh's bounding radius, ascending. Each level is simplified from the previous one, which is a lot
+// cheaper than starting over from the full mesh every time; its error is then reported as the sum of
+// both steps, a conservative bound. The simplified index buffers are appended to indices, cache optimized.
+// Levels that don't save at least 15% of the triangles of the previous level are skipped.
+// Returns the chain, level 0 being the full mesh.
+inline vector<MeshLod> BuildLods(const vector<Vertex> &vertices, vector<unsigned int> &indices, const vector<float> &relativeErrors)
+{
+    vector<MeshLod> lods = { { 0, static_cast<unsigned int>(indices.size()), 0.0f } };
+    if(vertices.empty() || indices.empty())
+        return lods;
+
+    glm::vec3 lo = vertices[0].Position, hi = lo;
+    ExpandBounds(vertices.data(), vertices.size(), lo, hi);
+    float radius = glm::length(hi - lo) * 0.5f;
+
+    vector<unsigned int> previous = indices;
+    for(float relativeError : relativeErrors)
+    {
+        float budget = relativeError * radius - lods.back().error;
+        if(budget <= 0.0f)
+            continue;
+        float error = 0.0f;
+        vector<unsigned int> lod = SimplifyMesh(vertices.data(), vertices.size(), previous.data(), previous.size(), budget, &error);
+        if(lod.empty() || lod.size() > lods.back().indexCount * 0.85)
+            continue;
+        lod = OptimizeVertexCache(lod.data(), lod.size(), vertices.size());
+        lods.push_back({ static_cast<unsigned int>(indices.size()), static_cast<unsigned int>(lod.size()), lods.back().error + error });
+        indices.insert(indices.end(), lod.begin(), lod.end());
+        previous.swap(lod);
+    }
+    return lods;
+}
+#endif
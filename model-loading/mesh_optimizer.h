@@ -0,0 +1,295 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+using namespace std;
+
+// Triangle and vertex reordering for the GPU, run once between import and Mesh construction:
+//   1. OptimizeVertexCache  - Forsyth's linear-speed vertex cache optimisation
+//   2. OptimizeOverdraw     - splits the result into clusters at cache flush points and sorts them
+//                             so outward facing clusters come first (Sander et al, "Tipsify")
+//   3. OptimizeVertexFetch  - renumbers vertices in first-use order so fetches walk memory linearly
+// The mesh cache stores the optimized arrays, so the cost is paid once per asset.
+
+// post-transform cache efficiency of an index buffer, measured on a FIFO cache
+struct VertexCacheStats {
+    float acmr = 0.0f; // average cache miss ratio: transformed vertices per triangle, 0.5 is the ideal for big grids, 3 the worst
+    float atvr = 0.0f; // average transform to vertex ratio: transformed vertices per referenced vertex, 1 is ideal
+};
+
+inline VertexCacheStats AnalyzeVertexCache(const unsigned int *indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = 16)
+{
+    VertexCacheStats stats;
+    if(indexCount < 3)
+        return stats;
+
+    // timestamp of the last load into the cache, FIFO semantics: hits don't refresh the entry
+    vector<size_t> loadedAt(vertexCount, 0);
+    vector<bool> referenced(vertexCount, false);
+    size_t misses = 0, uniqueVertices = 0;
+    for(size_t i = 0; i < indexCount; i++)
+    {
+        unsigned int v = indices[i];
+        if(loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize)
+        {
+            misses++;
+            loadedAt[v] = misses;
+        }
+        if(!referenced[v])
+        {
+            referenced[v] = true;
+            uniqueVertices++;
+        }
+    }
+    stats.acmr = float(misses) / float(indexCount / 3);
+    stats.atvr = float(misses) / float(std::max<size_t>(uniqueVertices, 1));
+    return stats;
+}
+
+// Forsyth's scoring, see https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+namespace forsyth
+{
+    const int kCacheSize = 32;
+    const float kCacheDecayPower = 1.5f;
+    const float kLastTriScore = 0.75f;
+    const float kValenceBoostScale = 2.0f;
+    const float kValenceBoostPower = 0.5f;
+
+    inline float vertexScore(int cachePosition, unsigned int remainingValence)
+    {
+        if(remainingValence == 0)
+            return -1.0f; // no triangle needs this vertex anymore
+        float score = 0.0f;
+        if(cachePosition >= 0)
+        {
+            if(cachePosition < 3)
+                score = kLastTriScore; // the last triangle's vertices get a fixed score so they aren't favoured unduly
+            else
+                score = std::pow(1.0f - float(cachePosition - 3) / float(kCacheSize - 3), kCacheDecayPower);
+        }
+        // boost vertices with few triangles left so stragglers get finished off
+        score += kValenceBoostScale * std::pow(float(remainingValence), -kValenceBoostPower);
+        return score;
+    }
+}
+
+inline vector<unsigned int> OptimizeVertexCache(const unsigned int *indices, size_t indexCount, size_t vertexCount)
+{
+    using namespace forsyth;
+    size_t triangleCount = indexCount / 3;
+    vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+    if(triangleCount == 0)
+        return result;
+
+    // vertex -> triangle adjacency in CSR form
+    vector<unsigned int> valence(vertexCount, 0);
+    for(size_t i = 0; i < triangleCount * 3; i++)
+        valence[indices[i]]++;
+    vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+    for(size_t v = 0; v < vertexCount; v++)
+        adjacencyStart[v + 1] = adjacencyStart[v] + valence[v];
+    vector<unsigned int> adjacency(triangleCount * 3);
+    vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for(size_t t = 0; t < triangleCount; t++)
+        for(int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+
+    vector<float> vertexScores(vertexCount);
+    for(size_t v = 0; v < vertexCount; v++)
+        vertexScores[v] = vertexScore(-1, valence[v]);
+
+    vector<bool> emitted(triangleCount, false);
+
+    // remaining triangles of each vertex are the first valence[v] entries of its adjacency range
+    vector<unsigned int> cache, nextCache;
+    cache.reserve(kCacheSize + 3);
+    nextCache.reserve(kCacheSize + 3);
+
+    size_t scanCursor = 0;
+    long bestTriangle = -1;
+    for(size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+    {
+        if(bestTriangle < 0)
+        {
+            // nothing in the cache is useful, continue with the first triangle not emitted yet.
+            // Searching all remaining triangles for the best score would be quadratic on meshes
+            // made of many disconnected pieces, the cursor keeps this linear overall.
+            while(emitted[scanCursor])
+                scanCursor++;
+            bestTriangle = static_cast<long>(scanCursor);
+        }
+
+        size_t t = static_cast<size_t>(bestTriangle);
+        emitted[t] = true;
+        const unsigned int *tri = indices + t * 3;
+        result.insert(result.end(), tri, tri + 3);
+
+        // drop the triangle from the remaining lists of its vertices
+        for(int k = 0; k < 3; k++)
+        {
+            unsigned int v = tri[k];
+            unsigned int *begin = adjacency.data() + adjacencyStart[v];
+            unsigned int *end = begin + valence[v];
+            unsigned int *it = std::find(begin, end, static_cast<unsigned int>(t));
+            std::swap(*it, *(end - 1));
+            valence[v]--;
+        }
+
+        // LRU: the triangle's vertices move to the front
+        nextCache.assign(tri, tri + 3);
+        for(unsigned int v : cache)
+            if(v != tri[0] && v != tri[1] && v != tri[2])
+                nextCache.push_back(v);
+        for(size_t i = kCacheSize; i < nextCache.size(); i++)
+            vertexScores[nextCache[i]] = vertexScore(-1, valence[nextCache[i]]); // evicted
+        nextCache.resize(std::min<size_t>(nextCache.size(), kCacheSize));
+        cache.swap(nextCache);
+
+        for(size_t i = 0; i < cache.size(); i++)
+            vertexScores[cache[i]] = vertexScore(static_cast<int>(i), valence[cache[i]]);
+
+        // rescore the triangles touching the cache and pick the best one for the next round
+        bestTriangle = -1;
+        float bestScore = -1e30f;
+        for(unsigned int v : cache)
+        {
+            for(unsigned int a = 0; a < valence[v]; a++)
+            {
+                unsigned int other = adjacency[adjacencyStart[v] + a];
+                const unsigned int *o = indices + other * 3;
+                float score = vertexScores[o[0]] + vertexScores[o[1]] + vertexScores[o[2]];
+                if(score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = other;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+// Reorders clusters of an already cache optimized index buffer to reduce overdraw. Cluster
+// boundaries are placed where the FIFO cache simulation misses on all three vertices of a triangle,
+// so reordering whole clusters barely costs any cache efficiency. Clusters are then sorted so the
+// ones facing away from the mesh centre are drawn first, those tend to occlude the rest.
+// If the result would degrade ACMR by more than threshold the input order is kept.
+inline vector<unsigned int> OptimizeOverdraw(const unsigned int *indices, size_t indexCount, const Vertex *vertices, size_t vertexCount,
+                                            float threshold = 1.05f, unsigned int cacheSize = 16)
+{
+    size_t triangleCount = indexCount / 3;
+    vector<unsigned int> input(indices, indices + triangleCount * 3);
+    if(triangleCount < 2)
+        return input;
+
+    // cluster boundaries
+    vector<size_t> clusterStart;
+    vector<size_t> loadedAt(vertexCount, 0);
+    size_t misses = 0;
+    for(size_t t = 0; t < triangleCount; t++)
+    {
+        int triangleMisses = 0;
+        for(int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if(loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize)
+            {
+                misses++;
+                loadedAt[v] = misses;
+                triangleMisses++;
+            }
+        }
+        if(t == 0 || triangleMisses == 3)
+            clusterStart.push_back(t);
+    }
+    clusterStart.push_back(triangleCount);
+    size_t clusterCount = clusterStart.size() - 1;
+    if(clusterCount < 2)
+        return input;
+
+    // mesh centroid, area weighted
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    vector<glm::vec3> clusterCentroid(clusterCount, glm::vec3(0.0f));
+    vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+    for(size_t c = 0; c < clusterCount; c++)
+    {
+        float clusterArea = 0.0f;
+        for(size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+        {
+            glm::vec3 p0 = vertices[indices[t * 3]].Position;
+            glm::vec3 p1 = vertices[indices[t * 3 + 1]].Position;
+            glm::vec3 p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0); // length is twice the area
+            float area = glm::length(n) * 0.5f;
+            glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+            clusterCentroid[c] += centroid * area;
+            clusterNormal[c] += n;
+            clusterArea += area;
+        }
+        meshCentroid += clusterCentroid[c];
+        meshArea += clusterArea;
+        clusterCentroid[c] = clusterArea > 0.0f ? clusterCentroid[c] / clusterArea : vertices[indices[clusterStart[c] * 3]].Position;
+        float length = glm::length(clusterNormal[c]);
+        clusterNormal[c] = length > 0.0f ? clusterNormal[c] / length : glm::vec3(0.0f);
+    }
+    if(meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    vector<float> sortKey(clusterCount);
+    for(size_t c = 0; c < clusterCount; c++)
+        sortKey[c] = glm::dot(clusterCentroid[c] - meshCentroid, clusterNormal[c]);
+    vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    vector<unsigned int> result;
+    result.reserve(input.size());
+    for(size_t c : order)
+        result.insert(result.end(), indices + clusterStart[c] * 3, indices + clusterStart[c + 1] * 3);
+
+    float before = AnalyzeVertexCache(input.data(), input.size(), vertexCount, cacheSize).acmr;
+    float after = AnalyzeVertexCache(result.data(), result.size(), vertexCount, cacheSize).acmr;
+    return after <= before * threshold ? result : input;
+}
+
+// renumbers vertices in the order the index buffer first touches them and drops unreferenced ones
+inline void OptimizeVertexFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+    const unsigned int unused = ~0u;
+    vector<unsigned int> remap(vertices.size(), unused);
+    vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+    for(unsigned int &index : indices)
+    {
+        if(remap[index] == unused)
+        {
+            remap[index] = static_cast<unsigned int>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+// full pass over one mesh, returns the cache stats before and after
+inline void OptimizeMesh(vector<Vertex> &vertices, vector<unsigned int> &indices, VertexCacheStats *before = nullptr, VertexCacheStats *after = nullptr)
+{
+    if(before)
+        *before = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    indices = OptimizeVertexCache(indices.data(), indices.size(), vertices.size());
+    indices = OptimizeOverdraw(indices.data(), indices.size(), vertices.data(), vertices.size());
+    OptimizeVertexFetch(vertices, indices);
+    if(after)
+        *after = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+}
+#endif
@@ -0,0 +1,221 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glm/glm.hpp>
+
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+// Splits a mesh into small clusters of triangles (meshlets) that are culled on the CPU before
+// drawing. Every meshlet carries a bounding sphere for frustum culling and a normal cone: if the
+// camera sits inside the "back side" of the cone every triangle of the meshlet faces away from it
+// and the whole meshlet can be skipped.
+//
+// Meshlets are built by scanning the index buffer in order, so each one is a contiguous triangle
+// range of the existing index buffer. That relies on the triangle order having good locality,
+// which OptimizeMesh (mesh_optimizer.h) provides. Visible meshlets are drawn straight out of the
+// mesh's EBO, no indices are copied per frame.
+const size_t kMeshletMaxVertices  = 64;
+const size_t kMeshletMaxTriangles = 124;
+
+struct Meshlet {
+    glm::vec3 center;      // bounding sphere, model space
+    float radius;
+    glm::vec3 coneAxis;    // average facing direction of the triangles
+    float coneCutoff;      // sine of the cone's half angle, 1 disables cone culling
+    unsigned int firstTriangle;
+    unsigned int triangleCount;
+    unsigned int vertexCount;
+};
+
+// everything the culling test needs, in the model space of the meshes
+struct MeshletCullView {
+    glm::vec4 planes[6];   // normalized, pointing inwards
+    glm::vec3 cameraPosition;
+};
+
+// triangles looked at and rejected by CullMeshlets, plus the CPU time it took
+struct MeshletCullStats {
+    size_t triangles = 0;
+    size_t frustumRejected = 0;
+    size_t coneRejected = 0;
+    double seconds = 0.0;
+};
+
+// a run of indices [first, first + count) of a mesh's index buffer
+struct IndexRange {
+    unsigned int first;
+    unsigned int count;
+};
+
+inline vector<Meshlet> BuildMeshlets(const Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount,
+                                     size_t maxVertices = kMeshletMaxVertices, size_t maxTriangles = kMeshletMaxTriangles)
+{
+    vector<Meshlet> meshlets;
+    size_t triangleCount = indexCount / 3;
+    if(triangleCount == 0)
+        return meshlets;
+
+    // stamp[v] == meshlets.size() + 1 marks v as already part of the meshlet being built
+    vector<unsigned int> stamp(vertexCount, 0);
+    vector<unsigned int> meshletVertices;
+    meshletVertices.reserve(maxVertices);
+
+    auto finish = [&](size_t firstTriangle, size_t endTriangle) {
+        Meshlet m;
+        m.firstTriangle = static_cast<unsigned int>(firstTriangle);
+        m.triangleCount = static_cast<unsigned int>(endTriangle - firstTriangle);
+        m.vertexCount = static_cast<unsigned int>(meshletVertices.size());
+
+        // bounding sphere around the box center, cheap and good enough for the sizes involved
+        glm::vec3 lo = vertices[meshletVertices[0]].Position, hi = lo;
+        for(unsigned int v : meshletVertices)
+        {
+            lo = glm::min(lo, vertices[v].Position);
+            hi = glm::max(hi, vertices[v].Position);
+        }
+        m.center = (lo + hi) * 0.5f;
+        float radiusSquared = 0.0f;
+        for(unsigned int v : meshletVertices)
+        {
+            glm::vec3 d = vertices[v].Position - m.center;
+            radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+        }
+        m.radius = std::sqrt(radiusSquared);
+
+        // normal cone from the geometric triangle normals (counter-clockwise is front facing)
+        vector<glm::vec3> normals;
+        normals.reserve(m.triangleCount);
+        glm::vec3 sum(0.0f);
+        for(size_t t = firstTriangle; t < endTriangle; t++)
+        {
+            const glm::vec3 &a = vertices[indices[t * 3 + 0]].Position;
+            const glm::vec3 &b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &c = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float length = glm::length(n);
+            if(length <= 0.0f)
+                continue; // degenerate triangles never show up anyway
+            normals.push_back(n / length);
+            sum += n / length;
+        }
+        m.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+        m.coneCutoff = 1.0f;
+        float sumLength = glm::length(sum);
+        if(!normals.empty() && sumLength > 1e-6f)
+        {
+            m.coneAxis = sum / sumLength;
+            float minDot = 1.0f;
+            for(const glm::vec3 &n : normals)
+                minDot = std::min(minDot, glm::dot(n, m.coneAxis));
+            // a cone wider than a hemisphere always has a triangle facing the camera
+            if(minDot > 0.0f)
+                m.coneCutoff = std::sqrt(std::max(0.0f, 1.0f - minDot * minDot));
+        }
+        meshlets.push_back(m);
+        meshletVertices.clear();
+    };
+
+    size_t firstTriangle = 0;
+    for(size_t t = 0; t < triangleCount; t++)
+    {
+        unsigned int mark = static_cast<unsigned int>(meshlets.size()) + 1;
+        size_t newVertices = 0;
+        for(int k = 0; k < 3; k++)
+            newVertices += stamp[indices[t * 3 + k]] != mark;
+        // a shared corner is counted twice here, which only closes a meshlet a triangle early
+        if(meshletVertices.size() + newVertices > maxVertices || t - firstTriangle >= maxTriangles)
+        {
+            finish(firstTriangle, t);
+            firstTriangle = t;
+            mark++;
+        }
+        for(int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if(stamp[v] != mark)
+            {
+                stamp[v] = mark;
+                meshletVertices.push_back(v);
+            }
+        }
+    }
+    finish(firstTriangle, triangleCount);
+    return meshlets;
+}
+
+// frustum planes and camera position moved into the model space of the meshes
+inline MeshletCullView MakeMeshletCullView(const glm::mat4 &projection, const glm::mat4 &view, const glm::mat4 &model)
+{
+    MeshletCullView cull;
+    glm::mat4 m = projection * view * model;
+    glm::vec4 row[4];
+    for(int i = 0; i < 4; i++)
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    for(int i = 0; i < 3; i++)
+    {
+        cull.planes[i * 2 + 0] = row[3] + row[i];
+        cull.planes[i * 2 + 1] = row[3] - row[i];
+    }
+    for(glm::vec4 &plane : cull.planes)
+        plane /= glm::length(glm::vec3(plane));
+    cull.cameraPosition = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    return cull;
+}
+
+// the same view in the space of a mesh that matrix places in the model (see SceneGraph). A plane
+// moves with the transpose, the camera with the inverse. Under non-uniform scale the cone test
+// becomes approximate.
+inline MeshletCullView TransformCullView(const MeshletCullView &cull, const glm::mat4 &matrix)
+{
+    MeshletCullView result;
+    glm::mat4 transposed = glm::transpose(matrix);
+    for(int i = 0; i < 6; i++)
+    {
+        result.planes[i] = transposed * cull.planes[i];
+        result.planes[i] /= glm::length(glm::vec3(result.planes[i]));
+    }
+    result.cameraPosition = glm::vec3(glm::inverse(matrix) * glm::vec4(cull.cameraPosition, 1.0f));
+    return result;
+}
+
+// appends the index ranges of the visible meshlets to ranges, neighbouring visible meshlets are
+// merged into one range
+inline void CullMeshlets(const vector<Meshlet> &meshlets, const MeshletCullView &cull, vector<IndexRange> &ranges, MeshletCullStats &stats)
+{
+    auto start = chrono::steady_clock::now();
+    for(const Meshlet &m : meshlets)
+    {
+        stats.triangles += m.triangleCount;
+
+        bool outside = false;
+        for(const glm::vec4 &plane : cull.planes)
+            outside |= glm::dot(glm::vec3(plane), m.center) + plane.w < -m.radius;
+        if(outside)
+        {
+            stats.frustumRejected += m.triangleCount;
+            continue;
+        }
+
+        // every point p of the sphere has to see the cone from behind: dot(p - camera, axis) >= cutoff * |p - camera|
+        glm::vec3 toCenter = m.center - cull.cameraPosition;
+        if(glm::dot(toCenter, m.coneAxis) - m.radius >= m.coneCutoff * (glm::length(toCenter) + m.radius))
+        {
+            stats.coneRejected += m.triangleCount;
+            continue;
+        }
+
+        unsigned int first = m.firstTriangle * 3;
+        if(!ranges.empty() && ranges.back().first + ranges.back().count == first)
+            ranges.back().count += m.triangleCount * 3;
+        else
+            ranges.push_back({ first, m.triangleCount * 3 });
+    }
+    stats.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+#endif
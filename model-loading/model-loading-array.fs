@@ -0,0 +1,16 @@
+#version 330 core
+// model-loading.fs for ModelOptions::textureArrays, see texture_array.h
+out vec4 FragColor;
+
+in vec2 TexCoords;
+flat in vec4 TextureLayers; // diffuse, specular, normal, height
+
+uniform sampler2DArray texture_diffuse_array;
+uniform vec4 texture_diffuse_array_rect; // atlas rectangle, see model-loading.fs
+
+void main()
+{
+    vec4 rect = texture_diffuse_array_rect;
+    vec2 uv = rect.xy + rect.zw * fract(TexCoords);
+    FragColor = textureGrad(texture_diffuse_array, vec3(uv, TextureLayers.x), dFdx(TexCoords) * rect.zw, dFdy(TexCoords) * rect.zw);
+}
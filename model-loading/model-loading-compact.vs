@@ -0,0 +1,33 @@
+#version 330 core
+// quantized vertex layout, see vertex_format.h
+layout (location = 0) in vec3 aPos;       // unorm16, relative to the mesh bounds
+layout (location = 1) in vec2 aNormal;    // snorm16 octahedral
+layout (location = 2) in vec2 aTexCoords; // half float
+layout (location = 7) in vec4 aTextureLayers; // texture array layers, see kTextureLayersLocation
+
+out vec2 TexCoords;
+flat out vec4 TextureLayers;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// normal = octDecode(aNormal), for lit variants of this shader
+vec3 octDecode(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0)
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(v);
+}
+
+void main()
+{
+    vec3 position = positionOffset + aPos * positionScale;
+    TexCoords = aTexCoords;
+    TextureLayers = aTextureLayers;
+    gl_Position = projection * view * model * vec4(position, 1.0);
+}
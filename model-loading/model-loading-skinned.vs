@@ -0,0 +1,37 @@
+#version 330 core
+// model-loading.vs with GPU skinning, see skeleton.h
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in ivec4 aBoneIds;
+layout (location = 6) in vec4 aWeights;
+layout (location = 7) in vec4 aTextureLayers; // texture array layers, see kTextureLayersLocation
+
+out vec2 TexCoords;
+flat out vec4 TextureLayers;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// kMaxBones in skeleton.h
+const int MAX_BONES = 128;
+
+// skinning matrices of the current pose, bind pose -> model space
+layout (std140) uniform BonePalette
+{
+    mat4 bones[MAX_BONES];
+};
+
+void main()
+{
+    // vertices without bones (all weights zero) stay where they are
+    float total = aWeights.x + aWeights.y + aWeights.z + aWeights.w;
+    mat4 skin = mat4(1.0);
+    if (total > 0.0)
+        skin = (bones[aBoneIds.x] * aWeights.x + bones[aBoneIds.y] * aWeights.y +
+                bones[aBoneIds.z] * aWeights.z + bones[aBoneIds.w] * aWeights.w) / total;
+    TexCoords = aTexCoords;
+    TextureLayers = aTextureLayers;
+    gl_Position = projection * view * model * skin * vec4(aPos, 1.0);
+}
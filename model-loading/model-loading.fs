@@ -4,9 +4,16 @@ out vec4 FragColor;
 in vec2 TexCoords;
 
 uniform sampler2D texture_diffuse1;
+uniform vec4 texture_diffuse1_rect; // uv offset and scale into an atlas page, (0, 0, 1, 1) for a texture of its own
 
-void main()
+// the texture coordinates wrap inside the rectangle, the gradients come from the unwrapped ones so
+// the wrap doesn't drop to the coarsest mip level
+vec4 sampleRect(sampler2D tex, vec4 rect, vec2 uv)
 {
-    FragColor = texture(texture_diffuse1, TexCoords);
+    return textureGrad(tex, rect.xy + rect.zw * fract(uv), dFdx(uv) * rect.zw, dFdy(uv) * rect.zw);
 }
 
+void main()
+{
+    FragColor = sampleRect(texture_diffuse1, texture_diffuse1_rect, TexCoords);
+}
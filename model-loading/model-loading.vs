@@ -2,8 +2,10 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in vec4 aTextureLayers; // texture array layers, see kTextureLayersLocation
 
 out vec2 TexCoords;
+flat out vec4 TextureLayers;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -12,6 +14,7 @@ uniform mat4 projection;
 void main()
 {
     TexCoords = aTexCoords;
+    TextureLayers = aTextureLayers;
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
 
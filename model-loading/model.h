@@ -9,6 +9,10 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <std_image.h>
 #include <glad/glad.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/texture_array.h>
+#include <learnopengl/texture_atlas.h>
+#include <learnopengl/texture_cache.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -16,138 +20,879 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "animation.h"
+#include "mapped_io_system.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_lod.h"
+#include "mesh_optimizer.h"
+#include "meshlet.h"
+#include "model_buffer.h"
+#include "scene_graph.h"
+#include "skeleton.h"
+#include "vertex_convert.h"
+#include "vertex_weld.h"
 #include "shader.h"
 
 #include <string>
+#include <cfloat>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <set>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+// post-processing requested from assimp, also part of the mesh cache key
+const unsigned int kModelImportFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+// knobs of the import pipeline
+struct ModelOptions
+{
+    // read/write a binary snapshot of the imported meshes next to the model file (see mesh_cache.h)
+    bool useMeshCache = true;
+    // upload meshes in the quantized layout of vertex_format.h, needs model-loading-compact.vs
+    bool compactVertices = false;
+    // attributes the shader reads (see ActiveVertexAttributes), the compact layout drops the rest
+    unsigned int vertexAttributes = kAllVertexAttributes;
+    // merge duplicate vertices before anything else looks at the mesh (see vertex_weld.h)
+    WeldOptions weld;
+    // reorder triangles and vertices for the post-transform cache, overdraw and fetch locality (see mesh_optimizer.h)
+    bool optimizeMeshes = true;
+    // pack all meshes into one vertex/index buffer and draw them with (multi-)draw base vertex calls
+    bool sharedBuffers = false;
+    // split meshes into meshlets that Draw(shader, cull) culls against the frustum and by facing (see meshlet.h).
+    // Cone culling drops back faces, so it is only correct for models that are fine with GL_CULL_FACE.
+    bool buildMeshlets = false;
+    // target errors of the generated levels of detail, relative to each mesh's bounding radius (see mesh_lod.h).
+    // Empty means no levels of detail, Draw(shader, cull, &lod) then always draws the full meshes.
+    vector<float> lodErrors;
+    // free every mesh's vertices/indices once they are on the GPU. Off by default, the tutorials
+    // expect Mesh::vertices to be there.
+    bool releaseCpuData = false;
+    // error budget of the keyframe compression every imported animation clip goes through (see CompressClip)
+    ClipCompression animationCompression;
+    // pack the textures into GL_TEXTURE_2D_ARRAY layers by size, format and mip count (see texture_array.h),
+    // needs model-loading-array.fs. With sharedBuffers the meshes then batch across different textures.
+    bool textureArrays = false;
+    // pack small textures into shared atlas pages (see texture_atlas.h), cached next to the model file
+    AtlasOptions atlas;
+};
 
 class Model
 {
 public:
     // model data
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
+    ModelBuffer     sharedBuffer; // only used with ModelOptions::sharedBuffers
     string directory;
     bool gammaCorrection;
+    ModelOptions options;
+    MeshletCullStats cullStats; // accumulated by Draw(shader, cull), reset it whenever it's been reported
+    LodStats lodStats;          // accumulated by Draw(shader, cull, &lod), same
+    SceneGraph nodes;           // the node hierarchy, move nodes with nodes.setLocal and Draw picks it up
+    Skeleton skeleton;          // bones of skinned meshes, posed by their nodes (see skeleton.h)
+    vector<CompressedClip> animations; // resampled onto nodes, play them with SampleClip + ApplyPose (see animation.h)
+    glm::mat4 transform = glm::mat4(1.0f); // places the model, Draw sets "model" to transform * the mesh's node matrix
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // constructor, expects a filepath to a 3D model. Blocks until the model is resident, see
+    // ModelLoader (model_loader.h) for loading in the background.
+    Model(string const &path, bool gamma = false, ModelOptions options = ModelOptions()) : gammaCorrection(gamma), options(options)
     {
         loadModel(path);
     }
 
+    // false while a background load is still uploading, Draw then only draws the meshes that are already resident
+    bool isReady() const { return ready; }
+
     // draws the model, and thus all its meshes
     void Draw(Shader &shader)
     {
+        prepareDraw(shader);
+        if(!sharedBuffer.empty())
+        {
+            sharedBuffer.Draw(meshes, shader, matrices.data());
+            return;
+        }
         for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if(i == 0 || matrices[i] != matrices[i - 1])
+                shader.setMat4("model", matrices[i]);
             meshes[i].Draw(shader);
+        }
+    }
+
+    // draws the model, skipping meshlets outside the frustum or facing away from the camera. With a
+    // lod view every mesh is drawn at the coarsest level whose error stays below a pixel budget.
+    // Both views are in model space (the space transform maps from).
+    void Draw(Shader &shader, const MeshletCullView &cull, const LodView *lod = nullptr)
+    {
+        prepareDraw(shader);
+        selectLevels(cull, lod);
+        if(!sharedBuffer.empty())
+        {
+            sharedBuffer.Draw(meshes, shader, matrices.data(), culls.data(), &cullStats, levels.data());
+            return;
+        }
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if(i == 0 || matrices[i] != matrices[i - 1])
+                shader.setMat4("model", matrices[i]);
+            meshes[i].Draw(shader, culls[i], cullStats, levels[i]);
+        }
+    }
+
+    // Draw(shader, cull, lod) recorded into queue instead of drawn right away: an item per mesh,
+    // keyed by shader, textures, VAO and the distance of the mesh's bounds from the camera, or a
+    // single item for the shared buffer, which batches its meshes itself. The pose is updated and
+    // uploaded now, its palette is bound when the items are drawn, so several skinned models can
+    // share a queue. The model and shader have to stay alive until queue.submit().
+    void Enqueue(RenderQueue &queue, Shader &shader, const glm::mat4 &view, float nearPlane, float farPlane,
+                 const MeshletCullView &cull, const LodView *lod = nullptr)
+    {
+        updatePose();
+        selectLevels(cull, lod);
+        auto depth = [&](const glm::mat4 &model, const glm::vec3 &center) {
+            return QuantizeRenderDepth(-(view * model * glm::vec4(center, 1.0f)).z, nearPlane, farPlane);
+        };
+        if(!sharedBuffer.empty())
+        {
+            uint32_t source = queue.addSource([this, &shader](uint32_t) {
+                shader.use();
+                bindPalette(shader);
+                sharedBuffer.Draw(meshes, shader, matrices.data(), culls.data(), &cullStats, levels.data());
+            });
+            // matrices already include transform
+            glm::vec3 center(0.0f);
+            for(size_t i = 0; i < meshes.size(); i++)
+                center += glm::vec3(matrices[i] * glm::vec4(meshes[i].boundsCenter, 1.0f)) / float(meshes.size());
+            queue.push(MakeRenderKey(RENDER_PASS_OPAQUE, shader.ID, 0, sharedBuffer.VAO, depth(glm::mat4(1.0f), center)), source, 0);
+            return;
+        }
+        uint32_t source = queue.addSource([this, &shader](uint32_t i) {
+            shader.use();
+            bindPalette(shader);
+            shader.setMat4("model", matrices[i]);
+            meshes[i].Draw(shader, culls[i], cullStats, levels[i]);
+        });
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            queue.push(MakeRenderKey(RENDER_PASS_OPAQUE, shader.ID, meshes[i].MaterialKey(), meshes[i].VAO,
+                                     depth(matrices[i], meshes[i].boundsCenter)), source, i);
+    }
+
+    size_t vertexCount() const
+    {
+        size_t count = 0;
+        for(const Mesh &mesh : meshes)
+            count += mesh.vertexCount;
+        return count;
+    }
+
+    // indices of a full detail draw, the vertex fetches Draw(shader) asks for
+    size_t indexCount() const
+    {
+        size_t count = 0;
+        for(const Mesh &mesh : meshes)
+            count += mesh.lods[0].indexCount;
+        return count;
+    }
+
+    // GPU memory of the vertices, in the layout they were uploaded in
+    size_t vertexBytes() const
+    {
+        size_t bytes = sharedBuffer.vertexBytes();
+        for(const Mesh &mesh : meshes)
+            bytes += mesh.vertexBytes();
+        return bytes;
+    }
+
+    // prints the GPU footprint of the vertex data next to what the plain Vertex layout would take
+    void printVertexStats() const
+    {
+        size_t vertices = 0, indexBytes = sharedBuffer.indexBytes(), indices = 0;
+        for(const Mesh &mesh : meshes)
+        {
+            vertices += mesh.vertexCount;
+            indices += mesh.indexCount;
+            indexBytes += mesh.indexBytes();
+        }
+        size_t vertexBytes = this->vertexBytes();
+        if(vertices == 0)
+            return;
+        cout << "MODEL::VERTEX_STATS:: " << vertices << " vertices, "
+             << double(vertexBytes) / vertices << " bytes/vertex (plain layout " << sizeof(Vertex) << "), "
+             << double(indexBytes) / std::max<size_t>(indices, 1) << " bytes/index, "
+             << (vertexBytes + indexBytes) / 1024 << " KiB total (plain layout "
+             << (vertices * sizeof(Vertex) + indices * sizeof(unsigned int)) / 1024 << " KiB)" << endl;
+        size_t cpuBytes = 0;
+        for(const Mesh &mesh : meshes)
+            cpuBytes += mesh.cpuBytes();
+        cout << "MODEL::VERTEX_STATS:: " << cpuBytes / 1024 << " KiB of vertex/index data kept in RAM" << endl;
+    }
+
+    // prints the levels of detail and, for a sweep of camera distances, the triangles Draw would
+    // submit next to the screen space error that costs. The camera looks at the model center along -z.
+    void printLodChart(const glm::mat4 &projection, float viewportHeight, float maxPixelError = 1.0f) const
+    {
+        if(meshes.empty())
+            return;
+        size_t fullTriangles = 0, levels = 0;
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for(const Mesh &mesh : meshes)
+        {
+            fullTriangles += mesh.lods[0].indexCount / 3;
+            levels = std::max(levels, mesh.lods.size());
+            // bounds of the placed mesh, the radius grows with the largest scale of the node
+            const glm::mat4 &node = nodeMatrix(mesh);
+            glm::vec3 center = glm::vec3(node * glm::vec4(mesh.boundsCenter, 1.0f));
+            float radius = mesh.boundsRadius * std::max(glm::length(glm::vec3(node[0])),
+                                                         std::max(glm::length(glm::vec3(node[1])), glm::length(glm::vec3(node[2]))));
+            lo = glm::min(lo, center - radius);
+            hi = glm::max(hi, center + radius);
+        }
+        if(levels < 2 || fullTriangles == 0)
+            return;
+        for(size_t level = 0; level < levels; level++)
+        {
+            size_t triangles = 0;
+            float error = 0.0f;
+            for(const Mesh &mesh : meshes)
+            {
+                const MeshLod &lod = mesh.lods[std::min(level, mesh.lods.size() - 1)];
+                triangles += lod.indexCount / 3;
+                error = std::max(error, lod.error);
+            }
+            cout << "MODEL::LOD:: level " << level << ": " << triangles << " triangles (" << 100.0 * triangles / fullTriangles
+                 << "%), error " << error << endl;
+        }
+
+        glm::vec3 center = (lo + hi) * 0.5f;
+        float radius = glm::length(hi - lo) * 0.5f;
+        for(float distance = radius * 2.0f; distance <= radius * 512.0f; distance *= 2.0f)
+        {
+            glm::mat4 view = glm::lookAt(center + glm::vec3(0.0f, 0.0f, distance), center, glm::vec3(0.0f, 1.0f, 0.0f));
+            LodView lod = MakeLodView(projection, view, glm::mat4(1.0f), viewportHeight, maxPixelError);
+            size_t triangles = 0;
+            float pixels = 0.0f;
+            for(const Mesh &mesh : meshes)
+            {
+                LodView meshLod = TransformLodView(lod, nodeMatrix(mesh));
+                unsigned int level = mesh.SelectLod(meshLod);
+                triangles += mesh.lods[level].indexCount / 3;
+                float meshDistance = glm::length(mesh.boundsCenter - meshLod.cameraPosition) - mesh.boundsRadius;
+                if(meshDistance > 0.0f)
+                    pixels = std::max(pixels, mesh.lods[level].error * meshLod.pixelsPerUnit / meshDistance);
+            }
+            cout << "MODEL::LOD:: distance " << distance << ": " << triangles << " triangles (" << 100.0 * triangles / fullTriangles
+                 << "%), screen error " << pixels << " px" << endl;
+        }
     }
 
 private:
+    friend class ModelLoader;
+
+    // what import() produced and the GL thread hasn't uploaded yet
+    struct PendingImport {
+        vector<Mesh> meshes;                        // without GL objects
+        vector<const Vertex*> vertexData;           // the arrays meshes[i] gets uploaded from
+        vector<const unsigned int*> indexData;
+        MeshCacheReader cache;                      // keeps the mapping alive on a cache hit
+        vector<TextureCache::PreparedTexture> textures;
+        vector<TextureHandle> textureHandles;       // textures[i] once uploaded
+        vector<unsigned int> textureLayers;         // layer of textures[i] in its array, with textureArrays
+        vector<size_t> textureAlias;                // the entry of textures that holds textures[i]: itself or an atlas page
+        vector<glm::vec4> textureRects;             // uv offset and scale of textures[i] in that entry
+        string path;                                // of the model file
+        bool arraysBuilt = false;
+        unordered_map<string, size_t> textureIndex; // path relative to directory -> textures
+        SceneGraph nodes;                           // becomes Model::nodes with the first upload step
+        Skeleton skeleton;                          // same for Model::skeleton
+        vector<CompressedClip> animations;          // and Model::animations
+        size_t nextMesh = 0;
+    };
+    unique_ptr<PendingImport> pending;
+    bool ready = false;
+    // per frame scratch of Draw and Enqueue
+    vector<unsigned int> levels;
+    vector<glm::mat4> matrices;       // "model" of every mesh
+    vector<MeshletCullView> culls;    // the cull view in the space of every mesh
+    vector<glm::mat4> palette;        // skinning matrices of the current pose
+    BonePalette bonePalette;          // the same on the GPU
+    bool paletteCurrent = false;
+
+    // an empty model, ModelLoader fills it in the background
+    struct Deferred {};
+    Model(Deferred, bool gamma, ModelOptions options) : gammaCorrection(gamma), options(options) {}
+
+    // vertex counts around the weld pass
+    struct WeldStats {
+        size_t before = 0, after = 0;
+    } weldStats;
+
+    // triangle/vertex weighted sums of the per mesh optimizer results
+    struct OptimizerStats {
+        size_t triangles = 0, vertices = 0;
+        double acmrBefore = 0.0, acmrAfter = 0.0, atvrBefore = 0.0, atvrAfter = 0.0;
+    } optimizerStats;
+
+    // bone influences that didn't fit into the MAX_BONE_INFLUENCE slots of their vertex, and those
+    // left out because their bone is past kMaxBones
+    struct BoneStats {
+        size_t influences = 0, dropped = 0, outOfPalette = 0;
+    } boneStats;
+    mutex statsMutex; // meshes are processed in parallel
+
+    // options that change the processed mesh data, part of the mesh cache key
+    uint64_t pipelineFlags() const
+    {
+        uint64_t flags = options.optimizeMeshes ? 1u : 0u;
+        flags |= uint64_t(options.weld.mode) << 1;
+        if(!options.lodErrors.empty())
+            flags = HashBytes(options.lodErrors.data(), options.lodErrors.size() * sizeof(float), flags);
+        if(options.weld.mode == WELD_TOLERANCE)
+        {
+            flags = HashBytes(&options.weld.positionTolerance, sizeof(float), flags);
+            flags = HashBytes(&options.weld.attributeTolerance, sizeof(float), flags);
+        }
+        return HashBytes(&options.animationCompression, sizeof(ClipCompression), flags);
+    }
+
+    // the node matrix of a mesh, identity for meshes of a model without nodes. Skinned meshes are
+    // placed by their bones instead, their node doesn't move them.
+    const glm::mat4 &nodeMatrix(const Mesh &mesh) const
+    {
+        static const glm::mat4 identity(1.0f);
+        if(mesh.node >= nodes.size() || (mesh.format.available & VERTEX_BONE_IDS))
+            return identity;
+        return nodes.world(mesh.node);
+    }
+
+    // the cull view and level of detail of every mesh for Draw(shader, cull, lod)
+    void selectLevels(const MeshletCullView &cull, const LodView *lod)
+    {
+        levels.assign(meshes.size(), 0);
+        culls.resize(meshes.size());
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            // the views move into the space of the mesh's vertices, most meshes sit at the model origin
+            const glm::mat4 &node = nodeMatrix(meshes[i]);
+            bool placed = node != glm::mat4(1.0f);
+            culls[i] = placed ? TransformCullView(cull, node) : cull;
+            if(lod)
+                levels[i] = meshes[i].SelectLod(placed ? TransformLodView(*lod, node) : *lod);
+            lodStats.triangles += meshes[i].lods[levels[i]].indexCount / 3;
+            lodStats.fullTriangles += meshes[i].lods[0].indexCount / 3;
+        }
+    }
+
+    // brings the world matrices of moved nodes up to date, places every mesh with transform and
+    // hands the shader the bone palette of the current pose
+    void prepareDraw(Shader &shader)
+    {
+        updatePose();
+        bindPalette(shader);
+    }
+
+    // the matrices and bone palette of the current pose, without binding anything
+    void updatePose()
+    {
+        size_t moved = nodes.update();
+        matrices.resize(meshes.size());
+        for(size_t i = 0; i < meshes.size(); i++)
+            matrices[i] = transform * nodeMatrix(meshes[i]);
+        if(skeleton.empty())
+            return;
+        if(moved > 0 || !paletteCurrent)
+        {
+            skeleton.palette(nodes, palette);
+            bonePalette.upload(palette);
+            paletteCurrent = true;
+        }
+    }
+
+    // the palette binding is shared by all models, so it has to be redone before each of their draws
+    void bindPalette(Shader &shader)
+    {
+        if(!skeleton.empty())
+            bonePalette.bind(shader);
+    }
+
+    void printWeldStats() const
+    {
+        if(weldStats.before == 0)
+            return;
+        cout << "MODEL::WELD:: vertices " << weldStats.before << " -> " << weldStats.after << " ("
+             << 100.0 * (weldStats.before - weldStats.after) / weldStats.before << "% smaller, "
+             << (weldStats.before - weldStats.after) * sizeof(Vertex) / 1024 << " KiB saved)" << endl;
+    }
+
+    void printOptimizerStats() const
+    {
+        if(optimizerStats.triangles == 0)
+            return;
+        cout << "MODEL::OPTIMIZER:: ACMR " << optimizerStats.acmrBefore / optimizerStats.triangles
+             << " -> " << optimizerStats.acmrAfter / optimizerStats.triangles
+             << ", ATVR " << optimizerStats.atvrBefore / optimizerStats.vertices
+             << " -> " << optimizerStats.atvrAfter / optimizerStats.vertices << endl;
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
-        // read file via ASSIMP
+        import(path);
+        while(uploadStep())
+            ;
+        TextureCache::instance().flushUploads();
+    }
+
+    // everything a load does before the GL uploads: assimp import (or mesh cache hit), mesh
+    // processing and texture decoding. Touches no GL state, so ModelLoader runs it on a worker.
+    void import(string const &path)
+    {
+        pending.reset(new PendingImport());
+        pending->path = path;
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        // a cache hit skips assimp entirely
+        uint64_t cacheKey = 0;
+        if(options.useMeshCache)
+        {
+            MappedFile source(path);
+            if(source.isOpen())
+            {
+                cacheKey = MeshCacheKey(source, kModelImportFlags, pipelineFlags());
+                if(loadFromCache(MeshCachePath(path), cacheKey))
+                {
+                    finishImport();
+                    return;
+                }
+            }
+        }
+
+        // read file via ASSIMP, straight out of mmapped files (see mapped_io_system.h)
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        MappedIOSystem *io = new MappedIOSystem();
+        importer.SetIOHandler(io);
+        const aiScene* scene = importer.ReadFile(path, kModelImportFlags);
+        cout << "MODEL::IO:: " << io->filesOpened << " files mapped, " << io->bytesMapped / 1024 << " KiB" << endl;
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // flatten ASSIMP's node hierarchy, then convert the meshes its nodes reference in parallel.
+        // Big meshes split their conversion further, see vertex_convert.h.
+        vector<const aiNode*> sources;
+        pending->nodes.build(scene->mRootNode, &sources);
+        vector<aiMesh*> nodeMeshes;
+        vector<unsigned int> meshNodes;
+        for(unsigned int node = 0; node < sources.size(); node++)
+            processNode(sources[node], node, scene, nodeMeshes, meshNodes);
+        // bone ids are model wide, so the bones are known before the meshes convert in parallel
+        for(const aiMesh *mesh : nodeMeshes)
+            for(unsigned int i = 0; i < mesh->mNumBones; i++)
+                pending->skeleton.add(mesh->mBones[i]->mName.C_Str(), ToGlm(mesh->mBones[i]->mOffsetMatrix));
+        pending->skeleton.bind(pending->nodes);
+        // resample the clips onto the flattened nodes and compress them
+        pending->animations.resize(scene->mNumAnimations);
+        SharedThreadPool().parallelFor(scene->mNumAnimations, 1, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; i++)
+                pending->animations[i] = CompressClip(ImportAnimation(scene->mAnimations[i], pending->nodes), options.animationCompression);
+        });
+        vector<optional<Mesh>> converted(nodeMeshes.size());
+        SharedThreadPool().parallelFor(nodeMeshes.size(), 1, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; i++)
+                converted[i].emplace(processMesh(nodeMeshes[i], scene));
+        });
+        for(size_t i = 0; i < converted.size(); i++)
+        {
+            converted[i]->node = meshNodes[i];
+            pending->meshes.push_back(std::move(*converted[i]));
+        }
+        for(const Mesh &mesh : pending->meshes)
+        {
+            pending->vertexData.push_back(mesh.vertices.data());
+            pending->indexData.push_back(mesh.indices.data());
+        }
+        if(options.weld.mode != WELD_NONE)
+            printWeldStats();
+        if(options.optimizeMeshes)
+            printOptimizerStats();
+        if(!pending->skeleton.empty())
+            cout << "MODEL::BONES:: " << pending->skeleton.bones.size() << " bones, " << boneStats.dropped << " of "
+                 << boneStats.influences << " influences dropped (more than " << MAX_BONE_INFLUENCE << " per vertex), "
+                 << boneStats.outOfPalette << " left out (bones past " << kMaxBones << ")" << endl;
+
+        if(options.useMeshCache && cacheKey != 0 && !WriteMeshCache(MeshCachePath(path), cacheKey, pending->meshes, pending->nodes, pending->skeleton, pending->animations))
+            cout << "WARNING::MESH_CACHE:: failed to write " << MeshCachePath(path) << endl;
+        finishImport();
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // rebuilds the meshes from a mesh cache written by an earlier import. The vertex and index
+    // arrays get uploaded straight out of the mapping, only the texture references are re-resolved.
+    bool loadFromCache(string const &cachePath, uint64_t key)
     {
-        // process each mesh located at the current node
-        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+        MeshCacheReader &cache = pending->cache;
+        if(!cache.open(cachePath, key))
+            return false;
+        cache.nodes(pending->nodes);
+        cache.skeleton(pending->skeleton);
+        pending->animations = cache.animations();
+
+        for(unsigned int i = 0; i < cache.meshCount(); i++)
         {
-            // the node object only contains indices to index the actual objects in the scene.
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            const MeshCacheMesh &entry = cache.mesh(i);
+            vector<Texture> textures;
+            for(unsigned int j = 0; j < entry.textureCount; j++)
+            {
+                string type, texturePath;
+                cache.texture(i, j, type, texturePath);
+                textures.push_back(textureReference(texturePath, type));
+            }
+            pending->meshes.push_back(Mesh(cache.vertices(i), entry.vertexCount, cache.indices(i), entry.indexCount, std::move(textures),
+                                           vertexFormat(entry.attributes), false));
+            if(entry.lodCount > 0)
+                pending->meshes.back().lods = cache.lods(i);
+            pending->meshes.back().node = entry.node;
+            pending->vertexData.push_back(cache.vertices(i));
+            pending->indexData.push_back(cache.indices(i));
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for(unsigned int i = 0; i < node->mNumChildren; i++)
+        return true;
+    }
+
+    // the CPU steps that run on the final vertex/index arrays, whether they came from assimp or the mesh cache
+    void finishImport()
+    {
+        PendingImport &p = *pending;
+        cout << "MODEL::NODES:: " << p.nodes.size() << " nodes in " << p.nodes.depth() << " levels" << endl;
+        if(!p.animations.empty())
         {
-            processNode(node->mChildren[i], scene);
+            size_t bytes = 0, rawBytes = 0;
+            for(const CompressedClip &clip : p.animations)
+            {
+                bytes += clip.bytes();
+                rawBytes += clip.rawBytes();
+            }
+            cout << "MODEL::ANIMATIONS:: " << p.animations.size() << " clips, " << bytes / 1024 << " KiB compressed ("
+                 << rawBytes / 1024 << " KiB resampled, " << 100.0 * bytes / std::max<size_t>(rawBytes, 1) << "%)" << endl;
+        }
+        if(p.skeleton.bones.size() > kMaxBones)
+            cout << "WARNING::SKELETON:: " << p.skeleton.bones.size() << " bones, only the first " << kMaxBones
+                 << " fit the palette, vertices ignore the others" << endl;
+        if(options.buildMeshlets)
+        {
+            size_t meshletCount = 0, meshletVertices = 0, meshletTriangles = 0;
+            for(size_t i = 0; i < p.meshes.size(); i++)
+            {
+                Mesh &mesh = p.meshes[i];
+                // the bounds of a skinned mesh's meshlets would only hold in bind pose
+                if(mesh.format.available & VERTEX_BONE_IDS)
+                    continue;
+                mesh.meshlets = BuildMeshlets(p.vertexData[i], mesh.vertexCount, p.indexData[i], mesh.lods[0].indexCount);
+                for(const Meshlet &m : mesh.meshlets)
+                {
+                    meshletVertices += m.vertexCount;
+                    meshletTriangles += m.triangleCount;
+                }
+                meshletCount += mesh.meshlets.size();
+            }
+            if(meshletCount > 0)
+                cout << "MODEL::MESHLETS:: " << meshletCount << " meshlets, " << double(meshletVertices) / meshletCount
+                     << " vertices and " << double(meshletTriangles) / meshletCount << " triangles on average" << endl;
         }
 
+        // decode (or block compress) every texture the meshes reference in parallel, uploadStep
+        // uploads them. The first material slot a file shows up in decides its role.
+        vector<string> paths;
+        vector<TextureRole> roles;
+        for(const Mesh &mesh : p.meshes)
+            for(const Texture &texture : mesh.textures)
+                if(p.textureIndex.emplace(texture.path, paths.size()).second)
+                {
+                    paths.push_back(texture.path);
+                    roles.push_back(textureRole(texture.type));
+                }
+        p.textures.resize(paths.size());
+        p.textureAlias.resize(paths.size());
+        for(size_t i = 0; i < paths.size(); i++)
+            p.textureAlias[i] = i;
+        p.textureRects.assign(paths.size(), glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+        // arrays and atlases need the pixels even of textures some other model already uploaded
+        bool skipResident = !options.textureArrays && !options.atlas.enabled;
+        SharedThreadPool().parallelFor(paths.size(), 1, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; i++)
+                p.textures[i] = TextureCache::instance().prepare(directory + '/' + paths[i], gammaCorrection, roles[i], skipResident);
+        });
+        if(options.atlas.enabled)
+            packAtlas(roles);
+        p.textureHandles.resize(p.textures.size());
+        p.textureLayers.assign(p.textures.size(), 0);
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // GL thread: one piece of the upload - one texture, one mesh, or the shared buffer once every
+    // mesh is through. Meshes become drawable as soon as they are uploaded, with shared buffers all
+    // at once. Returns false when there is nothing left to do.
+    bool uploadStep()
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        if(!pending)
+            return false;
+        PendingImport &p = *pending;
+        // Draw reads the nodes and bones, so they only change hands on the GL thread
+        if(p.nodes.size() > 0)
+        {
+            nodes = std::move(p.nodes);
+            skeleton = std::move(p.skeleton);
+            animations = std::move(p.animations);
+            p.nodes = SceneGraph();
+            p.skeleton = Skeleton();
+            p.animations.clear();
+            paletteCurrent = false;
+        }
+        // with texture arrays every texture goes up in one step, ahead of the first mesh
+        if(options.textureArrays && !p.arraysBuilt)
+        {
+            buildTextureArrays();
+            return true;
+        }
+        if(p.nextMesh < p.meshes.size())
+        {
+            Mesh &mesh = p.meshes[p.nextMesh];
+            for(Texture &texture : mesh.textures)
+            {
+                if(texture.handle)
+                    continue;
+                size_t t = p.textureIndex[texture.path], source = p.textureAlias[t];
+                if(!p.textureHandles[source])
+                {
+                    p.textureHandles[source] = TextureCache::instance().finish(p.textures[source]);
+                    p.textures[source].compressed = CompressedImage(); // the mip chain is on the GPU now
+                    return true;
+                }
+                texture.handle = p.textureHandles[source];
+                texture.id = texture.handle->id;
+                texture.layer = p.textureLayers[source];
+                texture.rect = p.textureRects[t];
+            }
+            if(!options.sharedBuffers)
+            {
+                mesh.Upload(p.vertexData[p.nextMesh], p.indexData[p.nextMesh]);
+                if(options.releaseCpuData)
+                    mesh.ReleaseCpuData();
+                meshes.push_back(std::move(mesh));
+            }
+            p.nextMesh++;
+            return true;
+        }
+        if(options.sharedBuffers)
+        {
+            sharedBuffer.build(p.meshes, p.vertexData, p.indexData);
+            if(options.releaseCpuData)
+                for(Mesh &mesh : p.meshes)
+                    mesh.ReleaseCpuData();
+            meshes = std::move(p.meshes);
+        }
+        pending.reset();
+        ready = true;
+        return false;
+    }
 
-        // walk through each of the mesh's vertices
-        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
-        {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            if (mesh->HasNormals())
+    // packs the small textures of every role into atlas pages, which are appended to the pending
+    // textures and stand in for their members from then on. Pages are cached next to the model,
+    // keyed by the content of their members and everything that shapes the packing.
+    void packAtlas(const vector<TextureRole> &roles)
+    {
+        PendingImport &p = *pending;
+        const AtlasOptions &atlas = options.atlas;
+        size_t textureCount = p.textures.size(), packed = 0, pageCount = 0, texturePixels = 0, paddedPixels = 0;
+        for(TextureRole role : { TEXTURE_ROLE_COLOR, TEXTURE_ROLE_MASK, TEXTURE_ROLE_NORMAL })
+        {
+            vector<size_t> members;
+            vector<pair<int, int>> sizes;
+            uint64_t key = HashCombine(HashCombine(HashCombine(kCompressedTextureVersion, kAtlasPageVersion), role), atlas.pageSize);
+            key = HashCombine(HashCombine(key, atlas.maxTextureSize), atlas.gutter);
+            for(size_t t = 0; t < textureCount; t++)
+            {
+                const CompressedImage &image = p.textures[t].compressed;
+                if(roles[t] != role || !image.valid() || image.width() > atlas.maxTextureSize || image.height() > atlas.maxTextureSize)
+                    continue;
+                members.push_back(t);
+                sizes.push_back(make_pair(image.width(), image.height()));
+                key = HashCombine(key, p.textures[t].key);
+            }
+            // a page for a single texture saves nothing
+            if(members.size() < 2)
+                continue;
+            AtlasPacking packing = PackAtlas(sizes, atlas);
+
+            vector<vector<uint8_t>> decoded; // members as RGBA8, only needed to compose a page
+            vector<const uint8_t*> pixels;
+            size_t firstPage = p.textures.size();
+            for(size_t page = 0; page < packing.pageCount; page++)
+            {
+                TextureCache::PreparedTexture prepared;
+                prepared.filename = p.path + ".atlas" + to_string(pageCount + page);
+                prepared.gamma = gammaCorrection;
+                prepared.role = role;
+                prepared.key = HashCombine(key, page);
+                string cachePath = CompressedTexturePath(prepared.filename);
+                if(!ReadCompressedTexture(cachePath, prepared.key, prepared.compressed))
+                {
+                    if(decoded.empty())
+                    {
+                        decoded.resize(members.size());
+                        // from the source files: the members are block compressed already, composing from
+                        // those would put the page through a second round of compression loss
+                        SharedThreadPool().parallelFor(members.size(), 1, [&](size_t begin, size_t end) {
+                            for(size_t i = begin; i < end; i++)
+                            {
+                                const CompressedImage &member = p.textures[members[i]].compressed;
+                                DecodedImage source = DecodeImage(p.textures[members[i]].filename);
+                                if(source.valid() && source.width == member.width() && source.height == member.height())
+                                    decoded[i] = ToRgba8(source);
+                                else
+                                    decoded[i] = DecodeCompressedLevel(member, 0);
+                            }
+                        });
+                        for(const vector<uint8_t> &image : decoded)
+                            pixels.push_back(image.data());
+                    }
+                    vector<uint8_t> rgba = ComposeAtlasPage(packing, page, pixels, atlas);
+                    prepared.compressed = CompressRgba8(rgba, atlas.pageSize, atlas.pageSize, 4, role, TextureCache::instance().compression,
+                                                        AtlasMipLevels(atlas));
+                    if(!WriteCompressedTexture(cachePath, prepared.key, prepared.compressed))
+                        cout << "WARNING::ATLAS:: failed to write " << cachePath << endl;
+                }
+                p.textures.push_back(std::move(prepared));
+                p.textureAlias.push_back(p.textureAlias.size());
+                p.textureRects.push_back(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+            }
+            for(size_t i = 0; i < members.size(); i++)
             {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
+                if(packing.rects[i].width == 0)
+                    continue; // didn't fit a page
+                p.textureAlias[members[i]] = firstPage + packing.rects[i].page;
+                p.textureRects[members[i]] = AtlasUvRect(packing.rects[i], atlas.pageSize);
+                p.textures[members[i]].compressed = CompressedImage();
+                packed++;
             }
-            // texture coordinates
-            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+            pageCount += packing.pageCount;
+            texturePixels += packing.texturePixels;
+            paddedPixels += packing.paddedPixels;
+        }
+        if(pageCount == 0)
+            return;
+        double pageArea = double(atlas.pageSize) * atlas.pageSize * pageCount;
+        cout << "MODEL::ATLAS:: " << packed << " of " << textureCount << " textures in " << pageCount << " pages of " << atlas.pageSize
+             << "x" << atlas.pageSize << ", " << 100.0 * texturePixels / pageArea << "% covered by textures (" << 100.0 * paddedPixels / pageArea
+             << "% with gutters), " << textureCount << " -> " << textureCount - packed + pageCount << " texture objects" << endl;
+    }
+
+    // GL thread: uploads every pending texture as a layer of a texture array
+    void buildTextureArrays()
+    {
+        PendingImport &p = *pending;
+        vector<const CompressedImage*> images;
+        for(size_t t = 0; t < p.textures.size(); t++)
+            images.push_back(p.textureAlias[t] == t ? &p.textures[t].compressed : nullptr);
+        vector<TextureArrayLayer> layers = BuildTextureArrays(images);
+        set<unsigned int> arrays;
+        for(size_t t = 0; t < layers.size(); t++)
+        {
+            if(p.textureAlias[t] != t)
+                continue;
+            if(!layers[t].array)
             {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x;
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-                // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-                // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
+                cout << "Texture failed to load at path: " << p.textures[t].filename << endl;
+                layers[t].array = make_shared<TextureObject>();
+                glGenTextures(1, &layers[t].array->id);
+                layers[t].array->layers = 1;
             }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            p.textureHandles[t] = layers[t].array;
+            p.textureLayers[t] = layers[t].layer;
+            p.textures[t].compressed = CompressedImage();
+            arrays.insert(layers[t].array->id);
+        }
+        if(!layers.empty())
+            cout << "MODEL::TEXTURE_ARRAYS:: " << arrays.size() << " arrays for " << p.textureIndex.size() << " textures" << endl;
+        p.arraysBuilt = true;
+    }
 
-            vertices.push_back(vertex);
+    // collects each individual mesh located at a node, the meshes remember the node that places them.
+    // The hierarchy itself is already flattened into nodes, so there is no recursion into the children.
+    void processNode(const aiNode *node, unsigned int index, const aiScene *scene, vector<aiMesh*> &nodeMeshes,
+                     vector<unsigned int> &meshNodes)
+    {
+        // process each mesh located at the current node
+        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+        {
+            // the node object only contains indices to index the actual objects in the scene.
+            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+            nodeMeshes.push_back(mesh);
+            meshNodes.push_back(index);
+        }
+    }
+
+    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    {
+        // data to fill: positions, normals, the first uv set and the tangent frame straight out of
+        // assimp's attribute arrays, the faces as one flat index buffer (see vertex_convert.h)
+        vector<Vertex> vertices = ConvertVertices(mesh);
+        vector<unsigned int> indices = ConvertIndices(mesh);
+        vector<Texture> textures;
+
+        // the strongest bones of every vertex, before welding compares them
+        if(mesh->HasBones())
+        {
+            size_t influences = 0;
+            for(unsigned int i = 0; i < mesh->mNumBones; i++)
+                influences += mesh->mBones[i]->mNumWeights;
+            size_t outOfPalette = 0;
+            size_t dropped = ImportBoneWeights(mesh, pending->skeleton, vertices, &outOfPalette);
+            lock_guard<mutex> lock(statsMutex);
+            boneStats.influences += influences;
+            boneStats.dropped += dropped;
+            boneStats.outOfPalette += outOfPalette;
+        }
+
+        // assimp hands out one vertex per face corner for many formats, merge the duplicates
+        if(options.weld.mode != WELD_NONE)
+        {
+            size_t before = vertices.size();
+            WeldVertices(vertices, indices, options.weld);
+            lock_guard<mutex> lock(statsMutex);
+            weldStats.before += before;
+            weldStats.after += vertices.size();
         }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+
+        // reorder for the GPU before the data gets uploaded (and cached)
+        if(options.optimizeMeshes)
         {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-            for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+            VertexCacheStats before, after;
+            OptimizeMesh(vertices, indices, &before, &after);
+            size_t triangles = indices.size() / 3;
+            lock_guard<mutex> lock(statsMutex);
+            optimizerStats.triangles += triangles;
+            optimizerStats.vertices += vertices.size();
+            optimizerStats.acmrBefore += before.acmr * triangles;
+            optimizerStats.acmrAfter += after.acmr * triangles;
+            optimizerStats.atvrBefore += before.atvr * vertices.size();
+            optimizerStats.atvrAfter += after.atvr * vertices.size();
         }
+
+        // coarser versions of the mesh go behind the full index buffer
+        vector<MeshLod> lods;
+        if(!options.lodErrors.empty())
+            lods = BuildLods(vertices, indices, options.lodErrors);
+
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -171,10 +916,35 @@ private:
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        Mesh result(std::move(vertices), std::move(indices), std::move(textures), vertexFormat(meshAttributes(mesh)), false);
+        if(!lods.empty())
+            result.lods = std::move(lods);
+        return result;
+    }
+
+    // the VertexAttribute bits an assimp mesh provides data for
+    static unsigned int meshAttributes(const aiMesh *mesh)
+    {
+        unsigned int attributes = VERTEX_POSITION;
+        if(mesh->HasNormals())
+            attributes |= VERTEX_NORMAL;
+        if(mesh->mTextureCoords[0])
+            attributes |= VERTEX_TEXCOORDS | VERTEX_TANGENT | VERTEX_BITANGENT; // processMesh only copies tangents with uvs
+        if(mesh->HasBones())
+            attributes |= VERTEX_BONE_IDS | VERTEX_WEIGHTS;
+        return attributes;
+    }
+
+    VertexFormat vertexFormat(unsigned int available) const
+    {
+        VertexFormat format;
+        format.available = available;
+        format.used = options.vertexAttributes;
+        format.compact = options.compactVertices;
+        return format;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
+    // checks all material textures of a given type, the textures themselves are loaded by uploadStep.
     // the required info is returned as a Texture struct.
     vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
     {
@@ -183,71 +953,32 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(textureReference(str.C_Str(), typeName));
         }
         return textures;
     }
-};
-
-
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
-{
-    string filename = string(path);
-    filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    // the block compression a material slot gets: diffuse maps are color, normal maps keep two
+    // channels, specular and height maps one
+    static TextureRole textureRole(const string &typeName)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+        if(typeName == "texture_normal")
+            return TEXTURE_ROLE_NORMAL;
+        if(typeName == "texture_specular" || typeName == "texture_height")
+            return TEXTURE_ROLE_MASK;
+        return TEXTURE_ROLE_COLOR;
     }
-    else
+
+    // a texture at path (relative to the model directory). Only the reference, uploadStep resolves
+    // it through the shared texture cache, so a file that is already resident (for this or any
+    // other model) is not loaded again.
+    static Texture textureReference(string const &path, string const &typeName)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        Texture texture;
+        texture.id = 0;
+        texture.type = typeName;
+        texture.path = path;
+        return texture;
     }
-
-    return textureID;
-}
+};
 #endif
-
-
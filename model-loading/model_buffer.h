@@ -0,0 +1,236 @@
+#ifndef MODEL_BUFFER_H
+#define MODEL_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+
+#include "mesh.h"
+#include "meshlet.h"
+#include "shader.h"
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+// All meshes of a Model packed into one VBO/EBO behind a single VAO. Every mesh keeps its own
+// 0-based indices and is drawn with a base vertex, so one vertex array binding serves the whole
+// model. Runs of consecutive meshes that bind the same textures become a single
+// glMultiDrawElementsBaseVertex call. Meshes textured from texture arrays get their layers from a
+// per vertex layer stream, so any meshes sharing the arrays batch, whatever layers they sample.
+class ModelBuffer
+{
+public:
+    struct Range {
+        GLint baseVertex;
+        size_t indexOffset; // bytes into the EBO
+        GLsizei indexCount; // of all levels of detail
+    };
+
+    unsigned int VAO = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    VertexLayout layout;
+    vector<Range> ranges; // one per mesh
+
+    bool empty() const { return VAO == 0; }
+
+    // owns its GL objects like Mesh does
+    ModelBuffer() = default;
+    ModelBuffer(const ModelBuffer&) = delete;
+    ModelBuffer &operator=(const ModelBuffer&) = delete;
+    ~ModelBuffer()
+    {
+        release();
+    }
+
+    void release()
+    {
+        if(VAO)
+            GLState::instance().deleteVertexArrays(1, &VAO);
+        if(VBO)
+            GLState::instance().deleteBuffers(1, &VBO);
+        if(EBO)
+            GLState::instance().deleteBuffers(1, &EBO);
+        if(layerVBO)
+            GLState::instance().deleteBuffers(1, &layerVBO);
+        VAO = VBO = EBO = layerVBO = 0;
+        ranges.clear();
+        vertexBufferSize = indexBufferSize = 0;
+    }
+
+    // uploads meshes[i] from vertices[i]/indices[i]. The meshes were created without GL buffers,
+    // the pointers only have to stay valid for the duration of this call.
+    void build(const vector<Mesh> &meshes, const vector<const Vertex*> &vertices, const vector<const unsigned int*> &indices)
+    {
+        release();
+        if(meshes.empty())
+            return;
+
+        // one layout for everything: union of the attributes, quantized on the model bounds
+        VertexFormat format = meshes[0].format;
+        format.available = 0;
+        glm::vec3 lo(0.0f), hi(0.0f);
+        bool first = true;
+        size_t totalVertices = 0, totalIndices = 0, maxMeshVertices = 0;
+        for(size_t i = 0; i < meshes.size(); i++)
+        {
+            format.available |= meshes[i].format.available;
+            if(meshes[i].vertexCount > 0)
+            {
+                if(first)
+                    lo = hi = vertices[i][0].Position;
+                first = false;
+                ExpandBounds(vertices[i], meshes[i].vertexCount, lo, hi);
+            }
+            totalVertices += meshes[i].vertexCount;
+            totalIndices += meshes[i].indexCount;
+            maxMeshVertices = std::max<size_t>(maxMeshVertices, meshes[i].vertexCount);
+        }
+        layout = MakeVertexLayout(format, lo, hi);
+        GLsizei stride = layout.compact ? layout.stride : static_cast<GLsizei>(sizeof(Vertex));
+        // indices are relative to their mesh, so 16 bits suffice as long as every single mesh is small
+        size_t indexSize = layout.compact ? IndexSize(maxMeshVertices) : sizeof(unsigned int);
+        indexType = indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        GLState::instance().bindVertexArray(VAO);
+        GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, totalVertices * stride, nullptr, GL_STATIC_DRAW);
+        GLState::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndices * indexSize, nullptr, GL_STATIC_DRAW);
+
+        ranges.resize(meshes.size());
+        size_t vertexOffset = 0, indexOffset = 0;
+        for(size_t i = 0; i < meshes.size(); i++)
+        {
+            const Mesh &mesh = meshes[i];
+            ranges[i].baseVertex = static_cast<GLint>(vertexOffset);
+            ranges[i].indexOffset = indexOffset * indexSize;
+            ranges[i].indexCount = static_cast<GLsizei>(mesh.indexCount);
+            if(layout.compact)
+            {
+                vector<unsigned char> packed = PackVertices(vertices[i], mesh.vertexCount, layout);
+                glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * stride, packed.size(), packed.data());
+                vector<unsigned char> packedIndices = PackIndices(indices[i], mesh.indexCount, maxMeshVertices);
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, ranges[i].indexOffset, packedIndices.size(), packedIndices.data());
+            }
+            else
+            {
+                glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * stride, mesh.vertexCount * sizeof(Vertex), vertices[i]);
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, ranges[i].indexOffset, mesh.indexCount * sizeof(unsigned int), indices[i]);
+            }
+            vertexOffset += mesh.vertexCount;
+            indexOffset += mesh.indexCount;
+        }
+        vertexBufferSize = totalVertices * stride;
+        indexBufferSize = totalIndices * indexSize;
+
+        // texture array layers of every vertex, one byte each (see kMaxTextureArrayLayers)
+        bool arrays = false;
+        for(const Mesh &mesh : meshes)
+            for(const Texture &texture : mesh.textures)
+                arrays = arrays || (texture.handle && texture.handle->layers > 0);
+        if(arrays)
+        {
+            vector<unsigned char> layers(totalVertices * 4);
+            size_t vertex = 0;
+            for(const Mesh &mesh : meshes)
+            {
+                glm::vec4 meshLayers = mesh.TextureLayers();
+                for(unsigned int v = 0; v < mesh.vertexCount; v++, vertex++)
+                    for(int c = 0; c < 4; c++)
+                        layers[vertex * 4 + c] = static_cast<unsigned char>(meshLayers[c]);
+            }
+            glGenBuffers(1, &layerVBO);
+            GLState::instance().bindBuffer(GL_ARRAY_BUFFER, layerVBO);
+            glBufferData(GL_ARRAY_BUFFER, layers.size(), layers.data(), GL_STATIC_DRAW);
+            glEnableVertexAttribArray(kTextureLayersLocation);
+            glVertexAttribPointer(kTextureLayersLocation, 4, GL_UNSIGNED_BYTE, GL_FALSE, 4, nullptr);
+            GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
+            vertexBufferSize += layers.size();
+        }
+
+        SetVertexAttributes(layout);
+        GLState::instance().bindVertexArray(0);
+    }
+
+    // draws every mesh, batching runs of meshes with identical textures and model matrices into one
+    // multi-draw. matrices[i] (optional) is set as the "model" uniform of mesh i. With cull views
+    // (one per mesh, in the mesh's space) only the visible meshlets of meshes that have them are
+    // submitted, levels picks the level of detail of every mesh (all full detail without).
+    void Draw(vector<Mesh> &meshes, Shader &shader, const glm::mat4 *matrices = nullptr, const MeshletCullView *culls = nullptr,
+              MeshletCullStats *stats = nullptr, const unsigned int *levels = nullptr)
+    {
+        const glm::mat4 *model = nullptr; // last matrix set
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+        if(layout.compact)
+        {
+            shader.setVec3("positionOffset", layout.positionOffset);
+            shader.setVec3("positionScale", layout.positionScale);
+        }
+        GLState::instance().bindVertexArray(VAO);
+        size_t i = 0;
+        while(i < meshes.size())
+        {
+            size_t first = i;
+            counts.clear();
+            offsets.clear();
+            baseVertices.clear();
+            do
+            {
+                unsigned int level = levels ? levels[i] : 0;
+                const MeshLod &lod = meshes[i].lods[level];
+                if(culls && level == 0 && !meshes[i].meshlets.empty())
+                {
+                    visibleRanges.clear();
+                    CullMeshlets(meshes[i].meshlets, culls[i], visibleRanges, *stats);
+                    for(const IndexRange &range : visibleRanges)
+                    {
+                        counts.push_back(static_cast<GLsizei>(range.count));
+                        offsets.push_back(reinterpret_cast<const void*>(ranges[i].indexOffset + range.first * indexSize));
+                        baseVertices.push_back(ranges[i].baseVertex);
+                    }
+                }
+                else if(lod.indexCount > 0)
+                {
+                    counts.push_back(static_cast<GLsizei>(lod.indexCount));
+                    offsets.push_back(reinterpret_cast<const void*>(ranges[i].indexOffset + lod.firstIndex * indexSize));
+                    baseVertices.push_back(ranges[i].baseVertex);
+                }
+                i++;
+            } while(i < meshes.size() && meshes[i].SharesTextures(meshes[i - 1]) && (!matrices || matrices[i] == matrices[i - 1]));
+
+            if(counts.empty())
+                continue;
+            if(matrices && (!model || *model != matrices[first]))
+            {
+                model = &matrices[first];
+                shader.setMat4("model", *model);
+            }
+            meshes[first].BindTextures(shader);
+            if(counts.size() == 1)
+                glDrawElementsBaseVertex(GL_TRIANGLES, counts[0], indexType, offsets[0], baseVertices[0]);
+            else
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), indexType, offsets.data(),
+                                              static_cast<GLsizei>(counts.size()), baseVertices.data());
+        }
+    }
+
+    size_t vertexBytes() const { return vertexBufferSize; }
+    size_t indexBytes() const { return indexBufferSize; }
+
+private:
+    unsigned int VBO = 0, EBO = 0;
+    unsigned int layerVBO = 0; // texture array layers, only for meshes textured from arrays
+    size_t vertexBufferSize = 0;
+    size_t indexBufferSize = 0;
+    // scratch arrays for the multi-draw parameters, kept to avoid allocating every frame
+    vector<GLsizei> counts;
+    vector<const void*> offsets;
+    vector<GLint> baseVertices;
+    vector<IndexRange> visibleRanges;
+};
+#endif
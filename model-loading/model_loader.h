@@ -0,0 +1,89 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <learnopengl/thread_pool.h>
+
+#include "model.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Loads models in the background. load() returns an empty Model right away: the assimp import
+// (or mesh cache read), mesh processing and texture decoding run on the shared thread pool, and
+// update() streams the GL uploads from the render loop under a per frame time budget. Meshes show
+// up in Model::Draw as soon as they are resident (all at once with ModelOptions::sharedBuffers),
+// Model::isReady() tells when the whole model is.
+class ModelLoader
+{
+public:
+    shared_ptr<Model> load(string const &path, bool gamma = false, ModelOptions options = ModelOptions())
+    {
+        shared_ptr<Job> job = make_shared<Job>();
+        job->model.reset(new Model(Model::Deferred(), gamma, options));
+        jobs.push_back(job);
+        SharedThreadPool().submit([job, path] {
+            job->model->import(path);
+            job->imported.store(true, memory_order_release);
+        });
+        return job->model;
+    }
+
+    // GL thread, once per frame: uploads finished imports until budgetMilliseconds are spent. At
+    // least one step is made every call, a single large texture can overshoot the budget but never
+    // stall a load - unless TextureCache::streamUploads is on, then a texture step only allocates
+    // and its contents stream in from here. Returns the number of models that became ready.
+    size_t update(double budgetMilliseconds = 2.0)
+    {
+        TextureCache::instance().updateUploads();
+        auto start = chrono::steady_clock::now();
+        auto elapsed = [&] { return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count(); };
+        size_t finished = 0;
+        bool first = true;
+        for(size_t i = 0; i < jobs.size(); )
+        {
+            Job &job = *jobs[i];
+            if(!job.imported.load(memory_order_acquire))
+            {
+                i++;
+                continue;
+            }
+            // nobody wants the model anymore, don't bother uploading it
+            bool done = job.model.use_count() == 1;
+            while(!done && (first || elapsed() < budgetMilliseconds))
+            {
+                first = false;
+                done = !job.model->uploadStep();
+            }
+            if(!done)
+                break;
+            finished += job.model.use_count() > 1;
+            // the worker may still hold the job for a moment, the model must not die on its thread
+            job.model.reset();
+            jobs.erase(jobs.begin() + i);
+        }
+        return finished;
+    }
+
+    // models that are partly uploaded own GL objects, release them here on the GL thread
+    ~ModelLoader()
+    {
+        for(shared_ptr<Job> &job : jobs)
+            if(job->imported.load(memory_order_acquire))
+                job->model.reset();
+    }
+
+    // true while any model is still loading or its textures are still streaming in
+    bool busy() const { return !jobs.empty() || TextureCache::instance().uploading(); }
+
+private:
+    struct Job {
+        shared_ptr<Model> model;
+        atomic<bool> imported{false};
+    };
+    vector<shared_ptr<Job>> jobs;
+};
+#endif
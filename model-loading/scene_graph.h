@@ -0,0 +1,210 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// The node hierarchy of a model, flattened into one array per field. Nodes are stored breadth
+// first: every parent comes before its children and the nodes of one depth form a contiguous
+// range. Changing a local transform only marks the node dirty, update() then recomputes the world
+// matrices of the dirty subtrees, one depth level after the other with the nodes of a level spread
+// over the shared thread pool. Nothing is touched while no node is dirty.
+const size_t kSceneGraphGrain = 1024; // nodes per task of SceneGraph::update
+
+// assimp matrices are row major, glm's are column major
+inline glm::mat4 ToGlm(const aiMatrix4x4 &m)
+{
+    return glm::mat4(m.a1, m.b1, m.c1, m.d1,
+                     m.a2, m.b2, m.c2, m.d2,
+                     m.a3, m.b3, m.c3, m.d3,
+                     m.a4, m.b4, m.c4, m.d4);
+}
+
+// splits an affine matrix into translation, rotation and scale. Shear doesn't survive the trip,
+// which is why SceneGraph keeps the local matrices as they came in until a node is edited.
+inline void DecomposeTrs(const glm::mat4 &m, glm::vec3 &translation, glm::quat &rotation, glm::vec3 &scale)
+{
+    translation = glm::vec3(m[3]);
+    glm::vec3 axes[3] = { glm::vec3(m[0]), glm::vec3(m[1]), glm::vec3(m[2]) };
+    scale = glm::vec3(glm::length(axes[0]), glm::length(axes[1]), glm::length(axes[2]));
+    if(glm::dot(glm::cross(axes[0], axes[1]), axes[2]) < 0.0f)
+        scale.x = -scale.x; // mirrored
+    for(int i = 0; i < 3; i++)
+        axes[i] = scale[i] != 0.0f ? axes[i] / scale[i] : glm::vec3(0.0f);
+    rotation = glm::normalize(glm::quat_cast(glm::mat3(axes[0], axes[1], axes[2])));
+}
+
+inline glm::mat4 ComposeTrs(const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale)
+{
+    glm::mat4 m = glm::mat4_cast(rotation);
+    m[0] *= scale.x;
+    m[1] *= scale.y;
+    m[2] *= scale.z;
+    m[3] = glm::vec4(translation, 1.0f);
+    return m;
+}
+
+class SceneGraph
+{
+public:
+    size_t size() const { return parents.size(); }
+    size_t depth() const { return levels.size(); }
+
+    const string &name(unsigned int node) const { return names[node]; }
+    int parent(unsigned int node) const { return parents[node]; } // -1 for a root
+    const glm::vec3 &translation(unsigned int node) const { return translations[node]; }
+    const glm::quat &rotation(unsigned int node) const { return rotations[node]; }
+    const glm::vec3 &scale(unsigned int node) const { return scales[node]; }
+    const glm::mat4 &local(unsigned int node) const { return locals[node]; }  // relative to the parent
+    const glm::mat4 &world(unsigned int node) const { return worlds[node]; }  // relative to the model, as of the last update()
+
+    // appends a node. Nodes have to come breadth first, a parent before its children and no node
+    // shallower than the one before it. Returns the node index.
+    unsigned int add(const string &name, int parent, const glm::mat4 &local)
+    {
+        unsigned int node = static_cast<unsigned int>(size());
+        unsigned int depth = parent < 0 ? 0 : depths[parent] + 1;
+        if(depth == levels.size())
+            levels.push_back(node);
+        names.push_back(name);
+        parents.push_back(parent);
+        depths.push_back(depth);
+        glm::vec3 t, s;
+        glm::quat r;
+        DecomposeTrs(local, t, r, s);
+        translations.push_back(t);
+        rotations.push_back(r);
+        scales.push_back(s);
+        locals.push_back(local);
+        worlds.push_back(parent < 0 ? local : worlds[parent] * local);
+        dirty.push_back(0);
+        changed.push_back(0);
+        return node;
+    }
+
+    // flattens the assimp hierarchy below root. sources (optional) receives the aiNode of every node.
+    void build(const aiNode *root, vector<const aiNode*> *sources = nullptr)
+    {
+        *this = SceneGraph();
+        deque<pair<const aiNode*, int>> queue;
+        queue.emplace_back(root, -1);
+        while(!queue.empty())
+        {
+            const aiNode *node = queue.front().first;
+            unsigned int index = add(node->mName.C_Str(), queue.front().second, ToGlm(node->mTransformation));
+            queue.pop_front();
+            if(sources)
+                sources->push_back(node);
+            for(unsigned int i = 0; i < node->mNumChildren; i++)
+                queue.emplace_back(node->mChildren[i], static_cast<int>(index));
+        }
+    }
+
+    // the first node called name, -1 if there is none
+    int find(const string &name) const
+    {
+        for(size_t i = 0; i < names.size(); i++)
+            if(names[i] == name)
+                return static_cast<int>(i);
+        return -1;
+    }
+
+    // moves a node relative to its parent, takes effect with the next update()
+    void setLocal(unsigned int node, const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale)
+    {
+        translations[node] = translation;
+        rotations[node] = rotation;
+        scales[node] = scale;
+        markDirty(node, LOCAL_DIRTY);
+    }
+
+    // the matrix is kept as given (TRS can't hold shear), it also replaces a TRS set before
+    void setLocal(unsigned int node, const glm::mat4 &local)
+    {
+        DecomposeTrs(local, translations[node], rotations[node], scales[node]);
+        locals[node] = local;
+        dirty[node] &= ~LOCAL_DIRTY;
+        markDirty(node, WORLD_DIRTY);
+    }
+
+    // recomputes the world matrices below every node that changed since the last call. Levels
+    // above the shallowest dirty node are skipped, and so is everything once a level neither
+    // changed nor has dirty nodes below it. Returns the number of world matrices recomputed.
+    size_t update()
+    {
+        if(firstDirtyLevel == UINT_MAX)
+            return 0;
+        size_t updated = 0;
+        for(size_t level = firstDirtyLevel; level < levels.size(); level++)
+        {
+            size_t begin = levels[level];
+            size_t end = level + 1 < levels.size() ? levels[level + 1] : size();
+            // the changed flags of the level above are only current from the second level on
+            bool parentsCurrent = level > firstDirtyLevel;
+            atomic<size_t> levelUpdated{0};
+            SharedThreadPool().parallelFor(end - begin, kSceneGraphGrain, [&](size_t first, size_t last) {
+                size_t count = 0;
+                for(size_t i = begin + first; i < begin + last; i++)
+                {
+                    uint8_t flags = dirty[i];
+                    int p = parents[i];
+                    bool recompute = flags || (parentsCurrent && p >= 0 && changed[p]);
+                    if(flags & LOCAL_DIRTY)
+                        locals[i] = ComposeTrs(translations[i], rotations[i], scales[i]);
+                    if(recompute)
+                        worlds[i] = p >= 0 ? worlds[p] * locals[i] : locals[i];
+                    dirty[i] = 0;
+                    changed[i] = recompute;
+                    count += recompute;
+                }
+                levelUpdated += count;
+            });
+            updated += levelUpdated;
+            if(levelUpdated == 0 && level >= lastDirtyLevel)
+                break;
+        }
+        firstDirtyLevel = UINT_MAX;
+        lastDirtyLevel = 0;
+        return updated;
+    }
+
+private:
+    enum : uint8_t {
+        LOCAL_DIRTY = 1, // the TRS changed, the local matrix has to be rebuilt
+        WORLD_DIRTY = 2  // the local matrix changed
+    };
+
+    vector<string>       names;
+    vector<int>          parents;
+    vector<unsigned int> depths;
+    vector<glm::vec3>    translations;
+    vector<glm::quat>    rotations;
+    vector<glm::vec3>    scales;
+    vector<glm::mat4>    locals;
+    vector<glm::mat4>    worlds;
+    vector<uint8_t>      dirty;
+    vector<uint8_t>      changed;  // update() scratch: the world matrix was recomputed
+    vector<unsigned int> levels;   // first node of every depth
+    unsigned int firstDirtyLevel = UINT_MAX, lastDirtyLevel = 0;
+
+    void markDirty(unsigned int node, uint8_t flags)
+    {
+        dirty[node] |= flags;
+        firstDirtyLevel = std::min(firstDirtyLevel, depths[node]);
+        lastDirtyLevel = std::max(lastDirtyLevel, depths[node]);
+    }
+};
+#endif
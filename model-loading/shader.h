@@ -8,6 +8,7 @@
 #define SHADER_H
 
 #include <glad/glad.h>
+#include <learnopengl/gl_state.h>
 #include <glm/glm.hpp>
 
 #include <string>
@@ -106,7 +107,7 @@ public:
     // ------------------------------------------------------------------------
     void use()
     {
-        glUseProgram(ID);
+        GLState::instance().useProgram(ID);
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
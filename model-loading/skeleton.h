@@ -0,0 +1,172 @@
+#ifndef SKELETON_H
+#define SKELETON_H
+
+#include <glad/glad.h>
+#include <assimp/mesh.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+
+#include "scene_graph.h"
+#include "shader.h"
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Bones of a model for GPU skinning. Every vertex keeps its MAX_BONE_INFLUENCE strongest bones
+// (renormalized) in Vertex::m_BoneIDs/m_Weights, the ids index the model wide bone list. The bones
+// are driven by scene graph nodes, their matrices go to the shader once per frame through the
+// BonePalette uniform block (model-loading-skinned.vs).
+const unsigned int kMaxBones = 128;          // size of the uniform block, 8 KiB of mat4s
+const GLuint kBonePaletteBinding = 0;        // uniform buffer binding point of the palette
+
+struct Bone {
+    string name;
+    glm::mat4 offset; // mesh space -> bone space in bind pose (aiBone::mOffsetMatrix)
+    int node = -1;    // the SceneGraph node that moves the bone, -1 keeps it in bind pose
+};
+
+class Skeleton
+{
+public:
+    vector<Bone> bones;
+
+    bool empty() const { return bones.empty(); }
+
+    // the index of a bone, registering it on first sight. Meshes that share a bone share its index.
+    unsigned int add(const string &name, const glm::mat4 &offset)
+    {
+        auto found = index.find(name);
+        if(found != index.end())
+            return found->second;
+        unsigned int id = static_cast<unsigned int>(bones.size());
+        index.emplace(name, id);
+        bones.push_back({ name, offset, -1 });
+        return id;
+    }
+
+    int find(const string &name) const
+    {
+        auto found = index.find(name);
+        return found == index.end() ? -1 : static_cast<int>(found->second);
+    }
+
+    // attaches every bone to the node of the same name
+    void bind(const SceneGraph &nodes)
+    {
+        for(Bone &bone : bones)
+            bone.node = nodes.find(bone.name);
+    }
+
+    // the skinning matrices of the current pose: bind pose mesh space -> model space
+    void palette(const SceneGraph &nodes, vector<glm::mat4> &matrices) const
+    {
+        matrices.resize(bones.size());
+        for(size_t i = 0; i < bones.size(); i++)
+            matrices[i] = bones[i].node >= 0 ? nodes.world(bones[i].node) * bones[i].offset : glm::mat4(1.0f);
+    }
+
+private:
+    unordered_map<string, unsigned int> index;
+};
+
+// fills the bone slots of vertices (converted from mesh) with the MAX_BONE_INFLUENCE heaviest
+// influences of every vertex, renormalized to sum up to one. Returns the number of influences that
+// didn't fit. Bones past kMaxBones have no palette slot, their influences are left out and counted
+// in outOfPalette instead. The skeleton must already know all bones of the mesh.
+inline size_t ImportBoneWeights(const aiMesh *mesh, const Skeleton &skeleton, vector<Vertex> &vertices, size_t *outOfPalette = nullptr)
+{
+    size_t dropped = 0;
+    for(unsigned int b = 0; b < mesh->mNumBones; b++)
+    {
+        const aiBone *bone = mesh->mBones[b];
+        int id = skeleton.find(bone->mName.C_Str());
+        if(id >= static_cast<int>(kMaxBones))
+        {
+            if(outOfPalette)
+                *outOfPalette += bone->mNumWeights;
+            continue;
+        }
+        for(unsigned int w = 0; w < bone->mNumWeights; w++)
+        {
+            const aiVertexWeight &influence = bone->mWeights[w];
+            if(influence.mVertexId >= vertices.size() || influence.mWeight <= 0.0f || id < 0)
+                continue;
+            // replace the lightest slot, empty slots weigh zero
+            Vertex &v = vertices[influence.mVertexId];
+            int lightest = 0;
+            for(int i = 1; i < MAX_BONE_INFLUENCE; i++)
+                if(v.m_Weights[i] < v.m_Weights[lightest])
+                    lightest = i;
+            if(v.m_Weights[lightest] > 0.0f)
+                dropped++;
+            if(influence.mWeight > v.m_Weights[lightest])
+            {
+                v.m_BoneIDs[lightest] = id;
+                v.m_Weights[lightest] = influence.mWeight;
+            }
+        }
+    }
+    for(Vertex &v : vertices)
+    {
+        float total = 0.0f;
+        for(int i = 0; i < MAX_BONE_INFLUENCE; i++)
+            total += v.m_Weights[i];
+        if(total > 0.0f)
+            for(int i = 0; i < MAX_BONE_INFLUENCE; i++)
+                v.m_Weights[i] /= total;
+    }
+    return dropped;
+}
+
+// the uniform buffer behind the BonePalette block. Owns its GL object, lives on the GL thread.
+class BonePalette
+{
+public:
+    BonePalette() = default;
+    BonePalette(const BonePalette&) = delete;
+    BonePalette &operator=(const BonePalette&) = delete;
+    ~BonePalette()
+    {
+        if(UBO)
+            GLState::instance().deleteBuffers(1, &UBO);
+    }
+
+    // replaces the palette. Only kMaxBones fit, ImportBoneWeights keeps vertices off the others.
+    void upload(const vector<glm::mat4> &matrices)
+    {
+        if(!UBO)
+        {
+            glGenBuffers(1, &UBO);
+            GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, UBO);
+            glBufferData(GL_UNIFORM_BUFFER, kMaxBones * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+        }
+        else
+            GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        size_t count = std::min<size_t>(matrices.size(), kMaxBones);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, count * sizeof(glm::mat4), matrices.data());
+        GLState::instance().bindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // makes the palette the one the shader's BonePalette block reads
+    void bind(const Shader &shader)
+    {
+        if(shader.ID != program)
+        {
+            GLuint block = glGetUniformBlockIndex(shader.ID, "BonePalette");
+            if(block != GL_INVALID_INDEX)
+                glUniformBlockBinding(shader.ID, block, kBonePaletteBinding);
+            program = shader.ID;
+        }
+        GLState::instance().bindBufferBase(GL_UNIFORM_BUFFER, kBonePaletteBinding, UBO);
+    }
+
+private:
+    GLuint UBO = 0;
+    unsigned int program = 0; // the last program bind() wired up
+};
+#endif
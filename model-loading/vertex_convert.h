@@ -0,0 +1,101 @@
+#ifndef VERTEX_CONVERT_H
+#define VERTEX_CONVERT_H
+
+#include <assimp/mesh.h>
+
+#include <learnopengl/simd.h>
+#include <learnopengl/thread_pool.h>
+
+#include "vertex_format.h"
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// Bulk conversion of an aiMesh (one array per attribute) into interleaved Vertex structs. Every
+// vec3 travels as a single 16 byte load and store instead of going through a placeholder field by
+// field. Large meshes are split into ranges that convert in parallel on the shared thread pool.
+const size_t kConvertGrain = 32768; // vertices or faces per task
+
+namespace convert
+{
+    using namespace simd;
+
+    // element i of a vec3 array in the low three lanes. The wide load reaches into the next
+    // element, except for the last one which would read past the end of the array.
+    inline float4 load3(const aiVector3D *v, size_t i, size_t count)
+    {
+        if(i + 1 < count)
+            return load4(&v[i].x);
+        float last[4] = { v[i].x, v[i].y, v[i].z, 0.0f };
+        return load4(last);
+    }
+}
+
+// converts vertices [begin, end) of mesh into out[begin, end). A 16 byte store of a vec3 spills
+// into the first lane of the next field, so the fields are written strictly in declaration order
+// and each store overwrites the spill of the previous one. Absent attributes come out as zero.
+inline void ConvertVertices(const aiMesh *mesh, Vertex *out, size_t begin, size_t end)
+{
+    static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "assimp must be built with single precision");
+    static_assert(offsetof(Vertex, Normal) == 3 * sizeof(float) && offsetof(Vertex, TexCoords) == 6 * sizeof(float) &&
+                  offsetof(Vertex, Tangent) == 8 * sizeof(float) && offsetof(Vertex, Bitangent) == 11 * sizeof(float) &&
+                  offsetof(Vertex, m_BoneIDs) == 14 * sizeof(float) && offsetof(Vertex, m_Weights) == 18 * sizeof(float) &&
+                  sizeof(Vertex) == 22 * sizeof(float), "ConvertVertices expects the Vertex layout of vertex_format.h");
+    using namespace convert;
+
+    size_t count = mesh->mNumVertices;
+    const aiVector3D *positions = mesh->mVertices;
+    const aiVector3D *normals = mesh->HasNormals() ? mesh->mNormals : nullptr;
+    const aiVector3D *uvs = mesh->mTextureCoords[0];
+    // tangents only count together with uvs, see Model::meshAttributes
+    const aiVector3D *tangents = uvs ? mesh->mTangents : nullptr;
+    const aiVector3D *bitangents = uvs ? mesh->mBitangents : nullptr;
+    const float4 zero = zero4();
+    for(size_t i = begin; i < end; i++)
+    {
+        float *v = &out[i].Position.x;
+        store4(v + 0, load3(positions, i, count));
+        store4(v + 3, normals ? load3(normals, i, count) : zero);
+        store4(v + 6, uvs ? load3(uvs, i, count) : zero); // u, v and the unused w that the tangent overwrites
+        store4(v + 8, tangents ? load3(tangents, i, count) : zero);
+        store4(v + 11, bitangents ? load3(bitangents, i, count) : zero);
+        store4(v + 14, zero); // bone ids
+        store4(v + 18, zero); // weights
+    }
+}
+
+// all vertices of mesh, converted in parallel ranges
+inline vector<Vertex> ConvertVertices(const aiMesh *mesh)
+{
+    vector<Vertex> vertices(mesh->mNumVertices);
+    SharedThreadPool().parallelFor(vertices.size(), kConvertGrain, [&](size_t begin, size_t end) {
+        ConvertVertices(mesh, vertices.data(), begin, end);
+    });
+    return vertices;
+}
+
+// the index buffer of mesh. aiProcess_Triangulate leaves triangle-only meshes behind, their faces
+// are copied with one fixed size copy each, in parallel ranges. Anything else (points, lines)
+// keeps the old face by face path.
+inline vector<unsigned int> ConvertIndices(const aiMesh *mesh)
+{
+    vector<unsigned int> indices;
+    if((mesh->mPrimitiveTypes & ~aiPrimitiveType_NGONEncodingFlag) == aiPrimitiveType_TRIANGLE)
+    {
+        indices.resize(size_t(mesh->mNumFaces) * 3);
+        SharedThreadPool().parallelFor(mesh->mNumFaces, kConvertGrain, [&](size_t begin, size_t end) {
+            for(size_t f = begin; f < end; f++)
+                memcpy(&indices[f * 3], mesh->mFaces[f].mIndices, 3 * sizeof(unsigned int));
+        });
+        return indices;
+    }
+    for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+    {
+        const aiFace &face = mesh->mFaces[i];
+        indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
+    }
+    return indices;
+}
+#endif
@@ -0,0 +1,318 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#define MAX_BONE_INFLUENCE 4
+
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+    //bone indexes which will influence this vertex
+    int m_BoneIDs[MAX_BONE_INFLUENCE];
+    //weights from each bone
+    float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+// attribute slots, the bit index equals the layout location used by setupMesh and the shaders
+enum VertexAttribute {
+    VERTEX_POSITION  = 1 << 0,
+    VERTEX_NORMAL    = 1 << 1,
+    VERTEX_TEXCOORDS = 1 << 2,
+    VERTEX_TANGENT   = 1 << 3,
+    VERTEX_BITANGENT = 1 << 4,
+    VERTEX_BONE_IDS  = 1 << 5,
+    VERTEX_WEIGHTS   = 1 << 6
+};
+const unsigned int kAllVertexAttributes = 0x7f;
+// vec4 of texture array layers (diffuse, specular, normal, height), not part of Vertex: a per draw
+// constant set by Mesh::BindTextures or the layer stream of a ModelBuffer (see texture_array.h)
+const unsigned int kTextureLayersLocation = 7;
+
+// what a mesh should be uploaded as. The default is the plain Vertex struct with every attribute,
+// compact selects the quantized layout below and only keeps attributes that are both available and used.
+struct VertexFormat {
+    unsigned int available = kAllVertexAttributes; // attributes the source data actually has
+    unsigned int used = kAllVertexAttributes;      // attributes the shader reads
+    bool compact = false;
+};
+
+// Compact layout, every attribute optional except the position:
+//   position   3 x unorm16 + pad  8 bytes  relative to the mesh AABB (positionOffset/positionScale uniforms)
+//   normal     2 x snorm16        4 bytes  octahedral encoding
+//   texcoords  2 x half           4 bytes
+//   tangent    snorm 10:10:10:2   4 bytes  xyz tangent, w = bitangent handedness (+1/-1)
+//   bone ids   4 x uint8          4 bytes
+//   weights    4 x unorm8         4 bytes
+// The bitangent is rebuilt in the shader as cross(normal, tangent) * w.
+// Worst case that's 28 bytes per vertex against the 88 of Vertex, a static textured mesh is 20.
+struct VertexLayout {
+    unsigned int attributes = kAllVertexAttributes;
+    bool compact = false;
+    GLsizei stride = 0;
+    size_t offsets[7] = {};
+    glm::vec3 positionOffset = glm::vec3(0.0f); // object space position = offset + decoded * scale
+    glm::vec3 positionScale = glm::vec3(1.0f);
+};
+
+// attributes the linked program actually reads, as VertexAttribute bits of their locations
+inline unsigned int ActiveVertexAttributes(unsigned int program)
+{
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    vector<GLchar> name(std::max(maxLength, 1));
+    unsigned int attributes = 0;
+    for(GLint i = 0; i < count; i++)
+    {
+        GLint size;
+        GLenum type;
+        glGetActiveAttrib(program, i, maxLength, nullptr, &size, &type, name.data());
+        GLint location = glGetAttribLocation(program, name.data());
+        if(location >= 0 && location < 7)
+            attributes |= 1u << location;
+    }
+    // the position is never optional
+    return attributes | VERTEX_POSITION;
+}
+
+// octahedral mapping of a unit vector onto the [-1, 1] square
+inline glm::vec2 OctEncode(glm::vec3 n)
+{
+    n /= (std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z));
+    glm::vec2 p(n.x, n.y);
+    if(n.z < 0.0f)
+    {
+        p.x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        p.y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return p;
+}
+
+inline glm::vec3 OctDecode(glm::vec2 e)
+{
+    glm::vec3 v(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    if(v.z < 0.0f)
+    {
+        float x = v.x;
+        v.x = (1.0f - std::fabs(v.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        v.y = (1.0f - std::fabs(x)) * (v.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return glm::normalize(v);
+}
+
+// stride and attribute offsets of a layout, positionOffset/positionScale are left alone
+inline void ComputeVertexOffsets(VertexLayout &layout)
+{
+    if(!layout.compact)
+        return; // plain Vertex, offsets come from offsetof in setupMesh
+    static const size_t sizes[7] = { 8, 4, 4, 4, 0, 4, 4 };
+    size_t offset = 0;
+    for(unsigned int i = 0; i < 7; i++)
+    {
+        layout.offsets[i] = offset;
+        if(layout.attributes & (1u << i))
+            offset += sizes[i];
+    }
+    layout.stride = static_cast<GLsizei>(offset);
+}
+
+inline size_t IndexSize(size_t vertexCount)
+{
+    return vertexCount < 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// indices in the smallest type that can address vertexCount vertices
+inline vector<unsigned char> PackIndices(const unsigned int *indices, size_t indexCount, size_t vertexCount)
+{
+    vector<unsigned char> packed(indexCount * IndexSize(vertexCount));
+    if(IndexSize(vertexCount) == sizeof(uint32_t))
+        memcpy(packed.data(), indices, packed.size());
+    else
+    {
+        uint16_t *out = reinterpret_cast<uint16_t*>(packed.data());
+        for(size_t i = 0; i < indexCount; i++)
+            out[i] = static_cast<uint16_t>(indices[i]);
+    }
+    return packed;
+}
+
+inline uint16_t QuantizeUnorm16(float v)
+{
+    return static_cast<uint16_t>(std::lround(std::min(std::max(v, 0.0f), 1.0f) * 65535.0f));
+}
+
+inline int16_t QuantizeSnorm16(float v)
+{
+    return static_cast<int16_t>(std::lround(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f));
+}
+
+// the layout for vertices within the box [lo, hi], compact positions are quantized on that box
+inline VertexLayout MakeVertexLayout(const VertexFormat &format, glm::vec3 lo, glm::vec3 hi)
+{
+    VertexLayout layout;
+    layout.compact = format.compact;
+    layout.attributes = format.compact ? ((format.available & format.used) | VERTEX_POSITION) & ~VERTEX_BITANGENT : kAllVertexAttributes;
+    if(layout.compact)
+    {
+        layout.positionOffset = lo;
+        layout.positionScale = hi - lo;
+    }
+    ComputeVertexOffsets(layout);
+    return layout;
+}
+
+inline void ExpandBounds(const Vertex *vertices, size_t vertexCount, glm::vec3 &lo, glm::vec3 &hi)
+{
+    for(size_t i = 0; i < vertexCount; i++)
+    {
+        lo = glm::min(lo, vertices[i].Position);
+        hi = glm::max(hi, vertices[i].Position);
+    }
+}
+
+// picks the layout for a mesh, the quantization grid spans the AABB of its positions
+inline VertexLayout MakeVertexLayout(const VertexFormat &format, const Vertex *vertices, size_t vertexCount)
+{
+    glm::vec3 lo(0.0f), hi(0.0f);
+    if(format.compact && vertexCount > 0)
+    {
+        lo = hi = vertices[0].Position;
+        ExpandBounds(vertices, vertexCount, lo, hi);
+    }
+    return MakeVertexLayout(format, lo, hi);
+}
+
+// converts Vertex data into a compact layout
+inline vector<unsigned char> PackVertices(const Vertex *vertices, size_t vertexCount, const VertexLayout &layout)
+{
+    vector<unsigned char> packed(vertexCount * layout.stride);
+    glm::vec3 invScale;
+    for(int c = 0; c < 3; c++)
+        invScale[c] = layout.positionScale[c] != 0.0f ? 1.0f / layout.positionScale[c] : 0.0f;
+
+    for(size_t i = 0; i < vertexCount; i++)
+    {
+        const Vertex &v = vertices[i];
+        unsigned char *out = packed.data() + i * layout.stride;
+
+        glm::vec3 p = (v.Position - layout.positionOffset) * invScale;
+        uint16_t position[4] = { QuantizeUnorm16(p.x), QuantizeUnorm16(p.y), QuantizeUnorm16(p.z), 0 };
+        memcpy(out + layout.offsets[0], position, sizeof(position));
+
+        if(layout.attributes & VERTEX_NORMAL)
+        {
+            glm::vec2 e = glm::length(v.Normal) > 0.0f ? OctEncode(v.Normal) : glm::vec2(0.0f);
+            int16_t normal[2] = { QuantizeSnorm16(e.x), QuantizeSnorm16(e.y) };
+            memcpy(out + layout.offsets[1], normal, sizeof(normal));
+        }
+        if(layout.attributes & VERTEX_TEXCOORDS)
+        {
+            uint32_t uv = glm::packHalf2x16(v.TexCoords);
+            memcpy(out + layout.offsets[2], &uv, sizeof(uv));
+        }
+        if(layout.attributes & VERTEX_TANGENT)
+        {
+            glm::vec3 t = glm::length(v.Tangent) > 0.0f ? glm::normalize(v.Tangent) : glm::vec3(0.0f);
+            float handedness = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            uint32_t tangent = glm::packSnorm3x10_1x2(glm::vec4(t, handedness));
+            memcpy(out + layout.offsets[3], &tangent, sizeof(tangent));
+        }
+        if(layout.attributes & VERTEX_BONE_IDS)
+        {
+            unsigned char ids[4];
+            for(int b = 0; b < 4; b++)
+                ids[b] = static_cast<unsigned char>(std::min(std::max(v.m_BoneIDs[b], 0), 255));
+            memcpy(out + layout.offsets[5], ids, sizeof(ids));
+        }
+        if(layout.attributes & VERTEX_WEIGHTS)
+        {
+            unsigned char weights[4];
+            for(int b = 0; b < 4; b++)
+                weights[b] = static_cast<unsigned char>(std::lround(std::min(std::max(v.m_Weights[b], 0.0f), 1.0f) * 255.0f));
+            memcpy(out + layout.offsets[6], weights, sizeof(weights));
+        }
+    }
+    return packed;
+}
+
+// points the attributes of the currently bound VAO/VBO at a layout, baseOffset is where the
+// first vertex starts inside the buffer
+inline void SetVertexAttributes(const VertexLayout &layout, size_t baseOffset = 0)
+{
+    auto at = [baseOffset](size_t offset) { return reinterpret_cast<void*>(baseOffset + offset); };
+    if(!layout.compact)
+    {
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), at(0));
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), at(offsetof(Vertex, Normal)));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), at(offsetof(Vertex, TexCoords)));
+        // vertex tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), at(offsetof(Vertex, Tangent)));
+        // vertex bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), at(offsetof(Vertex, Bitangent)));
+        // ids
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), at(offsetof(Vertex, m_BoneIDs)));
+        // weights
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), at(offsetof(Vertex, m_Weights)));
+        return;
+    }
+
+    GLsizei stride = layout.stride;
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, at(layout.offsets[0]));
+    if(layout.attributes & VERTEX_NORMAL)
+    {
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, at(layout.offsets[1]));
+    }
+    if(layout.attributes & VERTEX_TEXCOORDS)
+    {
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, at(layout.offsets[2]));
+    }
+    if(layout.attributes & VERTEX_TANGENT)
+    {
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, at(layout.offsets[3]));
+    }
+    if(layout.attributes & VERTEX_BONE_IDS)
+    {
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 4, GL_UNSIGNED_BYTE, stride, at(layout.offsets[5]));
+    }
+    if(layout.attributes & VERTEX_WEIGHTS)
+    {
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, at(layout.offsets[6]));
+    }
+}
+#endif
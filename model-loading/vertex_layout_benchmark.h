@@ -0,0 +1,62 @@
+#ifndef VERTEX_LAYOUT_BENCHMARK_H
+#define VERTEX_LAYOUT_BENCHMARK_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+
+#include "model.h"
+#include "shader.h"
+
+#include <iostream>
+#include <string>
+using namespace std;
+
+// GPU time of the same draw with the model in the plain Vertex layout and in the compact one
+// (vertex_format.h): everything at full detail, without meshlet or face culling, so both fetch every
+// vertex the index buffers reference. The model is loaded once per layout with options otherwise
+// unchanged, each with its own vertex shader. Waits on its timer queries, meant to run once before
+// the render loop.
+inline void RunVertexLayoutBenchmark(const string &path, ModelOptions options, Shader &plainShader, Shader &compactShader,
+                                     const glm::mat4 &projection, const glm::mat4 &view, unsigned int frames = 50)
+{
+    bool faceCulling = glIsEnabled(GL_CULL_FACE) == GL_TRUE;
+    GLState::instance().disable(GL_CULL_FACE);
+    unsigned int query;
+    glGenQueries(1, &query);
+    double plainSeconds = 0.0;
+    for(bool compact : { false, true })
+    {
+        Shader &shader = compact ? compactShader : plainShader;
+        options.compactVertices = compact;
+        options.vertexAttributes = ActiveVertexAttributes(shader.ID);
+        Model model(path, false, options);
+        shader.use();
+        shader.setMat4("projection", projection);
+        shader.setMat4("view", view);
+        model.Draw(shader); // warm up: first use of the buffers and textures
+        double seconds = 0.0;
+        for(unsigned int frame = 0; frame < frames; frame++)
+        {
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            model.Draw(shader);
+            glEndQuery(GL_TIME_ELAPSED);
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+            seconds += elapsed * 1e-9;
+        }
+        seconds /= frames;
+        size_t vertices = std::max<size_t>(model.vertexCount(), 1);
+        cout << "VERTEX_LAYOUT:: " << (compact ? "compact" : "plain") << ": " << double(model.vertexBytes()) / vertices << " bytes/vertex, "
+             << seconds * 1e3 << " ms per draw, " << model.indexCount() / std::max(seconds, 1e-9) / 1e6 << " M indices/s";
+        if(compact && plainSeconds > 0.0 && seconds > 0.0)
+            cout << " (" << plainSeconds / seconds << "x plain)";
+        cout << endl;
+        plainSeconds = compact ? plainSeconds : seconds;
+    }
+    glDeleteQueries(1, &query);
+    if(faceCulling)
+        GLState::instance().enable(GL_CULL_FACE);
+}
+#endif
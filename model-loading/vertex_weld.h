@@ -0,0 +1,170 @@
+#ifndef VERTEX_WELD_H
+#define VERTEX_WELD_H
+
+#include <learnopengl/content_hash.h>
+#include <learnopengl/thread_pool.h>
+
+#include "vertex_format.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// Merges duplicate vertices of a mesh and rewrites its indices.
+//   WELD_EXACT      only bit-identical vertices are merged, the output renders exactly like the input
+//   WELD_TOLERANCE  every float attribute is snapped to a grid of the given tolerance first, vertices
+//                   landing in the same cell are merged. Near-duplicates that straddle a cell border
+//                   stay separate, which costs a few missed merges but keeps the pass O(n).
+// Merged vertices take the values of the first vertex (in index order) of their group.
+enum WeldMode {
+    WELD_NONE,
+    WELD_EXACT,
+    WELD_TOLERANCE
+};
+
+struct WeldOptions {
+    WeldMode mode = WELD_EXACT;
+    float positionTolerance = 1e-5f;
+    float attributeTolerance = 1e-3f; // normals, uvs, tangents and weights
+};
+
+namespace weld
+{
+    // the float attributes of a Vertex in declaration order, positions first
+    const int kFloatCount = 3 + 3 + 2 + 3 + 3;
+
+    struct QuantizedKey {
+        int64_t values[kFloatCount + MAX_BONE_INFLUENCE * 2];
+        bool operator==(const QuantizedKey &other) const
+        {
+            return memcmp(values, other.values, sizeof(values)) == 0;
+        }
+    };
+
+    inline QuantizedKey quantize(const Vertex &v, const WeldOptions &options)
+    {
+        const float *f = &v.Position.x; // Vertex is tightly packed floats up to the bone slots
+        QuantizedKey key;
+        for(int i = 0; i < kFloatCount; i++)
+        {
+            float step = i < 3 ? options.positionTolerance : options.attributeTolerance;
+            key.values[i] = static_cast<int64_t>(std::floor(f[i] / step + 0.5f));
+        }
+        for(int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        {
+            key.values[kFloatCount + i] = v.m_BoneIDs[i];
+            key.values[kFloatCount + MAX_BONE_INFLUENCE + i] = static_cast<int64_t>(std::floor(v.m_Weights[i] / options.attributeTolerance + 0.5f));
+        }
+        return key;
+    }
+
+    inline bool equal(const Vertex &a, const Vertex &b, const WeldOptions &options)
+    {
+        if(options.mode == WELD_EXACT)
+            return memcmp(&a, &b, sizeof(Vertex)) == 0;
+        return quantize(a, options) == quantize(b, options);
+    }
+
+    inline uint64_t hash(const Vertex &v, const WeldOptions &options)
+    {
+        if(options.mode == WELD_EXACT)
+            return HashBytes(&v, sizeof(Vertex));
+        QuantizedKey key = quantize(v, options);
+        return HashBytes(key.values, sizeof(key.values));
+    }
+}
+
+// returns the number of vertices removed
+inline size_t WeldVertices(vector<Vertex> &vertices, vector<unsigned int> &indices, const WeldOptions &options = WeldOptions())
+{
+    static_assert(sizeof(Vertex) == (weld::kFloatCount + MAX_BONE_INFLUENCE * 2) * 4, "Vertex must not contain padding");
+    size_t vertexCount = vertices.size();
+    if(options.mode == WELD_NONE || vertexCount < 2)
+        return 0;
+
+    ThreadPool &pool = SharedThreadPool();
+    const size_t grain = 16384;
+
+    // 1. hash every vertex in parallel
+    vector<uint64_t> hashes(vertexCount);
+    pool.parallelFor(vertexCount, grain, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+            hashes[i] = weld::hash(vertices[i], options);
+    });
+
+    // 2. bucket vertices into shards by hash (counting sort keeps every shard in index order)
+    const size_t shardCount = std::max<size_t>(1, pool.size() * 4);
+    vector<size_t> shardStart(shardCount + 1, 0);
+    for(size_t i = 0; i < vertexCount; i++)
+        shardStart[hashes[i] % shardCount + 1]++;
+    for(size_t s = 0; s < shardCount; s++)
+        shardStart[s + 1] += shardStart[s];
+    vector<unsigned int> shardVertices(vertexCount);
+    {
+        vector<size_t> fill(shardStart.begin(), shardStart.end() - 1);
+        for(size_t i = 0; i < vertexCount; i++)
+            shardVertices[fill[hashes[i] % shardCount]++] = static_cast<unsigned int>(i);
+    }
+
+    // 3. every shard finds the representative (first occurrence) of each of its vertices with an
+    //    open addressing table, shards are independent so they run in parallel
+    vector<unsigned int> representative(vertexCount);
+    pool.parallelFor(shardCount, 1, [&](size_t shardBegin, size_t shardEnd) {
+        vector<unsigned int> table;
+        for(size_t s = shardBegin; s < shardEnd; s++)
+        {
+            size_t count = shardStart[s + 1] - shardStart[s];
+            if(count == 0)
+                continue;
+            size_t capacity = 1;
+            while(capacity < count * 2)
+                capacity <<= 1;
+            const unsigned int empty = ~0u;
+            table.assign(capacity, empty);
+            for(size_t k = shardStart[s]; k < shardStart[s + 1]; k++)
+            {
+                unsigned int v = shardVertices[k];
+                size_t slot = (hashes[v] / shardCount) & (capacity - 1);
+                for(;;)
+                {
+                    unsigned int candidate = table[slot];
+                    if(candidate == empty)
+                    {
+                        table[slot] = v;
+                        representative[v] = v;
+                        break;
+                    }
+                    if(hashes[candidate] == hashes[v] && weld::equal(vertices[candidate], vertices[v], options))
+                    {
+                        representative[v] = candidate;
+                        break;
+                    }
+                    slot = (slot + 1) & (capacity - 1);
+                }
+            }
+        }
+    });
+
+    // 4. compact in original order, then rewrite the indices in parallel
+    vector<unsigned int> remap(vertexCount);
+    size_t kept = 0;
+    for(size_t i = 0; i < vertexCount; i++)
+    {
+        if(representative[i] == i)
+        {
+            remap[i] = static_cast<unsigned int>(kept);
+            vertices[kept++] = vertices[i];
+        }
+        else
+            remap[i] = remap[representative[i]]; // representatives always come first
+    }
+    vertices.resize(kept);
+    pool.parallelFor(indices.size(), grain * 4, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+            indices[i] = remap[indices[i]];
+    });
+    return vertexCount - kept;
+}
+#endif
@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "glad/glad.h"
+#include <learnopengl/gl_state.h>
 #include <GLFW/glfw3.h>
 
 #include "shader_s.h"
@@ -23,7 +24,7 @@ inline void processInput(GLFWwindow* window) {
 
 inline void drawTris(const Shader &shader, unsigned int vao) {
     shader.use();
-    glBindVertexArray(vao);
+    GLState::instance().bindVertexArray(vao);
     glDrawArrays(GL_TRIANGLES, 0, 3);
 }
 
@@ -90,23 +91,24 @@ int main() {
         glfwPollEvents();
     }
 
-    glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &vbo);
+    GLState::instance().deleteVertexArrays(1, &vao);
+    GLState::instance().deleteBuffers(1, &vbo);
+    GLState::instance().report();
     glfwTerminate();
     return 0;
 }
 
 void genVertexData(const std::vector<float>& vertex_vec, unsigned int& vao, unsigned int& vbo) {
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    GLState::instance().bindVertexArray(vao);
+    GLState::instance().bindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * static_cast<GLsizeiptr>(vertex_vec.size()), vertex_vec.data(), GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)nullptr);
     glEnableVertexAttribArray(0);
 }
 
 void genVertexWithColorData(const std::vector<float>& vertex_vec, unsigned int& vao, unsigned int& vbo) {
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    GLState::instance().bindVertexArray(vao);
+    GLState::instance().bindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * static_cast<GLsizeiptr>(vertex_vec.size()), vertex_vec.data(), GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), (void*)nullptr);
     glEnableVertexAttribArray(0);
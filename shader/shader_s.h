@@ -6,6 +6,7 @@
 #define SHADER_SHADER_S_H
 
 #include <glad/glad.h>
+#include <learnopengl/gl_state.h>
 
 #include <string>
 #include <fstream>
@@ -75,14 +76,14 @@ public:
     }
 
     ~Shader() {
-        glDeleteProgram(ID);
+        GLState::instance().deleteProgram(ID);
     }
 
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     {
-        glUseProgram(ID);
+        GLState::instance().useProgram(ID);
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
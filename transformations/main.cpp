@@ -1,6 +1,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <std_image.h>
 #include <glad/glad.h>
+#include <learnopengl/gl_state.h>
 #include <GLFW/glfw3.h>
 
 #include <iostream>
@@ -60,12 +61,12 @@ int main() {
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
 
-    glBindVertexArray(VAO);
+    GLState::instance().bindVertexArray(VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLState::instance().bindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    GLState::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
     // position attribute
@@ -82,7 +83,7 @@ int main() {
     // texture 1
     // ---------
     glGenTextures(1, &texture1);
-    glBindTexture(GL_TEXTURE_2D, texture1);
+    GLState::instance().bindTexture(GL_TEXTURE_2D, texture1);
     // set the texture wrapping parameters
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -108,7 +109,7 @@ int main() {
     // texture 2
     // ---------
     glGenTextures(1, &texture2);
-    glBindTexture(GL_TEXTURE_2D, texture2);
+    GLState::instance().bindTexture(GL_TEXTURE_2D, texture2);
     // set the texture wrapping parameters
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -151,10 +152,8 @@ int main() {
         glClear(GL_COLOR_BUFFER_BIT);
 
         // bind textures on corresponding texture units
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture1);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texture2);
+        GLState::instance().bindTexture(0, GL_TEXTURE_2D, texture1);
+        GLState::instance().bindTexture(1, GL_TEXTURE_2D, texture2);
 
         // create transformations
         glm::mat4 transform_trans_rot = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
@@ -174,13 +173,13 @@ int main() {
         glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(transform_trans_rot));
 
         // render container
-        glBindVertexArray(VAO);
+        GLState::instance().bindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
         shaders_trans.use();
         unsigned int transformOnly = glGetUniformLocation(shaders_trans.ID, "transform_trans");
         glUniformMatrix4fv(transformOnly, 1, GL_FALSE, glm::value_ptr(transform_trans));
-        glBindVertexArray(VAO);
+        GLState::instance().bindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -191,10 +190,11 @@ int main() {
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
+    GLState::instance().deleteVertexArrays(1, &VAO);
+    GLState::instance().deleteBuffers(1, &VBO);
+    GLState::instance().deleteBuffers(1, &EBO);
 
+    GLState::instance().report();
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();